@@ -8,6 +8,7 @@
  * \details All NBT specifics are handled via callbacks defined in *nbt-usecase-ch.h*.
  */
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -19,39 +20,31 @@
 #include "wiced_bt_stack.h"
 #include "wiced_bt_gatt.h"
 #include "wiced_bt_ble.h"
+#include "wiced_timer.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
 
-#include "mbedtls/cipher.h"
-#include "mbedtls/cmac.h"
-
 #include "infineon/ifx-logger.h"
 
+#include "advertising-filter.h"
+#include "advertising-payload.h"
 #include "data-storage.h"
+#include "gatt-provider.h"
+#include "hci-snoop.h"
+#include "heap-guard.h"
+#include "key-cache.h"
 #include "bluetooth-handling.h"
+#include "link-monitor.h"
+#include "log-limiter.h"
+#include "metrics.h"
+#include "watchdog-supervisor.h"
 
 /**
  * \brief String used as source information for logging.
  */
 #define LOG_TAG "NBT example"
 
-/**
- * \brief Bonding information being kept both in RAM as well as persistent storage.
- */
-struct
-{
-    /**
-     * \brief Device link keys of bonded device.
-     */
-    wiced_bt_device_link_keys_t device_link_keys;
-
-    /**
-     * \brief Simple flag if a device is currently bonded.
-     */
-    bool bonded;
-} bonding_info;
-
 /**
  * \brief Current value of *Client Characteristic Configuration Descriptor*.
  * \details Kept both in RAM as well as persistent storage to have same CCCD value after reboot.
@@ -64,10 +57,227 @@ static uint16_t cccd;
 static uint16_t connection_id = 0x0000U;
 
 /**
- * \brief Local identity keys currently in use.
- * \details Kept both in RAM as well as persistent storage to have same keys available after reboot.
+ * \brief Bluetooth SIG company identifier used for manufacturer specific advertising data (Infineon Technologies AG).
+ */
+#define BLE_ADVERTISING_COMPANY_ID 0x0009U
+
+/**
+ * \brief Advertised status flag set while a device is bonded.
+ */
+#define BLE_ADVERTISING_STATUS_BONDED 0x01U
+
+/**
+ * \brief Period of heartbeats sent from BLE stack context to watchdog supervisor.
+ */
+#define BLE_HEARTBEAT_PERIOD_MS 1000U
+
+/**
+ * \brief Maximum allowed time between two heartbeats from BLE stack context.
+ */
+#define BLE_HEARTBEAT_SLO_MS 3000U
+
+/**
+ * \brief WICED timer sending heartbeats from BLE stack context.
+ * \details WICED timer callbacks are serialized into the BLE stack task, so stalled event processing delays heartbeats.
+ */
+static wiced_timer_t heartbeat_timer;
+
+/**
+ * \brief Watchdog supervisor ID of BLE event processing.
+ */
+static watchdog_supervisor_id_t heartbeat_id = WATCHDOG_SUPERVISOR_INVALID_ID;
+
+/**
+ * \brief Sends heartbeat of BLE event processing to watchdog supervisor.
+ * \param[in] param Ignored.
+ */
+static void heartbeat(WICED_TIMER_PARAM_TYPE param)
+{
+    (void) param;
+
+    watchdog_supervisor_heartbeat(heartbeat_id);
+}
+
+/**
+ * \brief Handle of diagnostics service declaration (placed above all handles of generated GATT database).
+ */
+#define HDLS_DIAGNOSTICS 0xF000U
+
+/**
+ * \brief Handle of diagnostics metrics characteristic declaration.
+ */
+#define HDLC_DIAGNOSTICS_METRICS 0xF001U
+
+/**
+ * \brief Handle of diagnostics metrics characteristic value.
+ * \details Reading returns a new snapshot (see metrics.h), writing any value requests the next snapshot to be a full snapshot.
+ * \details Snapshot becomes the baseline of the next snapshot once read completely. Only accessible via an encrypted and authenticated link.
+ */
+#define HDLC_DIAGNOSTICS_METRICS_VALUE 0xF002U
+
+/**
+ * \brief Handle of diagnostics HCI snoop characteristic declaration.
+ */
+#define HDLC_DIAGNOSTICS_HCI_SNOOP 0xF003U
+
+/**
+ * \brief Handle of diagnostics HCI snoop characteristic value.
+ * \details Every read at offset 0 returns the next part of the HCI capture in btsnoop format (see hci-snoop.h), an empty value marks the
+ *          end. Writing 0x01 dumps the capture to the debug log, writing any other value restarts the stream with the btsnoop header.
+ * \details Only accessible via an encrypted and authenticated link.
+ */
+#define HDLC_DIAGNOSTICS_HCI_SNOOP_VALUE 0xF004U
+
+/**
+ * \brief Maximum length of a part of the HCI capture read via HDLC_DIAGNOSTICS_HCI_SNOOP_VALUE.
+ */
+#define DIAGNOSTICS_HCI_SNOOP_MAX_LEN 256U
+
+/**
+ * \brief Maximum length of a metrics snapshot read via HDLC_DIAGNOSTICS_METRICS_VALUE.
+ */
+#define DIAGNOSTICS_SNAPSHOT_MAX_LEN 256U
+
+/**
+ * \brief UUID of diagnostics service (f3c6e1a0-5b7d-4c2e-9a41-091a2b3c5e4d, little endian).
+ */
+#define UUID_SERVICE_DIAGNOSTICS 0x4DU, 0x5EU, 0x3CU, 0x2BU, 0x1AU, 0x09U, 0x41U, 0x9AU, 0x2EU, 0x4CU, 0x7DU, 0x5BU, 0xA0U, 0xE1U, 0xC6U, 0xF3U
+
+/**
+ * \brief UUID of diagnostics metrics characteristic (f3c6e1a1-5b7d-4c2e-9a41-091a2b3c5e4d, little endian).
+ */
+#define UUID_CHARACTERISTIC_DIAGNOSTICS_METRICS 0x4DU, 0x5EU, 0x3CU, 0x2BU, 0x1AU, 0x09U, 0x41U, 0x9AU, 0x2EU, 0x4CU, 0x7DU, 0x5BU, 0xA1U, 0xE1U, 0xC6U, 0xF3U
+
+/**
+ * \brief UUID of diagnostics HCI snoop characteristic (f3c6e1a2-5b7d-4c2e-9a41-091a2b3c5e4d, little endian).
+ */
+#define UUID_CHARACTERISTIC_DIAGNOSTICS_HCI_SNOOP 0x4DU, 0x5EU, 0x3CU, 0x2BU, 0x1AU, 0x09U, 0x41U, 0x9AU, 0x2EU, 0x4CU, 0x7DU, 0x5BU, 0xA2U, 0xE1U, 0xC6U, 0xF3U
+
+/**
+ * \brief Diagnostics service appended to generated GATT database.
+ */
+// clang-format off
+static const uint8_t diagnostics_database[] = {
+    PRIMARY_SERVICE_UUID128(HDLS_DIAGNOSTICS, UUID_SERVICE_DIAGNOSTICS),
+    CHARACTERISTIC_UUID128_WRITABLE(HDLC_DIAGNOSTICS_METRICS, HDLC_DIAGNOSTICS_METRICS_VALUE, UUID_CHARACTERISTIC_DIAGNOSTICS_METRICS,
+                                    GATTDB_CHAR_PROP_READ | GATTDB_CHAR_PROP_WRITE,
+                                    GATTDB_PERM_READABLE | GATTDB_PERM_AUTH_READABLE | GATTDB_PERM_WRITE_REQ | GATTDB_PERM_AUTH_WRITABLE | GATTDB_PERM_VARIABLE_LENGTH),
+    CHARACTERISTIC_UUID128_WRITABLE(HDLC_DIAGNOSTICS_HCI_SNOOP, HDLC_DIAGNOSTICS_HCI_SNOOP_VALUE, UUID_CHARACTERISTIC_DIAGNOSTICS_HCI_SNOOP,
+                                    GATTDB_CHAR_PROP_READ | GATTDB_CHAR_PROP_WRITE,
+                                    GATTDB_PERM_READABLE | GATTDB_PERM_AUTH_READABLE | GATTDB_PERM_WRITE_REQ | GATTDB_PERM_AUTH_WRITABLE | GATTDB_PERM_VARIABLE_LENGTH)
+};
+// clang-format on
+
+/**
+ * \brief Generated GATT database followed by diagnostics_database.
+ */
+static uint8_t *combined_database = NULL;
+
+/**
+ * \brief Time spent in gatt_callback() in microseconds.
+ */
+static struct metric gatt_latency = METRICS_HISTOGRAM("gatt.handler_us");
+
+/**
+ * \brief Produces new metrics snapshot for diagnostics_metrics.
+ * \param[out] buffer Buffer for snapshot.
+ * \param[in] buffer_len Size of \c buffer.
+ * \param[in] context Ignored.
+ * \return uint16_t Number of bytes written to \c buffer.
+ */
+static uint16_t diagnostics_metrics_read(uint8_t *buffer, uint16_t buffer_len, void *context)
+{
+    (void) context;
+    return (uint16_t) metrics_snapshot(buffer, buffer_len);
+}
+
+/**
+ * \brief Requests next metrics snapshot to be a full snapshot (any written value).
+ * \param[in] data Ignored.
+ * \param[in] data_len Ignored.
+ * \param[in] context Ignored.
+ * \returns WICED_BT_GATT_SUCCESS
+ */
+static wiced_bt_gatt_status_t diagnostics_metrics_write(const uint8_t *data, uint16_t data_len, void *context)
+{
+    (void) data;
+    (void) data_len;
+    (void) context;
+    metrics_request_full_snapshot();
+    return WICED_BT_GATT_SUCCESS;
+}
+
+/**
+ * \brief Makes values of delivered metrics snapshot the baseline of the next snapshot.
+ * \param[in] context Ignored.
+ */
+static void diagnostics_metrics_delivered(void *context)
+{
+    (void) context;
+    metrics_snapshot_commit();
+}
+
+/**
+ * \brief Buffer for metrics snapshot served via diagnostics_metrics.
+ */
+static uint8_t diagnostics_snapshot[DIAGNOSTICS_SNAPSHOT_MAX_LEN];
+
+/**
+ * \brief Diagnostics metrics characteristic value (new snapshot for every read at offset 0).
+ */
+static struct gatt_provider_attribute diagnostics_metrics =
+    GATT_PROVIDER_ATTRIBUTE(HDLC_DIAGNOSTICS_METRICS_VALUE, diagnostics_metrics_read, diagnostics_metrics_write, diagnostics_metrics_delivered, NULL,
+                            diagnostics_snapshot, 0U);
+
+/**
+ * \brief Position of central in HCI capture stream.
+ */
+static struct hci_snoop_cursor diagnostics_hci_snoop_cursor;
+
+/**
+ * \brief Produces next part of HCI capture for diagnostics_hci_snoop.
+ * \param[out] buffer Buffer for btsnoop stream data.
+ * \param[in] buffer_len Size of \c buffer.
+ * \param[in] context Ignored.
+ * \return uint16_t Number of bytes written to \c buffer.
+ */
+static uint16_t diagnostics_hci_snoop_read(uint8_t *buffer, uint16_t buffer_len, void *context)
+{
+    (void) context;
+    return (uint16_t) hci_snoop_read(&diagnostics_hci_snoop_cursor, buffer, buffer_len);
+}
+
+/**
+ * \brief Dumps HCI capture to debug log (0x01) or restarts btsnoop stream (any other value).
+ * \param[in] data Written value.
+ * \param[in] data_len Number of bytes in \c data.
+ * \param[in] context Ignored.
+ * \returns WICED_BT_GATT_SUCCESS
  */
-static wiced_bt_local_identity_keys_t local_identity_keys;
+static wiced_bt_gatt_status_t diagnostics_hci_snoop_write(const uint8_t *data, uint16_t data_len, void *context)
+{
+    (void) context;
+    if ((data_len == 1U) && (data[0] == 0x01U))
+    {
+        hci_snoop_request_dump();
+    }
+    else
+    {
+        memset(&diagnostics_hci_snoop_cursor, 0x00, sizeof(diagnostics_hci_snoop_cursor));
+    }
+    return WICED_BT_GATT_SUCCESS;
+}
+
+/**
+ * \brief Buffer for part of HCI capture served via diagnostics_hci_snoop.
+ */
+static uint8_t diagnostics_hci_snoop_chunk[DIAGNOSTICS_HCI_SNOOP_MAX_LEN];
+
+/**
+ * \brief Diagnostics HCI snoop characteristic value (next part of capture for every read at offset 0).
+ */
+static struct gatt_provider_attribute diagnostics_hci_snoop = GATT_PROVIDER_ATTRIBUTE(HDLC_DIAGNOSTICS_HCI_SNOOP_VALUE, diagnostics_hci_snoop_read,
+                                                                                      diagnostics_hci_snoop_write, NULL, NULL, diagnostics_hci_snoop_chunk, 0U);
 
 /**
  * \brief Utility performing lookup from BLE GATT attribute handle to actual gatt_db_lookup_table_t object.
@@ -101,6 +311,28 @@ void ble_gatt_send_hid_update(void)
     }
 }
 
+/**
+ * \brief Publishes current device status to scanners via manufacturer specific advertising data.
+ * \details Advertising continues, the payload is updated in place (see *advertising-payload.h*).
+ */
+static void ble_update_advertised_status(void)
+{
+    uint8_t status = (key_cache_bond_count() > 0U) ? BLE_ADVERTISING_STATUS_BONDED : 0x00U;
+    if (advertising_payload_set_manufacturer_data(BLE_ADVERTISING_COMPANY_ID, &status, sizeof(status)) != WICED_BT_SUCCESS)
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not update advertised device status");
+    }
+}
+
+/**
+ * \brief Returns number of currently bonded devices.
+ * \return uint8_t Number of bonded devices (at most KEY_CACHE_LINK_KEYS devices are bonded at a time).
+ */
+uint8_t ble_get_bond_count(void)
+{
+    return key_cache_bond_count();
+}
+
 /**
  * \brief Clear bonding information to reset device.
  * \details This function is used by the button handler to clear bonding information on long-click.
@@ -112,19 +344,26 @@ void ble_clear_bonding_info(void)
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not stop Bluetooth advertisement");
         return;
     }
-    if (bonding_info.bonded)
+    if (key_cache_bond_count() > 0U)
     {
-        if (wiced_bt_dev_delete_bonded_device(bonding_info.device_link_keys.bd_addr) != WICED_BT_SUCCESS)
+        for (size_t i = 0U; i < key_cache_bond_count(); i++)
         {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not clear bond data for Bluetooth stack");
+            wiced_bt_device_link_keys_t device_link_keys = *key_cache_bond(i);
+            if (wiced_bt_dev_delete_bonded_device(device_link_keys.bd_addr) != WICED_BT_SUCCESS)
+            {
+                ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not clear bond data for Bluetooth stack");
+            }
         }
-        memset(&bonding_info.device_link_keys, 0x00, sizeof(wiced_bt_device_link_keys_t));
-        bonding_info.bonded = false;
-        if (mtb_kvstore_write(&data_storage, "bonding", (uint8_t *) (&bonding_info), sizeof(bonding_info)) != CY_RSLT_SUCCESS)
+        if (key_cache_clear_bonds() != CY_RSLT_SUCCESS)
         {
             ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not clear bond data for Bluetooth stack in persistent storage");
         }
     }
+    if (advertising_filter_update() != WICED_BT_SUCCESS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not clear Bluetooth filter accept list");
+    }
+    ble_update_advertised_status();
     if (wiced_bt_ble_address_resolution_list_clear_and_disable() != WICED_BT_SUCCESS)
     {
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could clear local Bluetooth resolution list");
@@ -136,13 +375,13 @@ void ble_clear_bonding_info(void)
 }
 
 /**
- * \brief Callback for all BLE GATT events.
+ * \brief Handles BLE GATT events for gatt_callback().
  * \details No specifics for NBT connection handover usecase, can just be used as is.
  * \param[in] event BLE GATT event for internal state machine.
  * \param[in,out] event_data Additional input/output buffer for event data specific to `event`.
  * \returns WICED_BT_GATT_SUCCESS if successful, any other value in case of error.
  */
-static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_gatt_event_data_t *event_data)
+static wiced_bt_gatt_status_t gatt_handle_event(wiced_bt_gatt_evt_t event, wiced_bt_gatt_event_data_t *event_data)
 {
     switch (event)
     {
@@ -150,9 +389,11 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
         if (event_data->connection_status.connected)
         {
             connection_id = event_data->connection_status.conn_id;
+            link_monitor_start(event_data->connection_status.bd_addr);
         }
         else
         {
+            link_monitor_stop();
             connection_id = 0x0000U;
             return wiced_bt_start_advertisements(BTM_BLE_ADVERT_UNDIRECTED_HIGH, BLE_ADDR_PUBLIC, NULL);
         }
@@ -164,6 +405,11 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
         {
         case GATT_REQ_READ:
         case GATT_REQ_READ_BLOB: {
+            struct gatt_provider_attribute *provided = gatt_provider_find(event_data->attribute_request.data.read_req.handle);
+            if (provided != NULL)
+            {
+                return gatt_provider_read(provided, &event_data->attribute_request);
+            }
             gatt_db_lookup_table_t *attribute = handle2attr(event_data->attribute_request.data.read_req.handle);
             if (attribute == NULL)
             {
@@ -186,6 +432,11 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
 
         case GATT_REQ_WRITE:
         case GATT_CMD_WRITE: {
+            struct gatt_provider_attribute *provided = gatt_provider_find(event_data->attribute_request.data.write_req.handle);
+            if (provided != NULL)
+            {
+                return gatt_provider_write(provided, &event_data->attribute_request);
+            }
             gatt_db_lookup_table_t *attribute = handle2attr(event_data->attribute_request.data.write_req.handle);
             if (attribute == NULL)
             {
@@ -202,9 +453,9 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
             if ((attribute->handle == HDLD_HIDS_REPORT_CLIENT_CHAR_CONFIG) && (attribute->cur_len >= 2U))
             {
                 cccd = (attribute->p_data[1] << 8) | attribute->p_data[0];
-                if (mtb_kvstore_write(&data_storage, "cccd", (uint8_t *) (&cccd), sizeof(cccd)) != CY_RSLT_SUCCESS)
+                if (data_storage_set("cccd", (uint8_t *) (&cccd), sizeof(cccd)) != CY_RSLT_SUCCESS)
                 {
-                    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not update CCCD value in persistent storage - ignored");
+                    LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not update CCCD value in persistent storage - ignored");
                 }
             }
 
@@ -213,13 +464,17 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
         }
 
         case GATT_REQ_READ_BY_TYPE: {
-            uint8_t *response = pvPortMalloc(event_data->attribute_request.len_requested);
+            uint8_t *response = heap_guard_malloc(event_data->attribute_request.len_requested);
             if (response == NULL)
             {
                 return WICED_BT_GATT_INSUF_RESOURCE;
             }
             uint16_t data_length = 0U;
             uint8_t type_length = 0U;
+
+            // Characteristic UUIDs are unique, so at most one provided value is part of the response
+            struct gatt_provider_attribute *provided = NULL;
+            uint16_t provided_len = 0U;
             while (1)
             {
                 static uint16_t attribute_handle = 0U;
@@ -229,29 +484,53 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
                 {
                     break;
                 }
+                uint16_t value_len = 0U;
+                const uint8_t *value = NULL;
+                struct gatt_provider_attribute *provider = NULL;
                 gatt_db_lookup_table_t *attribute = handle2attr(attribute_handle);
-                if (attribute == NULL)
+                if (attribute != NULL)
                 {
-                    vPortFree(response);
+                    value_len = attribute->cur_len;
+                    value = attribute->p_data;
+                }
+                else
+                {
+                    provider = gatt_provider_find(attribute_handle);
+                    value = gatt_provider_value(provider, 0U, &value_len);
+                }
+                if (value == NULL)
+                {
+                    heap_guard_free(response);
                     return WICED_BT_GATT_INVALID_HANDLE;
                 }
                 int update_length =
                     wiced_bt_gatt_put_read_by_type_rsp_in_stream(response + data_length, event_data->attribute_request.len_requested - data_length,
-                                                                 &type_length, attribute_handle, attribute->cur_len, attribute->p_data);
+                                                                 &type_length, attribute_handle, value_len, (uint8_t *) value);
                 if ((update_length == 0) || ((update_length + data_length) > 0xffffU))
                 {
                     break;
                 }
+                if (provider != NULL)
+                {
+                    // Entry is attribute handle followed by (possibly truncated) value
+                    provided = provider;
+                    provided_len = (uint16_t) (update_length - (int) sizeof(uint16_t));
+                }
                 data_length += update_length;
                 attribute_handle++;
             }
             if (data_length == 0)
             {
-                vPortFree(response);
+                heap_guard_free(response);
                 return WICED_BT_GATT_INVALID_HANDLE;
             }
-            return wiced_bt_gatt_server_send_read_by_type_rsp(event_data->attribute_request.conn_id, event_data->attribute_request.opcode, type_length,
-                                                              data_length, response, (void *) vPortFree);
+            wiced_bt_gatt_status_t status = wiced_bt_gatt_server_send_read_by_type_rsp(
+                event_data->attribute_request.conn_id, event_data->attribute_request.opcode, type_length, data_length, response, (void *) heap_guard_free);
+            if (status == WICED_BT_GATT_SUCCESS)
+            {
+                gatt_provider_sent(provided, 0U, provided_len);
+            }
+            return status;
         }
 
         case GATT_REQ_MTU: {
@@ -270,8 +549,8 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
     }
 
     case GATT_GET_RESPONSE_BUFFER_EVT: {
-        event_data->buffer_request.buffer.p_app_rsp_buffer = pvPortMalloc(event_data->buffer_request.len_requested);
-        event_data->buffer_request.buffer.p_app_ctxt = (void *) vPortFree;
+        event_data->buffer_request.buffer.p_app_rsp_buffer = heap_guard_malloc(event_data->buffer_request.len_requested);
+        event_data->buffer_request.buffer.p_app_ctxt = (void *) heap_guard_free;
         return WICED_BT_GATT_SUCCESS;
     }
 
@@ -290,11 +569,26 @@ static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_
     }
 }
 
+/**
+ * \brief Callback for all BLE GATT events.
+ * \details Events are handled by gatt_handle_event(), handler time is recorded as metric.
+ * \param[in] event BLE GATT event for internal state machine.
+ * \param[in,out] event_data Additional input/output buffer for event data specific to `event`.
+ * \returns WICED_BT_GATT_SUCCESS if successful, any other value in case of error.
+ */
+static wiced_bt_gatt_status_t gatt_callback(wiced_bt_gatt_evt_t event, wiced_bt_gatt_event_data_t *event_data)
+{
+    uint32_t start = metrics_timestamp();
+    wiced_bt_gatt_status_t status = gatt_handle_event(event, event_data);
+    metrics_observe_since(&gatt_latency, start);
+    return status;
+}
+
 /**
  * \brief Callback for all Bluetooth (Low Energy) events.
  * \details Events of interest for the NBT connection handover usecase are:
  *     * BTM_ENABLED_EVT: Update MAC address and start generating OOB data.
- *     * BTM_SMP_SC_LOCAL_OOB_DATA_NOTIFICATION_EVT: Generate OOB data and write to NBT.
+ *     * BTM_SMP_SC_LOCAL_OOB_DATA_NOTIFICATION_EVT: Write OOB data generated by stack to NBT.
  * \details GATT events are handled by gatt_callback().
  * \param[in] event BLE event for internal state machine.
  * \param[in,out] event_data Additional input/output buffer for event data specific to `event`.
@@ -310,6 +604,9 @@ wiced_result_t ble_callback(wiced_bt_management_evt_t event, wiced_bt_management
             return WICED_BT_ERROR;
         }
 
+        // Capture HCI traffic for diagnostics
+        hci_snoop_initialize();
+
         // NBT: Update BLE MAC with unique device ID
         wiced_bt_device_address_t mac_address;
         memcpy(mac_address, cy_bt_device_address, sizeof(wiced_bt_device_address_t));
@@ -329,39 +626,70 @@ wiced_result_t ble_callback(wiced_bt_management_evt_t event, wiced_bt_management
             return WICED_BT_ERROR;
         }
 
-        // Load previous bonding information
-        uint32_t data_storage_read_size = sizeof(bonding_info);
-        if (mtb_kvstore_read(&data_storage, "bonding", (uint8_t *) (&bonding_info), &data_storage_read_size) == CY_RSLT_SUCCESS)
+        // Restore previous bonds (already loaded by key_cache_load())
+        for (size_t i = 0U; i < key_cache_bond_count(); i++)
         {
-            if (bonding_info.bonded)
-            {
-                wiced_bt_dev_add_device_to_address_resolution_db(&bonding_info.device_link_keys);
-                data_storage_read_size = sizeof(cccd);
-                mtb_kvstore_read(&data_storage, "cccd", (uint8_t *) (&cccd), &data_storage_read_size);
-            }
+            wiced_bt_device_link_keys_t device_link_keys = *key_cache_bond(i);
+            wiced_bt_dev_add_device_to_address_resolution_db(&device_link_keys);
+        }
+        if (key_cache_bond_count() > 0U)
+        {
+            uint32_t data_storage_read_size = sizeof(cccd);
+            data_storage_get("cccd", (uint8_t *) (&cccd), &data_storage_read_size);
         }
 
         // Configure BLE, GAP and GATT server
         wiced_bt_set_pairable_mode(WICED_TRUE, WICED_FALSE);
-        if (wiced_bt_ble_set_raw_advertisement_data(CY_BT_ADV_PACKET_DATA_SIZE, cy_bt_adv_packet_data) != WICED_BT_SUCCESS)
+        if (advertising_payload_initialize(cy_bt_adv_packet_data, CY_BT_ADV_PACKET_DATA_SIZE) != WICED_BT_SUCCESS)
         {
             return WICED_BT_ERROR;
         }
+        ble_update_advertised_status();
         if (wiced_bt_gatt_register(gatt_callback) != WICED_BT_GATT_SUCCESS)
         {
             return WICED_BT_ERROR;
         }
-        if (wiced_bt_gatt_db_init(gatt_database, gatt_database_len, NULL) != WICED_BT_SUCCESS)
+
+        // Generated GATT database extended by diagnostics service (kept for lifetime of BLE stack)
+        if (combined_database == NULL)
+        {
+            combined_database = pvPortMalloc(gatt_database_len + sizeof(diagnostics_database));
+            if (combined_database == NULL)
+            {
+                return WICED_BT_ERROR;
+            }
+            memcpy(combined_database, gatt_database, gatt_database_len);
+            memcpy(combined_database + gatt_database_len, diagnostics_database, sizeof(diagnostics_database));
+        }
+        if (wiced_bt_gatt_db_init(combined_database, gatt_database_len + sizeof(diagnostics_database), NULL) != WICED_BT_SUCCESS)
         {
             return WICED_BT_ERROR;
         }
 
+        // Diagnostics characteristic values produced on demand
+        gatt_provider_register(&diagnostics_metrics);
+        gatt_provider_register(&diagnostics_hci_snoop);
+
+        // Supervise BLE event processing
+        heartbeat_id = watchdog_supervisor_register("BLE", NULL, BLE_HEARTBEAT_SLO_MS);
+        wiced_init_timer(&heartbeat_timer, heartbeat, 0U, WICED_MILLI_SECONDS_PERIODIC_TIMER);
+        wiced_start_timer(&heartbeat_timer, BLE_HEARTBEAT_PERIOD_MS);
+
         // NBT: Generate OOB data for connection handover
         if (wiced_bt_smp_create_local_sc_oob_data(mac_address, BLE_ADDR_PUBLIC) != WICED_TRUE)
         {
             CY_ASSERT(0);
         }
 
+        // Once bonded, only bonded devices may scan and connect (see advertising-filter.h)
+        if (advertising_filter_update() != WICED_BT_SUCCESS)
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not restrict advertising to bonded devices");
+        }
+
+        // Start-up complete, all further allocations are steady-state allocations
+        heap_guard_boot_complete();
+
         return wiced_bt_start_advertisements(BTM_BLE_ADVERT_UNDIRECTED_HIGH, BLE_ADDR_PUBLIC, NULL);
     }
 
@@ -376,12 +704,17 @@ wiced_result_t ble_callback(wiced_bt_management_evt_t event, wiced_bt_management
     }
 
     case BTM_PAIRING_COMPLETE_EVT: {
-        bonding_info.bonded = true;
-        if (mtb_kvstore_write(&data_storage, "bonding", (uint8_t *) (&bonding_info), sizeof(bonding_info)) != CY_RSLT_SUCCESS)
+        bool paired = (event_data->pairing_complete.pairing_complete_info.ble.status == WICED_SUCCESS);
+        if (key_cache_commit_bond(event_data->pairing_complete.bd_addr, paired) != CY_RSLT_SUCCESS)
         {
             ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not persistently store bonding information");
             return WICED_BT_ERROR;
         }
+        if (advertising_filter_update() != WICED_BT_SUCCESS)
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not add bonded device to Bluetooth filter accept list");
+        }
+        ble_update_advertised_status();
         return WICED_BT_SUCCESS;
     }
 
@@ -397,22 +730,24 @@ wiced_result_t ble_callback(wiced_bt_management_evt_t event, wiced_bt_management
     }
 
     case BTM_PAIRED_DEVICE_LINK_KEYS_UPDATE_EVT: {
-        memcpy(&bonding_info.device_link_keys, &event_data->paired_device_link_keys_update, sizeof(wiced_bt_device_link_keys_t));
+        if (key_cache_update_link_keys(&event_data->paired_device_link_keys_update) != CY_RSLT_SUCCESS)
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not persistently store link keys");
+            return WICED_BT_ERROR;
+        }
         return WICED_BT_SUCCESS;
     }
 
     case BTM_PAIRED_DEVICE_LINK_KEYS_REQUEST_EVT: {
-        if (!bonding_info.bonded)
+        if (!key_cache_get_link_keys(event_data->paired_device_link_keys_request.bd_addr, &event_data->paired_device_link_keys_request))
         {
             return WICED_BT_ERROR;
         }
-        memcpy(&event_data->paired_device_link_keys_request, &bonding_info.device_link_keys, sizeof(wiced_bt_device_link_keys_t));
         return WICED_BT_SUCCESS;
     }
 
     case BTM_LOCAL_IDENTITY_KEYS_UPDATE_EVT: {
-        memcpy(&local_identity_keys, &event_data->local_identity_keys_update, sizeof(wiced_bt_local_identity_keys_t));
-        if (mtb_kvstore_write(&data_storage, "identity_keys", (uint8_t *) (&local_identity_keys), sizeof(wiced_bt_local_identity_keys_t)) != CY_RSLT_SUCCESS)
+        if (key_cache_set_identity_keys(&event_data->local_identity_keys_update) != CY_RSLT_SUCCESS)
         {
             ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not persistently store local identity keys");
             return WICED_BT_ERROR;
@@ -421,20 +756,16 @@ wiced_result_t ble_callback(wiced_bt_management_evt_t event, wiced_bt_management
     }
 
     case BTM_LOCAL_IDENTITY_KEYS_REQUEST_EVT: {
-        uint32_t read_size = sizeof(wiced_bt_local_identity_keys_t);
-        if (mtb_kvstore_read(&data_storage, "identity_keys", NULL, &read_size) == CY_RSLT_SUCCESS)
+        // Served from RAM, no flash access while the stack waits
+        if (!key_cache_get_identity_keys(&event_data->local_identity_keys_request))
         {
-            if (mtb_kvstore_read(&data_storage, "identity_keys", (uint8_t *) (&local_identity_keys), &read_size) == CY_RSLT_SUCCESS)
-            {
-                return WICED_BT_SUCCESS;
-            }
+            return WICED_BT_ERROR;
         }
-        return WICED_BT_ERROR;
+        return WICED_BT_SUCCESS;
     }
 
     case BTM_ENCRYPTION_STATUS_EVT: {
-        if (bonding_info.bonded &&
-            (memcmp(event_data->encryption_status.bd_addr, bonding_info.device_link_keys.bd_addr, sizeof(wiced_bt_device_address_t)) == 0))
+        if (key_cache_get_link_keys(event_data->encryption_status.bd_addr, NULL))
         {
             app_hids_report_client_char_config[0] = cccd;
         }
@@ -444,39 +775,16 @@ wiced_result_t ble_callback(wiced_bt_management_evt_t event, wiced_bt_management
     case BTM_SMP_SC_LOCAL_OOB_DATA_NOTIFICATION_EVT: {
         // NBT: Update connection handover message
 
-        // OOB random value typically dynamically generated but here {0x00} based to match wiced BLE stack
-        uint8_t random_value[0x10U] = {0x00U};
-        if (ifx_error_check(callback_sc_random_value_changed(random_value)))
+        // Stack verifies pairing against its own local OOB data and cannot be handed a random value, so exactly its values are published
+        static const uint8_t zero_randomizer[sizeof(event_data->p_smp_sc_local_oob_data->randomizer)] = {0x00U};
+        if (memcmp(event_data->p_smp_sc_local_oob_data->randomizer, zero_randomizer, sizeof(zero_randomizer)) == 0)
         {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not update BLE SC random value on NBT");
-            return WICED_BT_ERROR;
-        }
-
-        // OOB confirmation value is generated using AES-CMAC over public_key.x || public_key.x || 0x00 using random value as key
-        uint8_t m[0x20U + 0x20U + 1U];
-        memcpy(m, event_data->p_smp_sc_local_oob_data->public_key_used.x, 0x20U);
-        memcpy(m + 0x20U, event_data->p_smp_sc_local_oob_data->public_key_used.x, 0x20U);
-        mbedtls_cipher_context_t crypto_context;
-        mbedtls_cipher_init(&crypto_context);
-        if ((mbedtls_cipher_setup(&crypto_context, mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_ECB)) != 0) ||
-            (mbedtls_cipher_cmac_starts(&crypto_context, random_value, sizeof(random_value) * 8U) != 0) ||
-            (mbedtls_cipher_cmac_update(&crypto_context, m, sizeof(m)) != 0))
-        {
-            mbedtls_cipher_free(&crypto_context);
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not set up required MBED TLS cipher to calculate OOB confirmation value.");
-            return WICED_BT_ERROR;
-        }
-        uint8_t confirmation_value[0x10U];
-        int crypto_status = mbedtls_cipher_cmac_finish(&crypto_context, confirmation_value);
-        mbedtls_cipher_free(&crypto_context);
-        if (crypto_status != 0)
-        {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not calculate required OOB confirmation value.");
-            return WICED_BT_ERROR;
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "BLE stack generated constant (all-zero) OOB random value");
         }
-        if (ifx_error_check(callback_sc_confirmation_value_changed(confirmation_value)))
+        if (ifx_error_check(callback_sc_oob_data_changed(event_data->p_smp_sc_local_oob_data->commitment,
+                                                         event_data->p_smp_sc_local_oob_data->randomizer)))
         {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not update BLE SC confirmation value on NBT");
+            LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not update BLE SC OOB data on NBT");
             return WICED_BT_ERROR;
         }
 
@@ -24,6 +24,12 @@ extern "C" {
  */
 void ble_gatt_send_hid_update(void);
 
+/**
+ * \brief Returns number of currently bonded devices.
+ * \return uint8_t Number of bonded devices (at most one device is bonded at a time).
+ */
+uint8_t ble_get_bond_count(void);
+
 /**
  * \brief Clear bonding information to reset device.
  * \details This function is used by the button handler to clear bonding information on long-click.
@@ -48,20 +54,14 @@ wiced_result_t ble_callback(wiced_bt_management_evt_t event, wiced_bt_management
 ifx_status_t callback_mac_address_changed(wiced_bt_device_address_t mac);
 
 /**
- * \brief Callback triggered once LE Secure Connection Confirmation Value is available / changed.
- * \details This callback is used to update the NBT NDEF file to set the SC confirmation value for the NFC connection handover.
+ * \brief Callback triggered once LE Secure Connection OOB data is available / changed.
+ * \details This callback is used to update the NBT NDEF file to set the SC confirmation and random value for the NFC connection handover.
+ * \details Both values are written as one range so that a reader never sees a confirmation value not matching the random value.
  * \param[in] confirmation LE Secure Connection Confirmation Value to write to connection handover record.
- * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
- */
-ifx_status_t callback_sc_confirmation_value_changed(uint8_t confirmation[0x10U]);
-
-/**
- * \brief Callback triggered once LE Secure Connection Confirmation Value is available / changed.
- * \details This callback is used to update the NBT NDEF file to set the SC confirmation value for the NFC connection handover.
  * \param[in] random LE Secure Connection Random Value to write to connection handover record.
  * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
  */
-ifx_status_t callback_sc_random_value_changed(uint8_t random[0x10U]);
+ifx_status_t callback_sc_oob_data_changed(uint8_t confirmation[0x10U], uint8_t random[0x10U]);
 
 #ifdef __cplusplus
 }
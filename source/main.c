@@ -28,74 +28,135 @@
 #include "infineon/logger-printf.h"
 #include "infineon/logger-cyhal-rtos.h"
 #include "infineon/ifx-protocol.h"
-#include "infineon/i2c-cyhal.h"
 #include "infineon/ifx-t1prime.h"
 #include "infineon/nbt-cmd.h"
 
+#include "advertising-filter.h"
 #include "bluetooth-handling.h"
 #include "data-storage.h"
+#include "hci-snoop.h"
+#include "heap-guard.h"
+#include "key-cache.h"
+#include "log-limiter.h"
+#include "nbt-i2c-adapter.h"
+#include "nbt-mailbox.h"
+#include "nbt-pipeline.h"
+#include "nbt-provisioning.h"
 #include "nbt-utilities.h"
+#include "nbt-write-budget.h"
+#include "ndef-layout.h"
+#include "profiled-mutex.h"
+#include "watchdog-supervisor.h"
 
 /**
- * \brief Skeleton for BLE connection handover message.
- * \details Populated according to *NFC Forum: Bluetooth Secure Simple Pairing Using NFC* application document.
- * \details Uses simplified tag format with fields for:
- *     * BLE Device Address (required, updated via callback_mac_address_changed())
- *     * BLE Role (required)
- *     * Security Manager TK (optional but required by AOSP based Bluetooth stacks - still ignored)
- *     * LE Secure Connection Confirmation Value (optional but required by AOSP based Bluetooth stacks - updated via callback_sc_confirmation_value_changed())
- *     * LE Secure Connection Random Value (optional but required by AOSP based Bluetooth stacks - updated via callback_sc_random_value_changed())
- *     * BLE OOB flags (optional)
- *     * BLE Local Name (optional)
- *     * BLE Appeareance (optional)
+ * \brief Firmware major version reported in device status record.
  */
-// clang-format off
-static uint8_t CONNECTION_HANDOVER_MESSAGE[] = {
-    // NDEF message length
-    0x00U, 0x23U + 0x4EU,
-    // NDEF Record Header
-    0xD2U,
-    // Record Type Length
-    0x20U,
-    // Payload Length
-    0x4EU,
-    // Record Type Name: application/vnd.bluetooth.le.oob
-    0x61U, 0x70U, 0x70U, 0x6CU, 0x69U, 0x63U, 0x61U, 0x74U, 0x69U, 0x6FU, 0x6EU, 0x2FU, 0x76U, 0x6EU, 0x64U, 0x2EU,
-    0x62U, 0x6CU, 0x75U, 0x65U, 0x74U, 0x6FU, 0x6FU, 0x74U, 0x68U, 0x2EU, 0x6CU, 0x65U, 0x2EU, 0x6FU, 0x6FU, 0x62U,
-    // Payload
-    // BLE Device Address (1B length, 1B data type, 6B address, 1B address type)
-    0x08U, 0x1BU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0XFFU, 0x00U,
-    // BLE Role (1B length, 1B data type, 1B role "Peripheral")
-    0x02U, 0x1CU, 0x00U,
-    // BLE Local Name (1B length, 1B data type, 3B name "NBT")
-    0x04U, 0x09U, 0x4EU, 0x42U, 0x54U,
-    // Appearance (1B length, 1B data type, 2B appearance "HID: Mouse")
-    0x03U, 0x19U, 0xC2U, 0x03U,
-    // Security Manager TK (1B length, 1B data type, 16B key)
-    0x11U, 0x10U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U,
-    // LE Secure Connection Confirmation Value (1B length, 1B data type, 16B confirmation value)
-    0x11U, 0x22U, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
-    // LE Secure Connection Random Value (1B length, 1B data type, 16B random value)
-    0x11U, 0x23U, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU,
-    // LE OOB Flags (1B length, 1B data type, 1B flags LE General Discoverable Mode, BR/EDR not supported
-    0x02U, 0x01U, 0x06U
-};
-// clang-format on
+#ifndef APP_VERSION_MAJOR
+#define APP_VERSION_MAJOR 1U
+#endif
+
+/**
+ * \brief Firmware minor version reported in device status record.
+ */
+#ifndef APP_VERSION_MINOR
+#define APP_VERSION_MINOR 0U
+#endif
+
+/**
+ * \brief Firmware patch version reported in device status record.
+ */
+#ifndef APP_VERSION_PATCH
+#define APP_VERSION_PATCH 0U
+#endif
+
+/**
+ * \brief BLE connection handover message optimized for NDEF_LAYOUT_MLE (see *ndef-layout.h*).
+ * \details Built by startup_task() before any value is updated, values are updated via callback_mac_address_changed() and
+ *          callback_sc_oob_data_changed().
+ * \details Device status record (if selected) is refreshed lazily via nbt_refresh_status_record().
+ */
+static struct ndef_layout connection_handover;
 
 /**
- * \brief Offset of MAC address in CONNECTION_HANDOVER_MESSAGE.
+ * \brief Initial device status payload: format version, battery level (0xFF unknown), bond count, firmware version (major, minor, patch).
  */
-#define CONNECTION_HANDOVER_MESSAGE_MAC_OFFSET 39U
+static const uint8_t CONNECTION_HANDOVER_STATUS[NDEF_LAYOUT_STATUS_LEN] = {0x01U, 0xFFU, 0x00U, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_PATCH};
 
 /**
- * \brief Offset of LE Secure Connection Confirmation value in CONNECTION_HANDOVER_MESSAGE.
+ * \brief Offset of battery level in device status payload.
  */
-#define CONNECTION_HANDOVER_MESSAGE_CONFIRMATION_OFFSET 78U
+#define CONNECTION_HANDOVER_STATUS_BATTERY_OFFSET 1U
 
 /**
- * \brief Offset of LE Secure Connection Random value in CONNECTION_HANDOVER_MESSAGE.
+ * \brief NBT GPIO signals NFC writes to mailbox (see nbt-mailbox.h).
  */
-#define CONNECTION_HANDOVER_MESSAGE_RANDOM_OFFSET 96U
+#define NBT_IRQ_MODE_MAILBOX 0U
+
+/**
+ * \brief NBT GPIO signals NFC field presence, used to refresh device status record.
+ */
+#define NBT_IRQ_MODE_STATUS 1U
+
+/**
+ * \brief Function of NBT GPIO selected at build time (NBT_IRQ_MODE_MAILBOX or NBT_IRQ_MODE_STATUS).
+ */
+#ifndef NBT_IRQ_MODE
+#define NBT_IRQ_MODE NBT_IRQ_MODE_MAILBOX
+#endif
+
+/**
+ * \brief NBT GPIO function signalling NFC field presence.
+ */
+#ifndef NBT_STATUS_GPIO_FUNCTION
+#define NBT_STATUS_GPIO_FUNCTION NBT_GPIO_FUNCTION_NFC_FIELD_DETECT
+#endif
+
+/**
+ * \brief NBT GPIO function matching NBT_IRQ_MODE.
+ */
+#if NBT_IRQ_MODE == NBT_IRQ_MODE_STATUS
+#define NBT_IRQ_FUNCTION NBT_STATUS_GPIO_FUNCTION
+#else
+#define NBT_IRQ_FUNCTION NBT_MAILBOX_GPIO_FUNCTION
+#endif
+
+/**
+ * \brief Optional fields of connection handover message, device status record is only refreshed on NFC field presence (see NBT_IRQ_MODE).
+ */
+#if NBT_IRQ_MODE == NBT_IRQ_MODE_STATUS
+#define CONNECTION_HANDOVER_OPTIONAL_FIELDS NDEF_LAYOUT_OPTIONAL_FIELDS
+#else
+#define CONNECTION_HANDOVER_OPTIONAL_FIELDS (NDEF_LAYOUT_OPTIONAL_FIELDS & ~NDEF_LAYOUT_FIELD_STATUS)
+#endif
+
+/**
+ * \brief Simple flag if proprietary file 2 holds device data protected by NBT_DEVICE_DATA_PASSWORD.
+ * \details Disabled by default, only enable if the password has been created on the NBT during personalization (stock kits do not have it).
+ */
+#ifndef NBT_DEVICE_DATA_PROTECTED
+#define NBT_DEVICE_DATA_PROTECTED 0
+#endif
+
+/**
+ * \brief ID of NBT password protecting device data in proprietary file 2.
+ */
+#ifndef NBT_DEVICE_DATA_PASSWORD_ID
+#define NBT_DEVICE_DATA_PASSWORD_ID 0x01U
+#endif
+
+/**
+ * \brief Value of NBT password protecting device data in proprietary file 2.
+ */
+#ifndef NBT_DEVICE_DATA_PASSWORD
+#define NBT_DEVICE_DATA_PASSWORD {0x00U, 0x00U, 0x00U, 0x00U}
+#endif
+
+#if NBT_DEVICE_DATA_PROTECTED
+/**
+ * \brief Device data kept in password protected proprietary file 2: format version, firmware version (major, minor, patch).
+ */
+static const uint8_t NBT_DEVICE_DATA[] = {0x01U, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_PATCH};
+#endif
 
 /**
  * \brief String used as source information for logging.
@@ -115,7 +176,7 @@ static cyhal_i2c_t i2c_device;
 /**
  * \brief Adapter between ModusToolbox CYHAL I2C driver and NBT library framework.
  */
-static ifx_protocol_t driver_adapter;
+static struct nbt_i2c_adapter driver_adapter;
 
 /**
  * \brief Communication protocol stack for NBT library framework.
@@ -132,6 +193,79 @@ static nbt_cmd_t nbt;
  */
 static SemaphoreHandle_t btn_irq_sleeper;
 
+/**
+ * \brief FreeRTOS mutex guarding NBT abstraction and I2C bus shared between BLE stack, nbt_task() and provisioning_task().
+ */
+static struct profiled_mutex nbt_lock;
+
+/**
+ * \brief Simple flag if NBT is activated and configured for connection handover (guarded by nbt_lock and critical sections).
+ */
+static volatile bool nbt_ready = false;
+
+/**
+ * \brief Simple flag if connection_handover changed while NBT was not ready or nbt_lock was not available in time.
+ */
+static bool handover_pending = false;
+
+/**
+ * \brief FreeRTOS semaphore given by nbt_attach_task() once NBT is ready.
+ */
+static SemaphoreHandle_t nbt_attached;
+
+/**
+ * \brief Maximum time startup_task() waits for the NBT before starting the BLE stack anyway.
+ */
+#ifndef NBT_ATTACH_DEADLINE_MS
+#define NBT_ATTACH_DEADLINE_MS 1500U
+#endif
+
+/**
+ * \brief Delay before first retry of NBT activation, doubled for every further retry.
+ */
+#define NBT_ATTACH_BACKOFF_MIN_MS 500U
+
+/**
+ * \brief Maximum delay between two retries of NBT activation.
+ */
+#define NBT_ATTACH_BACKOFF_MAX_MS 30000U
+
+/**
+ * \brief Period in which nbt_task() performs NBT maintenance (deferred writes, write counter persistence).
+ */
+#define NBT_TASK_PERIOD_MS 1000U
+
+/**
+ * \brief Maximum time nbt_task() and the BLE stack wait for nbt_lock (well below TASK_HEARTBEAT_SLO_MS and BLE heartbeat SLO).
+ * \details nbt_attach() and provisioning hold nbt_lock for as long as a (possibly unresponsive) NBT takes, waiters skip their work instead.
+ */
+#define NBT_LOCK_TIMEOUT_MS 1000U
+
+/**
+ * \brief Period in which nbt_task() logs lock contention and task latency metrics.
+ */
+#define DIAGNOSTICS_REPORT_PERIOD_MS (10U * 60U * 1000U)
+
+/**
+ * \brief Maximum time btn_task() waits for button presses before sending a heartbeat to the watchdog supervisor.
+ */
+#define BTN_TASK_HEARTBEAT_PERIOD_MS 1000U
+
+/**
+ * \brief Maximum allowed time between two heartbeats of btn_task() and nbt_task().
+ */
+#define TASK_HEARTBEAT_SLO_MS 3000U
+
+/**
+ * \brief Pin connected to NBT GPIO (interrupt) output.
+ */
+#define NBT_IRQ_PIN P6_2
+
+/**
+ * \brief Handle of nbt_task() notified by nbt_irq().
+ */
+static TaskHandle_t nbt_task_handle = NULL;
+
 /**
  * \brief Period length for time_keeper.
  * \details This is basically how often the timer should wake up and increment elapsed_periods.
@@ -178,9 +312,163 @@ static void btn_irq(void *handler_arg, cyhal_gpio_event_t event)
  */
 static cyhal_gpio_callback_data_t btn_irq_data = {.callback = btn_irq, .callback_arg = NULL};
 
+/**
+ * \brief Interrupt handler for NBT GPIO.
+ * \details Notifies nbt_task() that the phone wrote to the NBT via NFC or that an NFC field is present (see NBT_IRQ_MODE).
+ * \param[in] handler_arg ignored.
+ * \param[in] event ignored.
+ */
+static void nbt_irq(void *handler_arg, cyhal_gpio_event_t event)
+{
+    (void) handler_arg;
+    (void) event;
+
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    if (nbt_task_handle != NULL)
+    {
+        vTaskNotifyGiveFromISR(nbt_task_handle, &xHigherPriorityTaskWoken);
+    }
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/**
+ * \brief Callback data for nbt_irq().
+ */
+static cyhal_gpio_callback_data_t nbt_irq_data = {.callback = nbt_irq, .callback_arg = NULL};
+
+/**
+ * \brief Number of additional NBTs on a provisioning line station (at consecutive I2C addresses following NBT_DEFAULT_I2C_ADDRESS).
+ */
+#ifndef PROVISIONING_LINE_TAGS
+#define PROVISIONING_LINE_TAGS 0U
+#endif
+
+/**
+ * \brief Minimum button press duration letting any device scan and connect for ADVERTISING_FILTER_WINDOW_MS.
+ */
+#define PAIRING_WINDOW_PRESS_MIN_MS 1000U
+
+/**
+ * \brief Minimum button press duration starting factory provisioning.
+ */
+#define PROVISIONING_PRESS_MIN_MS 2000U
+
+/**
+ * \brief Button press duration above which BLE bonding information is cleared instead.
+ */
+#define BONDING_RESET_PRESS_MIN_MS 5000U
+
+/**
+ * \brief Persistent storage key of manifest replacing PROVISIONING_MANIFEST.
+ */
+#define PROVISIONING_MANIFEST_KEY "nbt_manifest"
+
+/**
+ * \brief Maximum length of manifest stored under PROVISIONING_MANIFEST_KEY.
+ */
+#define PROVISIONING_MANIFEST_MAX_LEN 512U
+
+/**
+ * \brief Encodes file access policy entry of provisioning manifest (see nbt-provisioning.h).
+ */
+#define PROVISIONING_FAP(file_id, i2c_read, i2c_write, nfc_read, nfc_write)                                                                      \
+    NBT_PROVISIONING_ENTRY_FAP, (uint8_t) ((file_id) >> 8U), (uint8_t) (file_id), (uint8_t) (i2c_read), (uint8_t) (i2c_write), (uint8_t) (nfc_read), \
+        (uint8_t) (nfc_write)
+
+/**
+ * \brief Built-in provisioning manifest matching nbt_configure_ble_connection_handover().
+ * \details NDEF contents are written during start-up, so only access policies and configuration are provisioned.
+ */
+// clang-format off
+static const uint8_t PROVISIONING_MANIFEST[] = {
+    // Magic, version, number of entries
+    'N', 'B', 'T', 'M', NBT_PROVISIONING_VERSION, 9U,
+    PROVISIONING_FAP(NBT_FILEID_CC, NBT_ACCESS_ALWAYS, NBT_ACCESS_NEVER, NBT_ACCESS_ALWAYS, NBT_ACCESS_NEVER),
+    PROVISIONING_FAP(NBT_FILEID_NDEF, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS, NBT_ACCESS_NEVER),
+    PROVISIONING_FAP(NBT_FILEID_FAP, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS),
+    PROVISIONING_FAP(NBT_FILEID_PROPRIETARY1, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS, NBT_ACCESS_ALWAYS),
+#if NBT_DEVICE_DATA_PROTECTED
+    PROVISIONING_FAP(NBT_FILEID_PROPRIETARY2, NBT_ACCESS_CONDITION_PASSWORD(NBT_DEVICE_DATA_PASSWORD_ID), NBT_ACCESS_CONDITION_PASSWORD(NBT_DEVICE_DATA_PASSWORD_ID),
+                     NBT_ACCESS_CONDITION_PASSWORD(NBT_DEVICE_DATA_PASSWORD_ID), NBT_ACCESS_NEVER),
+#else
+    PROVISIONING_FAP(NBT_FILEID_PROPRIETARY2, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER),
+#endif
+    PROVISIONING_FAP(NBT_FILEID_PROPRIETARY3, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER),
+    PROVISIONING_FAP(NBT_FILEID_PROPRIETARY4, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER, NBT_ACCESS_NEVER),
+    NBT_PROVISIONING_ENTRY_CONFIGURATION, NBT_PROVISIONING_CONFIGURATION_COMMUNICATION_INTERFACE, (uint8_t) NBT_COMM_INTF_NFC_ENABLED_I2C_ENABLED,
+    NBT_PROVISIONING_ENTRY_CONFIGURATION, NBT_PROVISIONING_CONFIGURATION_GPIO_FUNCTION, (uint8_t) NBT_IRQ_FUNCTION
+};
+// clang-format on
+
+/**
+ * \brief Handle of provisioning_task() once started.
+ */
+static TaskHandle_t provisioning_task_handle = NULL;
+
+/**
+ * \brief Simple flag if provisioning_task() is currently applying the manifest.
+ */
+static volatile bool provisioning_running = false;
+
+/**
+ * \brief Stack depth of provisioning_task() in words.
+ */
+#define PROVISIONING_TASK_STACK_DEPTH 1536U
+
+/**
+ * \brief Stack of provisioning_task() (started after start-up, so no heap allocation).
+ */
+static StackType_t provisioning_task_stack[PROVISIONING_TASK_STACK_DEPTH];
+
+/**
+ * \brief Task control block of provisioning_task().
+ */
+static StaticTask_t provisioning_task_buffer;
+
+/**
+ * \brief FreeRTOS task applying provisioning manifest to on-board NBT and line station NBTs whenever notified.
+ * \details Uses manifest stored under PROVISIONING_MANIFEST_KEY if available, PROVISIONING_MANIFEST otherwise.
+ * \param[in] data Ignored.
+ */
+static void provisioning_task(void *data)
+{
+    (void) data;
+
+    nbt_provisioning_add_tag(&nbt, NBT_DEFAULT_I2C_ADDRESS);
+#if PROVISIONING_LINE_TAGS > 0
+    for (size_t i = 0U; i < PROVISIONING_LINE_TAGS; i++)
+    {
+        if (ifx_error_check(nbt_provisioning_attach_tag(&i2c_device, (uint8_t) (NBT_DEFAULT_I2C_ADDRESS + 1U + i))))
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not attach line station NBT %u", (unsigned int) i);
+        }
+    }
+#endif
+
+    static uint8_t stored_manifest[PROVISIONING_MANIFEST_MAX_LEN];
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t stored_manifest_len = sizeof(stored_manifest);
+        const uint8_t *manifest = PROVISIONING_MANIFEST;
+        size_t manifest_len = sizeof(PROVISIONING_MANIFEST);
+        if (data_storage_get(PROVISIONING_MANIFEST_KEY, stored_manifest, &stored_manifest_len) == CY_RSLT_SUCCESS)
+        {
+            manifest = stored_manifest;
+            manifest_len = stored_manifest_len;
+        }
+        if (ifx_error_check(nbt_provisioning_run(manifest, manifest_len, &nbt_lock)))
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Factory provisioning failed");
+        }
+        provisioning_running = false;
+    }
+}
+
 /**
  * \brief FreeRTOS task waiting for button presses and handling user inputs accordingly.
- * \details Short click sends HID events, long click resets BLE bonding data.
+ * \details Short click sends HID events, press of PAIRING_WINDOW_PRESS_MIN_MS lets new devices pair, press of PROVISIONING_PRESS_MIN_MS
+ *          starts factory provisioning, long click resets BLE bonding data.
  * \param[in] data Ignored.
  */
 static void btn_task(void *data)
@@ -188,11 +476,14 @@ static void btn_task(void *data)
     (void) data;
 
     static uint32_t press_start = 0U;
+    watchdog_supervisor_id_t watchdog_id = watchdog_supervisor_register("Button", xTaskGetCurrentTaskHandle(), TASK_HEARTBEAT_SLO_MS);
 
     // Wait for button interrupt
     while (1)
     {
-        if (xSemaphoreTake(btn_irq_sleeper, portMAX_DELAY) == pdPASS)
+        BaseType_t pressed = xSemaphoreTake(btn_irq_sleeper, pdMS_TO_TICKS(BTN_TASK_HEARTBEAT_PERIOD_MS));
+        watchdog_supervisor_heartbeat(watchdog_id);
+        if (pressed == pdPASS)
         {
             if (cyhal_gpio_read(CYBSP_USER_BTN) == CYBSP_BTN_PRESSED)
             {
@@ -201,10 +492,39 @@ static void btn_task(void *data)
             else
             {
                 uint32_t press_duration = elapsed_periods - press_start;
-                if ((press_duration * PERIOD_LENGTH_MS) > 5000U)
+                if ((press_duration * PERIOD_LENGTH_MS) > BONDING_RESET_PRESS_MIN_MS)
                 {
                     ble_clear_bonding_info();
                 }
+                else if ((press_duration * PERIOD_LENGTH_MS) >= PROVISIONING_PRESS_MIN_MS)
+                {
+                    if (!nbt_ready)
+                    {
+                        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "NBT not ready - factory provisioning not started");
+                    }
+                    else if (!provisioning_running)
+                    {
+                        // Task is kept after first provisioning, re-creating static tasks could race with idle task clean-up
+                        if (provisioning_task_handle == NULL)
+                        {
+                            provisioning_task_handle = xTaskCreateStatic(provisioning_task, (char *) "Provision", PROVISIONING_TASK_STACK_DEPTH, 0U,
+                                                                         configMAX_PRIORITIES - 4U, provisioning_task_stack, &provisioning_task_buffer);
+                        }
+                        if (provisioning_task_handle == NULL)
+                        {
+                            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not start factory provisioning");
+                        }
+                        else
+                        {
+                            provisioning_running = true;
+                            xTaskNotifyGive(provisioning_task_handle);
+                        }
+                    }
+                }
+                else if ((press_duration * PERIOD_LENGTH_MS) >= PAIRING_WINDOW_PRESS_MIN_MS)
+                {
+                    advertising_filter_open();
+                }
                 else
                 {
                     ble_gatt_send_hid_update();
@@ -214,6 +534,37 @@ static void btn_task(void *data)
     }
 }
 
+/**
+ * \brief Writes range of connection_handover to NBT once it is ready.
+ * \details While the NBT is not ready, the change is only kept in connection_handover and written by nbt_attach().
+ * \details If nbt_lock is not available within NBT_LOCK_TIMEOUT_MS, the whole message is written by nbt_task() instead.
+ * \param[in] offset Offset of changed range.
+ * \param[in] length Number of bytes in changed range.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_write_handover(size_t offset, size_t length)
+{
+    taskENTER_CRITICAL();
+    bool ready = nbt_ready;
+    handover_pending = handover_pending || !ready;
+    taskEXIT_CRITICAL();
+    if (!ready)
+    {
+        return IFX_SUCCESS;
+    }
+    if (!profiled_mutex_take(&nbt_lock, pdMS_TO_TICKS(NBT_LOCK_TIMEOUT_MS)))
+    {
+        // Do not stall BLE stack (and its heartbeat) behind long NBT operations
+        taskENTER_CRITICAL();
+        handover_pending = true;
+        taskEXIT_CRITICAL();
+        return IFX_SUCCESS;
+    }
+    ifx_status_t status = nbt_write_file(&nbt, NBT_FILEID_NDEF, offset, connection_handover.message + offset, length);
+    profiled_mutex_give(&nbt_lock);
+    return status;
+}
+
 /**
  * \brief Callback triggered once BLE MAC address is available / changed.
  * \details This callback is used to update the NBT NDEF file to set the MAC address for the NFC connection handover.
@@ -224,41 +575,213 @@ ifx_status_t callback_mac_address_changed(wiced_bt_device_address_t mac)
 {
     for (size_t i = 0U; i < sizeof(wiced_bt_device_address_t); i++)
     {
-        CONNECTION_HANDOVER_MESSAGE[CONNECTION_HANDOVER_MESSAGE_MAC_OFFSET + i] = mac[sizeof(wiced_bt_device_address_t) - 1U - i];
+        connection_handover.message[connection_handover.address_offset + i] = mac[sizeof(wiced_bt_device_address_t) - 1U - i];
     }
-    return nbt_write_file(&nbt, NBT_FILEID_NDEF, CONNECTION_HANDOVER_MESSAGE_MAC_OFFSET, CONNECTION_HANDOVER_MESSAGE + CONNECTION_HANDOVER_MESSAGE_MAC_OFFSET,
-                          sizeof(wiced_bt_device_address_t));
+    return nbt_write_handover(connection_handover.address_offset, sizeof(wiced_bt_device_address_t));
 }
 
 /**
- * \brief Callback triggered once LE Secure Connection Confirmation Value is available / changed.
- * \details This callback is used to update the NBT NDEF file to set the SC confirmation value for the NFC connection handover.
+ * \brief Callback triggered once LE Secure Connection OOB data is available / changed.
+ * \details This callback is used to update the NBT NDEF file to set the SC confirmation and random value for the NFC connection handover.
+ * \details Both values are written as one range so that a reader never sees a confirmation value not matching the random value.
  * \param[in] confirmation LE Secure Connection Confirmation Value to write to connection handover record.
+ * \param[in] random LE Secure Connection Random Value to write to connection handover record.
  * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
  */
-ifx_status_t callback_sc_confirmation_value_changed(uint8_t confirmation[0x10U])
+ifx_status_t callback_sc_oob_data_changed(uint8_t confirmation[0x10U], uint8_t random[0x10U])
 {
-    memcpy(CONNECTION_HANDOVER_MESSAGE + CONNECTION_HANDOVER_MESSAGE_CONFIRMATION_OFFSET, confirmation, 0x10U);
-    return nbt_write_file(&nbt, NBT_FILEID_NDEF, CONNECTION_HANDOVER_MESSAGE_CONFIRMATION_OFFSET,
-                          CONNECTION_HANDOVER_MESSAGE + CONNECTION_HANDOVER_MESSAGE_CONFIRMATION_OFFSET, 0x10U);
+    size_t start = SIZE_MAX;
+    size_t end = 0U;
+
+    // Each value only if selected for configured phone profile
+    if (connection_handover.confirmation_offset != 0U)
+    {
+        memcpy(connection_handover.message + connection_handover.confirmation_offset, confirmation, 0x10U);
+        start = connection_handover.confirmation_offset;
+        end = connection_handover.confirmation_offset + 0x10U;
+    }
+    if (connection_handover.random_offset != 0U)
+    {
+        memcpy(connection_handover.message + connection_handover.random_offset, random, 0x10U);
+        start = (connection_handover.random_offset < start) ? connection_handover.random_offset : start;
+        end = ((connection_handover.random_offset + 0x10U) > end) ? (connection_handover.random_offset + 0x10U) : end;
+    }
+    if (start >= end)
+    {
+        return IFX_SUCCESS;
+    }
+    return nbt_write_handover(start, end - start);
 }
 
 /**
- * \brief Callback triggered once LE Secure Connection Confirmation Value is available / changed.
- * \details This callback is used to update the NBT NDEF file to set the SC confirmation value for the NFC connection handover.
- * \param[in] random LE Secure Connection Random Value to write to connection handover record.
+ * \brief Returns current battery level for device status record.
+ * \details The prototyping kit is USB powered without battery measurement, replace for battery powered designs.
+ * \return uint8_t Battery level in percent or \c 0xFF if unknown.
+ */
+static uint8_t status_battery_level(void)
+{
+    return 0xFFU;
+}
+
+/**
+ * \brief Updates device status values in connection_handover.
+ * \param[out] offset Offset of first changed byte in connection_handover.
+ * \param[out] length Number of bytes between first and last changed byte (\c 0 if unchanged or device status record not selected).
+ */
+static void status_record_update(size_t *offset, size_t *length)
+{
+    *offset = 0U;
+    *length = 0U;
+    if (connection_handover.status_offset == 0U)
+    {
+        return;
+    }
+    const size_t battery_offset = connection_handover.status_offset + CONNECTION_HANDOVER_STATUS_BATTERY_OFFSET;
+    const uint8_t values[] = {status_battery_level(), ble_get_bond_count()};
+    size_t first = sizeof(values);
+    size_t last = 0U;
+    for (size_t i = 0U; i < sizeof(values); i++)
+    {
+        if (connection_handover.message[battery_offset + i] != values[i])
+        {
+            connection_handover.message[battery_offset + i] = values[i];
+            first = (i < first) ? i : first;
+            last = i;
+        }
+    }
+    *offset = battery_offset + first;
+    *length = (first < sizeof(values)) ? (last - first + 1U) : 0U;
+}
+
+/**
+ * \brief Updates device status record in connection_handover and writes changed bytes to NBT.
+ * \details Called once the NBT signals an NFC field so that the phone reads fresh values at (almost) no idle cost.
+ * \details Only the range between first and last changed byte is written to save NBT NVM and I2C time.
+ * \param[in] nbt NBT abstraction for communication.
  * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
  */
-ifx_status_t callback_sc_random_value_changed(uint8_t random[0x10U])
+static ifx_status_t nbt_refresh_status_record(nbt_cmd_t *nbt)
 {
-    memcpy(CONNECTION_HANDOVER_MESSAGE + CONNECTION_HANDOVER_MESSAGE_RANDOM_OFFSET, random, 0x10U);
-    return nbt_write_file(&nbt, NBT_FILEID_NDEF, CONNECTION_HANDOVER_MESSAGE_RANDOM_OFFSET,
-                          CONNECTION_HANDOVER_MESSAGE + CONNECTION_HANDOVER_MESSAGE_RANDOM_OFFSET, 0x10U);
+    size_t offset = 0U;
+    size_t length = 0U;
+    status_record_update(&offset, &length);
+    if (length == 0U)
+    {
+        return IFX_SUCCESS;
+    }
+    return nbt_write_file(nbt, NBT_FILEID_NDEF, offset, connection_handover.message + offset, length);
+}
+
+/**
+ * \brief Parser for messages written to NBT mailbox by phone.
+ * \details Placeholder for phone-to-device configuration, currently only logs message.
+ * \param[in] message Message payload.
+ * \param[in] length Number of bytes in \c message.
+ * \param[in] context Ignored.
+ */
+static void mailbox_message_received(const uint8_t *message, size_t length, void *context)
+{
+    (void) context;
+
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "Phone sent %u byte message (type 0x%02X)", (unsigned int) length, message[0]);
+}
+
+/**
+ * \brief FreeRTOS task performing NBT maintenance.
+ * \details Processes NBT mailbox or refreshes device status record (depending on NBT_IRQ_MODE) once notified by nbt_irq(). Every
+ *          notification also lets any device scan and connect for ADVERTISING_FILTER_WINDOW_MS.
+ * \details Periodically flushes writes deferred by the NVM write budget and connection handover changes nbt_write_handover() could not
+ *          write, lazily persists NVM write counters.
+ * \details NBT commands are only sent once nbt_attach() succeeded. Skips a cycle if nbt_lock is not available within NBT_LOCK_TIMEOUT_MS.
+ * \details Logs lock contention and task latency metrics every DIAGNOSTICS_REPORT_PERIOD_MS and dumps HCI capture once requested.
+ * \param[in] data Ignored.
+ */
+static void nbt_task(void *data)
+{
+    (void) data;
+
+    TickType_t last_report = xTaskGetTickCount();
+    watchdog_supervisor_id_t watchdog_id = watchdog_supervisor_register("NBT", xTaskGetCurrentTaskHandle(), TASK_HEARTBEAT_SLO_MS);
+    while (1)
+    {
+        uint32_t notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NBT_TASK_PERIOD_MS));
+        watchdog_supervisor_heartbeat(watchdog_id);
+        if (notified > 0U)
+        {
+            // NFC tap: phone is about to connect via connection handover
+            advertising_filter_open();
+        }
+        if (profiled_mutex_take(&nbt_lock, pdMS_TO_TICKS(NBT_LOCK_TIMEOUT_MS)))
+        {
+            if (nbt_ready && (notified > 0U))
+            {
+#if NBT_IRQ_MODE == NBT_IRQ_MODE_STATUS
+                nbt_refresh_status_record(&nbt);
+#else
+                nbt_mailbox_process(&nbt);
+#endif
+            }
+            if (nbt_ready)
+            {
+                taskENTER_CRITICAL();
+                bool pending = handover_pending;
+                handover_pending = false;
+                taskEXIT_CRITICAL();
+                if (pending)
+                {
+                    nbt_write_file(&nbt, NBT_FILEID_NDEF, 0U, connection_handover.message, connection_handover.length);
+                }
+                nbt_write_deferred(&nbt);
+            }
+            nbt_write_budget_persist(false);
+            profiled_mutex_give(&nbt_lock);
+        }
+        else if (notified > 0U)
+        {
+            // Keep NBT notification for next cycle
+            xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+        }
+        watchdog_supervisor_heartbeat(watchdog_id);
+        hci_snoop_report();
+        if ((xTaskGetTickCount() - last_report) >= pdMS_TO_TICKS(DIAGNOSTICS_REPORT_PERIOD_MS))
+        {
+            last_report = xTaskGetTickCount();
+            profiled_mutex_report();
+            nbt_pipeline_trace_report();
+            heap_guard_report();
+            log_limiter_report();
+            watchdog_supervisor_report();
+        }
+    }
 }
 
+#if NBT_DEVICE_DATA_PROTECTED
+/**
+ * \brief Updates device data in password protected proprietary file 2 if it differs from NBT_DEVICE_DATA.
+ * \param[in] nbt NBT abstraction for communication.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_update_device_data(nbt_cmd_t *nbt)
+{
+    uint8_t device_data[sizeof(NBT_DEVICE_DATA)];
+    ifx_status_t status = nbt_read_file(nbt, NBT_FILEID_PROPRIETARY2, 0x00U, sizeof(device_data), device_data);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+    if (memcmp(device_data, NBT_DEVICE_DATA, sizeof(NBT_DEVICE_DATA)) == 0)
+    {
+        return IFX_SUCCESS;
+    }
+    return nbt_write_file(nbt, NBT_FILEID_PROPRIETARY2, 0x00U, NBT_DEVICE_DATA, sizeof(NBT_DEVICE_DATA));
+}
+#endif
+
 /**
  * \brief Configures NBT for BLE connection handover usecase.
  * \details Sets file access policies, configures communication interface and writes connection handover skeleton to NDEF file.
+ * \details Device data in proprietary file 2 is protected by NBT_DEVICE_DATA_PASSWORD for both interfaces (see NBT_DEVICE_DATA_PROTECTED).
+ * \details Enables NBT GPIO write notifications for the phone-to-device mailbox or NFC field detection for the device status record (see NBT_IRQ_MODE).
  * \param[in] nbt NBT abstraction for communication.
  * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
  */
@@ -283,16 +806,29 @@ static ifx_status_t nbt_configure_ble_connection_handover(nbt_cmd_t *nbt)
                                               .i2c_write_access_condition = NBT_ACCESS_ALWAYS,
                                               .nfc_read_access_condition = NBT_ACCESS_ALWAYS,
                                               .nfc_write_access_condition = NBT_ACCESS_ALWAYS};
+    // Proprietary file 1 is used as NFC writable mailbox, acknowledged via I2C (see nbt-mailbox.h)
     const nbt_file_access_policy_t fap_proprietary1 = {.file_id = NBT_FILEID_PROPRIETARY1,
-                                                       .i2c_read_access_condition = NBT_ACCESS_NEVER,
-                                                       .i2c_write_access_condition = NBT_ACCESS_NEVER,
-                                                       .nfc_read_access_condition = NBT_ACCESS_NEVER,
+                                                       .i2c_read_access_condition = NBT_ACCESS_ALWAYS,
+                                                       .i2c_write_access_condition = NBT_ACCESS_ALWAYS,
+                                                       .nfc_read_access_condition = NBT_ACCESS_ALWAYS,
+                                                       .nfc_write_access_condition = NBT_ACCESS_ALWAYS};
+#if NBT_DEVICE_DATA_PROTECTED
+    // Proprietary file 2 holds device data only readable with password (see NBT_DEVICE_DATA_PASSWORD)
+    const nbt_file_access_policy_t fap_proprietary2 = {.file_id = NBT_FILEID_PROPRIETARY2,
+                                                       .i2c_read_access_condition = NBT_ACCESS_CONDITION_PASSWORD(NBT_DEVICE_DATA_PASSWORD_ID),
+                                                       .i2c_write_access_condition = NBT_ACCESS_CONDITION_PASSWORD(NBT_DEVICE_DATA_PASSWORD_ID),
+                                                       .nfc_read_access_condition = NBT_ACCESS_CONDITION_PASSWORD(NBT_DEVICE_DATA_PASSWORD_ID),
                                                        .nfc_write_access_condition = NBT_ACCESS_NEVER};
+    const struct nbt_password_binding passwords[] = {
+        {.file_id = NBT_FILEID_PROPRIETARY2, .password_id = NBT_DEVICE_DATA_PASSWORD_ID, .password = NBT_DEVICE_DATA_PASSWORD},
+    };
+#else
     const nbt_file_access_policy_t fap_proprietary2 = {.file_id = NBT_FILEID_PROPRIETARY2,
                                                        .i2c_read_access_condition = NBT_ACCESS_NEVER,
                                                        .i2c_write_access_condition = NBT_ACCESS_NEVER,
                                                        .nfc_read_access_condition = NBT_ACCESS_NEVER,
                                                        .nfc_write_access_condition = NBT_ACCESS_NEVER};
+#endif
     const nbt_file_access_policy_t fap_proprietary3 = {.file_id = NBT_FILEID_PROPRIETARY3,
                                                        .i2c_read_access_condition = NBT_ACCESS_NEVER,
                                                        .i2c_write_access_condition = NBT_ACCESS_NEVER,
@@ -307,54 +843,132 @@ static ifx_status_t nbt_configure_ble_connection_handover(nbt_cmd_t *nbt)
     const struct nbt_configuration configuration = {.fap = (nbt_file_access_policy_t **) faps,
                                                     .fap_len = sizeof(faps) / sizeof(struct nbt_configuration *),
                                                     .communication_interface = NBT_COMM_INTF_NFC_ENABLED_I2C_ENABLED,
-                                                    .irq_function = NBT_GPIO_FUNCTION_DISABLED};
+                                                    .irq_function = NBT_IRQ_FUNCTION,
+#if NBT_DEVICE_DATA_PROTECTED
+                                                    .passwords = passwords,
+                                                    .passwords_len = sizeof(passwords) / sizeof(passwords[0]),
+#endif
+    };
     ifx_status_t status = nbt_configure(nbt, &configuration);
     if (ifx_error_check(status))
     {
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not confgure NBT for connection handover usecase.");
         return status;
     }
+#if NBT_DEVICE_DATA_PROTECTED
+    if (ifx_error_check(nbt_update_device_data(nbt)))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not update password protected device data (password personalized?)");
+    }
+#endif
 
     // Write skeleton message, later updated based on events
+    size_t status_offset = 0U;
+    size_t status_length = 0U;
+    status_record_update(&status_offset, &status_length);
     if (ifx_error_check(nbt_select_nbt_application(nbt)))
     {
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not re-select NBT application.");
         return status;
     }
-    return nbt_write_file(nbt, NBT_FILEID_NDEF, 0x00, CONNECTION_HANDOVER_MESSAGE, sizeof(CONNECTION_HANDOVER_MESSAGE));
+    const struct nbt_capability_container *cc = nbt_get_capability_container();
+    if ((cc != NULL) && (cc->mle != connection_handover.mle))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "NDEF layout optimized for MLe %u but NBT declares MLe %u", (unsigned int) connection_handover.mle, cc->mle);
+        ndef_layout_report(&connection_handover, cc->mle);
+    }
+    if (connection_handover.length > nbt_get_file_size(NBT_FILEID_NDEF))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Connection handover message does not fit into NDEF file.");
+        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_ILLEGAL_ARGUMENT);
+    }
+    return nbt_write_file(nbt, NBT_FILEID_NDEF, 0x00, connection_handover.message, connection_handover.length);
 }
 
 /**
- * \brief FreeRTOS task establishing communication channel to NBT and then starting all other tasks.
- * \details NBT should be configured before starting the BLE stack but requires FreeRTOS to be running.
- * \param[in] data Ignored.
+ * \brief Activates NBT and configures it for BLE connection handover.
+ * \details Also writes changes to connection_handover made while the NBT was not ready.
+ * \return bool \c true if NBT is ready, \c false otherwise.
  */
-static void startup_task(void *arg)
+static bool nbt_attach(void)
 {
-    (void) arg;
-
-    // Activate communication channel to NBT
+    profiled_mutex_take(&nbt_lock, portMAX_DELAY);
     uint8_t *atpo = NULL;
     size_t atpo_len = 0U;
     ifx_status_t status = ifx_protocol_activate(&communication_protocol, &atpo, &atpo_len);
-    if (ifx_error_check(status))
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not open communication channel to NBT");
-        goto cleanup;
-    }
     if (atpo != NULL)
     {
         free(atpo);
-        atpo = NULL;
+    }
+    nbt_pipeline_invalidate();
+    if (ifx_error_check(status))
+    {
+        profiled_mutex_give(&nbt_lock);
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not open communication channel to NBT");
+        return false;
     }
 
     // Set NBT to BLE connection handover configuration
     status = nbt_configure_ble_connection_handover(&nbt);
     if (ifx_error_check(status))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not set NBT to BLE connection handover configuration");
+        profiled_mutex_give(&nbt_lock);
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not set NBT to BLE connection handover configuration");
+        return false;
+    }
+    taskENTER_CRITICAL();
+    nbt_ready = true;
+    bool pending = handover_pending;
+    handover_pending = false;
+    taskEXIT_CRITICAL();
+    if (pending)
+    {
+        nbt_write_file(&nbt, NBT_FILEID_NDEF, 0U, connection_handover.message, connection_handover.length);
+    }
+    profiled_mutex_give(&nbt_lock);
+    return true;
+}
+
+/**
+ * \brief FreeRTOS task attaching the NBT, retrying with exponential backoff until it responds.
+ * \details Gives nbt_attached and enables NBT GPIO notifications once the NBT is ready.
+ * \param[in] data Ignored.
+ */
+static void nbt_attach_task(void *data)
+{
+    (void) data;
+
+    uint32_t backoff = NBT_ATTACH_BACKOFF_MIN_MS;
+    while (!nbt_attach())
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "NBT not ready - retrying in %u ms", (unsigned int) backoff);
+        vTaskDelay(pdMS_TO_TICKS(backoff));
+        backoff = ((backoff * 2U) < NBT_ATTACH_BACKOFF_MAX_MS) ? (backoff * 2U) : NBT_ATTACH_BACKOFF_MAX_MS;
+    }
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "NBT ready for connection handover");
+    cyhal_gpio_enable_event(NBT_IRQ_PIN, CYHAL_GPIO_IRQ_FALL, configMAX_PRIORITIES - 1U, true);
+    xSemaphoreGive(nbt_attached);
+    vTaskDelete(NULL);
+}
+
+/**
+ * \brief FreeRTOS task starting all other tasks.
+ * \details The NBT should be configured before starting the BLE stack so that the first phone tap already sees the connection handover
+ *          record. If the NBT is not ready within NBT_ATTACH_DEADLINE_MS, the BLE stack is started anyway and nbt_attach_task() attaches the
+ *          NBT once it responds.
+ * \param[in] data Ignored.
+ */
+static void startup_task(void *arg)
+{
+    (void) arg;
+
+    // Connection handover message layout with fewest reads per tap, values are filled in once available
+    if (!ndef_layout_build(&connection_handover, NDEF_LAYOUT_MLE, NDEF_LAYOUT_REQUIRED_FIELDS, CONNECTION_HANDOVER_OPTIONAL_FIELDS, CONNECTION_HANDOVER_STATUS))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not build connection handover message");
         goto cleanup;
     }
+    ndef_layout_report(&connection_handover, NDEF_LAYOUT_MLE);
 
     // Start global time keeper here
     if (xTimerStart(time_keeper, 0U) != pdPASS)
@@ -370,13 +984,46 @@ static void startup_task(void *arg)
         goto cleanup;
     }
 
+    // BLE security keys are served from RAM once the stack is running
+    if (key_cache_load() != CY_RSLT_SUCCESS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not load BLE security keys");
+    }
+
+    // Merge NBT write counters collected since boot with persisted ones
+    nbt_write_budget_load();
+    nbt_write_budget_report();
+    nbt_mailbox_register_parser(mailbox_message_received, NULL);
+    if (xTaskCreate(nbt_task, (char *) "NBT", 1024U, 0U, configMAX_PRIORITIES - 4U, &nbt_task_handle) != pdPASS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not start NBT maintenance task");
+        goto cleanup;
+    }
+
+    // Supervise tasks via hardware watchdog from here on
+    if (watchdog_supervisor_start() != CY_RSLT_SUCCESS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not start watchdog supervisor");
+        goto cleanup;
+    }
+
+    // Attach NBT in background, BLE does not wait longer than NBT_ATTACH_DEADLINE_MS
+    nbt_attached = xSemaphoreCreateBinary();
+    if ((nbt_attached == NULL) || (xTaskCreate(nbt_attach_task, (char *) "NBT attach", 1024U, 0U, configMAX_PRIORITIES - 3U, NULL) != pdPASS))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not start NBT activation");
+        goto cleanup;
+    }
+    if (xSemaphoreTake(nbt_attached, pdMS_TO_TICKS(NBT_ATTACH_DEADLINE_MS)) != pdPASS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "NBT not ready within %u ms - starting BLE first", NBT_ATTACH_DEADLINE_MS);
+    }
+
     // Start BLE GATT server
     if (wiced_bt_stack_init(ble_callback, &wiced_bt_cfg_settings) != WICED_BT_SUCCESS)
     {
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not start BLE GATT server");
-        goto cleanup;
     }
-
     vTaskDelete(NULL);
     return;
 
@@ -436,9 +1083,25 @@ int main(void)
     {
         CY_ASSERT(0);
     }
+    if (!profiled_mutex_initialize(&nbt_lock, "nbt"))
+    {
+        CY_ASSERT(0);
+    }
     cyhal_gpio_register_callback(CYBSP_USER_BTN, &btn_irq_data);
     cyhal_gpio_enable_event(CYBSP_USER_BTN, CYHAL_GPIO_IRQ_BOTH, configMAX_PRIORITIES - 1U, true);
 
+    // NBT GPIO signalling NFC writes to mailbox (enabled once nbt_task() is running)
+    result = cyhal_gpio_init(NBT_IRQ_PIN, CYHAL_GPIO_DIR_INPUT, CYHAL_GPIO_DRIVE_PULLUP, true);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        CY_ASSERT(0);
+    }
+    cyhal_gpio_register_callback(NBT_IRQ_PIN, &nbt_irq_data);
+#if NBT_IRQ_MODE == NBT_IRQ_MODE_STATUS
+    // Every tap opens advertising filter window, mailbox writes are not part of a regular connection handover
+    advertising_filter_restrict();
+#endif
+
     // I2C driver for communication with NBT
     cyhal_i2c_cfg_t i2c_cfg = {.is_slave = false, .address = 0x00U, .frequencyhal_hz = 400000U};
     result = cyhal_i2c_init(&i2c_device, CYBSP_I2C_SDA, CYBSP_I2C_SCL, NULL);
@@ -494,7 +1157,7 @@ int main(void)
     }
 
     // I2C driver adapter
-    status = i2c_cyhal_initialize(&driver_adapter, &i2c_device, NBT_DEFAULT_I2C_ADDRESS);
+    status = nbt_i2c_adapter_initialize(&driver_adapter, &i2c_device, NBT_DEFAULT_I2C_ADDRESS);
     if (ifx_error_check(status))
     {
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not initialize I2C driver adapter");
@@ -502,7 +1165,7 @@ int main(void)
     }
 
     // Communication protocol (data link layer)
-    status = ifx_t1prime_initialize(&communication_protocol, &driver_adapter);
+    status = ifx_t1prime_initialize(&communication_protocol, &driver_adapter.protocol);
     if (ifx_error_check(status))
     {
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not initialize NBT communication protocol");
@@ -517,6 +1180,7 @@ int main(void)
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not initialize NBT abstraction");
         CY_ASSERT(0);
     }
+    nbt_set_primary(&nbt);
 
     ///////////////////////////////////////////////////////////////////////////
     // FreeRTOS start-up
@@ -0,0 +1,251 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file advertising-filter.c
+ * \brief Advertising filter policy restricting scan and connection requests to bonded devices.
+ * \details Bonded devices (see *key-cache.h*) are mirrored into the controller's filter accept list. As long as at least one device is
+ *          bonded, the controller drops scan and connection requests of all other devices without waking the host.
+ * \details advertising_filter_open() accepts requests of any device for ADVERTISING_FILTER_WINDOW_MS so that new devices can pair
+ *          (e.g. after a button gesture or an NFC tap).
+ * \details Requests are only restricted after advertising_filter_restrict(), which must only be called if every new device can open the
+ *          window (e.g. NFC field detection on tap).
+ * \details Policy changes take effect by restarting an active advertisement (restarted by the BTM_BLE_ADVERT_STATE_CHANGED_EVT
+ *          handler).
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "wiced_bt_ble.h"
+#include "wiced_bt_dev.h"
+#include "wiced_timer.h"
+
+#include "advertising-filter.h"
+#include "key-cache.h"
+#include "metrics.h"
+
+/**
+ * \brief Devices currently in controller's filter accept list.
+ */
+static wiced_bt_device_address_t accept_list[KEY_CACHE_LINK_KEYS];
+
+/**
+ * \brief Number of devices in accept_list.
+ */
+static size_t accept_list_len = 0U;
+
+/**
+ * \brief Simple flag if BLE stack is up (advertising_filter_update() called at least once).
+ */
+static bool enabled = false;
+
+/**
+ * \brief Simple flag if advertising_filter_restrict() has been called.
+ */
+static volatile bool restricted = false;
+
+/**
+ * \brief Simple flag if requests of any device are currently accepted.
+ */
+static volatile bool window_open = false;
+
+/**
+ * \brief WICED timer closing window.
+ */
+static wiced_timer_t window_timer;
+
+/**
+ * \brief Simple flag if window_timer has been initialized.
+ */
+static bool timer_initialized = false;
+
+/**
+ * \brief Filter policy currently requested from controller.
+ */
+static wiced_bt_ble_advert_filter_policy_t policy = BTM_BLE_ADV_POLICY_ACCEPT_CONN_AND_SCAN;
+
+/**
+ * \brief 1 while scan and connection requests are restricted to bonded devices, 0 otherwise.
+ */
+static struct metric filtered_metric = METRICS_GAUGE("adv.filtered");
+
+/**
+ * \brief Number of windows opened via advertising_filter_open().
+ */
+static struct metric windows_metric = METRICS_COUNTER("adv.filter_windows");
+
+/**
+ * \brief Checks if device is bonded.
+ * \param[in] address Address of device.
+ * \return bool \c true if device is bonded, \c false otherwise.
+ */
+static bool advertising_filter_bonded(const wiced_bt_device_address_t address)
+{
+    for (size_t i = 0U; i < key_cache_bond_count(); i++)
+    {
+        if (memcmp(key_cache_bond(i)->bd_addr, address, sizeof(wiced_bt_device_address_t)) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Checks if device is in accept_list.
+ * \param[in] address Address of device.
+ * \return bool \c true if device is in accept list, \c false otherwise.
+ */
+static bool advertising_filter_listed(const wiced_bt_device_address_t address)
+{
+    for (size_t i = 0U; i < accept_list_len; i++)
+    {
+        if (memcmp(accept_list[i], address, sizeof(wiced_bt_device_address_t)) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Synchronizes controller's filter accept list with bonded devices.
+ * \return wiced_result_t \c WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+static wiced_result_t advertising_filter_sync(void)
+{
+    wiced_result_t result = WICED_BT_SUCCESS;
+
+    // Remove devices no longer bonded
+    size_t kept = 0U;
+    for (size_t i = 0U; i < accept_list_len; i++)
+    {
+        if (advertising_filter_bonded(accept_list[i]))
+        {
+            memmove(accept_list[kept++], accept_list[i], sizeof(wiced_bt_device_address_t));
+        }
+        else if (!wiced_bt_ble_update_advertising_filter_accept_list(WICED_FALSE, accept_list[i]))
+        {
+            result = WICED_BT_ERROR;
+        }
+    }
+    accept_list_len = kept;
+
+    // Add newly bonded devices
+    for (size_t i = 0U; (i < key_cache_bond_count()) && (accept_list_len < KEY_CACHE_LINK_KEYS); i++)
+    {
+        wiced_bt_device_address_t address;
+        memcpy(address, key_cache_bond(i)->bd_addr, sizeof(address));
+        if (advertising_filter_listed(address))
+        {
+            continue;
+        }
+        if (!wiced_bt_ble_update_advertising_filter_accept_list(WICED_TRUE, address))
+        {
+            result = WICED_BT_ERROR;
+            continue;
+        }
+        memcpy(accept_list[accept_list_len++], address, sizeof(wiced_bt_device_address_t));
+    }
+    return result;
+}
+
+/**
+ * \brief Applies filter policy matching current accept list and window.
+ * \return wiced_result_t \c WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+static wiced_result_t advertising_filter_apply(void)
+{
+    // Without any listed device filtering would lock out everybody
+    wiced_bt_ble_advert_filter_policy_t requested = BTM_BLE_ADV_POLICY_ACCEPT_CONN_AND_SCAN;
+#if ADVERTISING_FILTER_ENABLED
+    if (restricted && (accept_list_len > 0U) && !window_open)
+    {
+        requested = BTM_BLE_ADV_POLICY_FILTER_CONN_FILTER_SCAN;
+    }
+#endif
+    if (requested == policy)
+    {
+        return WICED_BT_SUCCESS;
+    }
+    if (!wiced_btm_ble_update_advertisement_filter_policy(requested))
+    {
+        return WICED_BT_ERROR;
+    }
+    policy = requested;
+    metrics_set(&filtered_metric, (policy == BTM_BLE_ADV_POLICY_ACCEPT_CONN_AND_SCAN) ? 0U : 1U);
+
+    // Policy is only picked up when advertising starts
+    if (wiced_bt_ble_get_current_advert_mode() != BTM_BLE_ADVERT_OFF)
+    {
+        return wiced_bt_start_advertisements(BTM_BLE_ADVERT_OFF, 0U, NULL);
+    }
+    return WICED_BT_SUCCESS;
+}
+
+/**
+ * \brief Closes window once ADVERTISING_FILTER_WINDOW_MS elapsed.
+ * \param[in] param Ignored.
+ */
+static void advertising_filter_close(WICED_TIMER_PARAM_TYPE param)
+{
+    (void) param;
+
+    window_open = false;
+    advertising_filter_apply();
+}
+
+/**
+ * \brief Mirrors bonded devices into filter accept list and applies filter policy.
+ *
+ * \details Must be called whenever the set of bonded devices changes.
+ *
+ * \return wiced_result_t \c WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_result_t advertising_filter_update(void)
+{
+    enabled = true;
+    wiced_result_t result = advertising_filter_sync();
+    wiced_result_t apply_result = advertising_filter_apply();
+    return (result != WICED_BT_SUCCESS) ? result : apply_result;
+}
+
+/**
+ * \brief Accepts requests of any device for ADVERTISING_FILTER_WINDOW_MS.
+ *
+ * \details Calling again while open restarts the window.
+ */
+void advertising_filter_open(void)
+{
+    // Nothing filtered before BLE stack is up
+    if (!enabled)
+    {
+        return;
+    }
+    if (!timer_initialized)
+    {
+        wiced_init_timer(&window_timer, advertising_filter_close, 0U, WICED_MILLI_SECONDS_TIMER);
+        timer_initialized = true;
+    }
+    if (!window_open)
+    {
+        metrics_increment(&windows_metric, 1U);
+    }
+    window_open = true;
+    wiced_stop_timer(&window_timer);
+    wiced_start_timer(&window_timer, ADVERTISING_FILTER_WINDOW_MS);
+    advertising_filter_apply();
+}
+
+/**
+ * \brief Restricts requests to bonded devices outside of windows opened via advertising_filter_open().
+ *
+ * \details Until called, requests of any device are accepted. Only call if new devices can reliably open the window, otherwise no new
+ *          device can pair once one device is bonded.
+ */
+void advertising_filter_restrict(void)
+{
+    restricted = true;
+}
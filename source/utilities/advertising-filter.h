@@ -0,0 +1,67 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file advertising-filter.h
+ * \brief Advertising filter policy restricting scan and connection requests to bonded devices.
+ * \details Bonded devices (see *key-cache.h*) are mirrored into the controller's filter accept list. As long as at least one device is
+ *          bonded, the controller drops scan and connection requests of all other devices without waking the host.
+ * \details advertising_filter_open() accepts requests of any device for ADVERTISING_FILTER_WINDOW_MS so that new devices can pair
+ *          (e.g. after a button gesture or an NFC tap).
+ * \details Requests are only restricted after advertising_filter_restrict(), which must only be called if every new device can open the
+ *          window (e.g. NFC field detection on tap).
+ * \details Policy changes take effect by restarting an active advertisement (restarted by the BTM_BLE_ADVERT_STATE_CHANGED_EVT
+ *          handler).
+ */
+#ifndef ADVERTISING_FILTER_H
+#define ADVERTISING_FILTER_H
+
+#include "wiced_bt_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Simple flag if requests may be restricted to bonded devices (see advertising_filter_restrict()).
+ */
+#ifndef ADVERTISING_FILTER_ENABLED
+#define ADVERTISING_FILTER_ENABLED 1
+#endif
+
+/**
+ * \brief Time in milliseconds requests of any device are accepted after advertising_filter_open().
+ */
+#ifndef ADVERTISING_FILTER_WINDOW_MS
+#define ADVERTISING_FILTER_WINDOW_MS 30000U
+#endif
+
+/**
+ * \brief Mirrors bonded devices into filter accept list and applies filter policy.
+ *
+ * \details Must be called whenever the set of bonded devices changes.
+ *
+ * \return wiced_result_t \c WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_result_t advertising_filter_update(void);
+
+/**
+ * \brief Accepts requests of any device for ADVERTISING_FILTER_WINDOW_MS.
+ *
+ * \details Calling again while open restarts the window.
+ */
+void advertising_filter_open(void);
+
+/**
+ * \brief Restricts requests to bonded devices outside of windows opened via advertising_filter_open().
+ *
+ * \details Until called, requests of any device are accepted. Only call if new devices can reliably open the window, otherwise no new
+ *          device can pair once one device is bonded.
+ */
+void advertising_filter_restrict(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVERTISING_FILTER_H
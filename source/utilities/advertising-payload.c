@@ -0,0 +1,317 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file advertising-payload.c
+ * \brief Structured model of the BLE advertising payload updated in place while advertising continues.
+ * \details The payload is kept as list of AD fields (flags, name, appearance, manufacturer / service data, ...). Changed fields are
+ *          pushed to the controller via *LE Set Advertising Data* without stopping advertising, at most once per
+ *          ADVERTISING_PAYLOAD_MIN_INTERVAL_MS. Updates in between are coalesced into a single push.
+ * \details Pushes are performed from BLE stack context (WICED timer), fields may be updated from any task.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "wiced_bt_ble.h"
+#include "wiced_timer.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "infineon/ifx-logger.h"
+
+#include "advertising-payload.h"
+#include "log-limiter.h"
+#include "metrics.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT example"
+
+/**
+ * \brief Maximum number of data bytes of a single AD field.
+ */
+#define ADVERTISING_PAYLOAD_MAX_FIELD_LEN (ADVERTISING_PAYLOAD_MAX_LEN - 2U)
+
+/** \struct advertising_payload_field
+ * \brief Single AD field of payload.
+ */
+struct advertising_payload_field
+{
+    /**
+     * \brief AD type.
+     */
+    wiced_bt_ble_advert_type_t type;
+
+    /**
+     * \brief Number of bytes in advertising_payload_field.data.
+     */
+    uint8_t len;
+
+    /**
+     * \brief Field data (without length and type).
+     */
+    uint8_t data[ADVERTISING_PAYLOAD_MAX_FIELD_LEN];
+};
+
+/**
+ * \brief Current payload model.
+ */
+static struct advertising_payload_field fields[ADVERTISING_PAYLOAD_MAX_FIELDS];
+
+/**
+ * \brief Number of used entries in fields.
+ */
+static uint8_t fields_len = 0U;
+
+/**
+ * \brief Simple flag if payload model changed since last push.
+ */
+static bool dirty = false;
+
+/**
+ * \brief Simple flag if advertising_payload_initialize() has been called (pushes possible).
+ */
+static bool initialized = false;
+
+/**
+ * \brief FreeRTOS tick count of last push.
+ */
+static TickType_t last_push = 0U;
+
+/**
+ * \brief WICED timer pushing pending changes from BLE stack context.
+ */
+static wiced_timer_t push_timer;
+
+/**
+ * \brief Number of payload pushes to the controller.
+ */
+static struct metric push_count = METRICS_COUNTER("adv.updates");
+
+/**
+ * \brief Returns number of bytes of payload on air.
+ * \details Must be called from within a critical section.
+ * \return size_t Encoded length of all fields.
+ */
+static size_t advertising_payload_len(void)
+{
+    size_t len = 0U;
+    for (uint8_t i = 0U; i < fields_len; i++)
+    {
+        len += 2U + fields[i].len;
+    }
+    return len;
+}
+
+/**
+ * \brief Returns field of given type.
+ * \details Must be called from within a critical section.
+ * \param[in] type AD type to look for.
+ * \return struct advertising_payload_field * Matching field or \c NULL if not part of payload.
+ */
+static struct advertising_payload_field *advertising_payload_find(wiced_bt_ble_advert_type_t type)
+{
+    for (uint8_t i = 0U; i < fields_len; i++)
+    {
+        if (fields[i].type == type)
+        {
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Pushes current payload model to controller.
+ * \details Must be called from BLE stack context.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+static wiced_result_t advertising_payload_push(void)
+{
+    // Consistent copy of current model, controller copies payload before call returns
+    static struct advertising_payload_field pushed[ADVERTISING_PAYLOAD_MAX_FIELDS];
+    wiced_bt_ble_advert_elem_t elements[ADVERTISING_PAYLOAD_MAX_FIELDS];
+    taskENTER_CRITICAL();
+    uint8_t pushed_len = fields_len;
+    memcpy(pushed, fields, sizeof(struct advertising_payload_field) * pushed_len);
+    dirty = false;
+    taskEXIT_CRITICAL();
+
+    for (uint8_t i = 0U; i < pushed_len; i++)
+    {
+        elements[i].advert_type = pushed[i].type;
+        elements[i].len = pushed[i].len;
+        elements[i].p_data = pushed[i].data;
+    }
+    last_push = xTaskGetTickCount();
+    metrics_increment(&push_count, 1U);
+    return wiced_bt_ble_set_raw_advertisement_data(pushed_len, elements);
+}
+
+/**
+ * \brief Pushes pending changes to controller.
+ * \param[in] param Ignored.
+ */
+static void advertising_payload_timeout(WICED_TIMER_PARAM_TYPE param)
+{
+    (void) param;
+
+    if (dirty && (advertising_payload_push() != WICED_BT_SUCCESS))
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not update Bluetooth advertisement data");
+    }
+}
+
+/**
+ * \brief Schedules push of changed payload respecting ADVERTISING_PAYLOAD_MIN_INTERVAL_MS.
+ */
+static void advertising_payload_schedule(void)
+{
+    if (!initialized || (wiced_is_timer_in_use(&push_timer) == WICED_TRUE))
+    {
+        return;
+    }
+    uint32_t elapsed_ms = (uint32_t) (xTaskGetTickCount() - last_push) * portTICK_PERIOD_MS;
+    uint32_t delay_ms = (elapsed_ms < ADVERTISING_PAYLOAD_MIN_INTERVAL_MS) ? (ADVERTISING_PAYLOAD_MIN_INTERVAL_MS - elapsed_ms) : 1U;
+    wiced_start_timer(&push_timer, delay_ms);
+}
+
+/**
+ * \brief Sets, replaces or removes AD field in model.
+ * \param[in] type AD type of field.
+ * \param[in] prefix Bytes preceding \c data in field (e.g. company ID).
+ * \param[in] prefix_len Number of bytes in \c prefix.
+ * \param[in] data Field data (\c NULL to remove field).
+ * \param[in] data_len Number of bytes in \c data.
+ * \param[in] replace Simple flag if an existing field of same type is replaced.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+static wiced_result_t advertising_payload_update(wiced_bt_ble_advert_type_t type, const uint8_t *prefix, uint8_t prefix_len, const uint8_t *data,
+                                                 uint8_t data_len, bool replace)
+{
+    if (((data == NULL) && (data_len > 0U)) || (((size_t) prefix_len + data_len) > ADVERTISING_PAYLOAD_MAX_FIELD_LEN))
+    {
+        return WICED_BT_ILLEGAL_VALUE;
+    }
+    uint8_t len = prefix_len + data_len;
+
+    wiced_result_t result = WICED_BT_SUCCESS;
+    bool changed = false;
+    taskENTER_CRITICAL();
+    struct advertising_payload_field *field = advertising_payload_find(type);
+    if (data == NULL)
+    {
+        if (field != NULL)
+        {
+            // Keep order of remaining fields
+            size_t index = (size_t) (field - fields);
+            memmove(field, field + 1, sizeof(struct advertising_payload_field) * (fields_len - index - 1U));
+            fields_len--;
+            changed = true;
+        }
+    }
+    else if ((field != NULL) && !replace)
+    {
+        // Keep field set before initialization
+    }
+    else if ((field != NULL) && (field->len == len) && (memcmp(field->data, prefix, prefix_len) == 0) &&
+             (memcmp(field->data + prefix_len, data, data_len) == 0))
+    {
+        // Unchanged, nothing to push
+    }
+    else if ((advertising_payload_len() - ((field != NULL) ? (2U + field->len) : 0U) + 2U + len) > ADVERTISING_PAYLOAD_MAX_LEN)
+    {
+        result = WICED_BT_NO_RESOURCES;
+    }
+    else if ((field == NULL) && (fields_len >= ADVERTISING_PAYLOAD_MAX_FIELDS))
+    {
+        result = WICED_BT_NO_RESOURCES;
+    }
+    else
+    {
+        if (field == NULL)
+        {
+            field = &fields[fields_len++];
+            field->type = type;
+        }
+        field->len = len;
+        memcpy(field->data, prefix, prefix_len);
+        memcpy(field->data + prefix_len, data, data_len);
+        changed = true;
+    }
+    if (changed)
+    {
+        dirty = true;
+    }
+    taskEXIT_CRITICAL();
+
+    if (changed)
+    {
+        advertising_payload_schedule();
+    }
+    return result;
+}
+
+/**
+ * \brief Loads fields not set yet from generated advertising data and pushes payload to controller.
+ *
+ * \details Must be called from BLE stack context once the stack is enabled (BTM_ENABLED_EVT).
+ *
+ * \param[in] elements Generated advertising data (e.g. \c cy_bt_adv_packet_data).
+ * \param[in] elements_len Number of entries in \c elements.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_result_t advertising_payload_initialize(const wiced_bt_ble_advert_elem_t *elements, uint8_t elements_len)
+{
+    for (uint8_t i = 0U; i < elements_len; i++)
+    {
+        if (elements[i].len > UINT8_MAX)
+        {
+            return WICED_BT_ILLEGAL_VALUE;
+        }
+        wiced_result_t result =
+            advertising_payload_update(elements[i].advert_type, NULL, 0U, elements[i].p_data, (uint8_t) elements[i].len, false);
+        if (result != WICED_BT_SUCCESS)
+        {
+            return result;
+        }
+    }
+    if (!initialized)
+    {
+        wiced_init_timer(&push_timer, advertising_payload_timeout, 0U, WICED_MILLI_SECONDS_TIMER);
+        initialized = true;
+    }
+    return advertising_payload_push();
+}
+
+/**
+ * \brief Sets, replaces or removes AD field and schedules push to controller if payload changed.
+ *
+ * \param[in] type AD type of field.
+ * \param[in] data Field data (\c NULL to remove field).
+ * \param[in] data_len Number of bytes in \c data.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, WICED_BT_NO_RESOURCES if payload would exceed ADVERTISING_PAYLOAD_MAX_LEN
+ *         or ADVERTISING_PAYLOAD_MAX_FIELDS.
+ */
+wiced_result_t advertising_payload_set(wiced_bt_ble_advert_type_t type, const uint8_t *data, uint8_t data_len)
+{
+    return advertising_payload_update(type, NULL, 0U, data, data_len, true);
+}
+
+/**
+ * \brief Sets manufacturer specific data field (company ID followed by \c data).
+ *
+ * \param[in] company_id Bluetooth SIG company identifier.
+ * \param[in] data Manufacturer specific data.
+ * \param[in] data_len Number of bytes in \c data.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_result_t advertising_payload_set_manufacturer_data(uint16_t company_id, const uint8_t *data, uint8_t data_len)
+{
+    const uint8_t prefix[] = {(uint8_t) company_id, (uint8_t) (company_id >> 8U)};
+    return advertising_payload_update(BTM_BLE_ADVERT_TYPE_MANUFACTURER, prefix, sizeof(prefix), data, data_len, true);
+}
@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file advertising-payload.h
+ * \brief Structured model of the BLE advertising payload updated in place while advertising continues.
+ * \details The payload is kept as list of AD fields (flags, name, appearance, manufacturer / service data, ...). Changed fields are
+ *          pushed to the controller via *LE Set Advertising Data* without stopping advertising, at most once per
+ *          ADVERTISING_PAYLOAD_MIN_INTERVAL_MS. Updates in between are coalesced into a single push.
+ * \details Pushes are performed from BLE stack context (WICED timer), fields may be updated from any task.
+ */
+#ifndef ADVERTISING_PAYLOAD_H
+#define ADVERTISING_PAYLOAD_H
+
+#include <stdint.h>
+
+#include "wiced_bt_ble.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Maximum number of AD fields in payload.
+ */
+#ifndef ADVERTISING_PAYLOAD_MAX_FIELDS
+#define ADVERTISING_PAYLOAD_MAX_FIELDS 8U
+#endif
+
+/**
+ * \brief Minimum time between two pushes of the payload to the controller in milliseconds.
+ */
+#ifndef ADVERTISING_PAYLOAD_MIN_INTERVAL_MS
+#define ADVERTISING_PAYLOAD_MIN_INTERVAL_MS 1000U
+#endif
+
+/**
+ * \brief Maximum length of legacy advertising payload (each field adds 1B length and 1B type to its data).
+ */
+#define ADVERTISING_PAYLOAD_MAX_LEN 31U
+
+/**
+ * \brief Loads fields not set yet from generated advertising data and pushes payload to controller.
+ *
+ * \details Must be called from BLE stack context once the stack is enabled (BTM_ENABLED_EVT).
+ *
+ * \param[in] elements Generated advertising data (e.g. \c cy_bt_adv_packet_data).
+ * \param[in] elements_len Number of entries in \c elements.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_result_t advertising_payload_initialize(const wiced_bt_ble_advert_elem_t *elements, uint8_t elements_len);
+
+/**
+ * \brief Sets, replaces or removes AD field and schedules push to controller if payload changed.
+ *
+ * \param[in] type AD type of field.
+ * \param[in] data Field data (\c NULL to remove field).
+ * \param[in] data_len Number of bytes in \c data.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, WICED_BT_NO_RESOURCES if payload would exceed ADVERTISING_PAYLOAD_MAX_LEN
+ *         or ADVERTISING_PAYLOAD_MAX_FIELDS.
+ */
+wiced_result_t advertising_payload_set(wiced_bt_ble_advert_type_t type, const uint8_t *data, uint8_t data_len);
+
+/**
+ * \brief Sets manufacturer specific data field (company ID followed by \c data).
+ *
+ * \param[in] company_id Bluetooth SIG company identifier.
+ * \param[in] data Manufacturer specific data.
+ * \param[in] data_len Number of bytes in \c data.
+ * \return wiced_result_t WICED_BT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_result_t advertising_payload_set_manufacturer_data(uint16_t company_id, const uint8_t *data, uint8_t data_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVERTISING_PAYLOAD_H
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file crc16.h
+ * \brief Table driven CRC-16/X.25 used to protect provisioning manifests.
+ */
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Calculates CRC-16/X.25 (reflected polynomial 0x1021, initial value and final XOR 0xFFFF).
+ *
+ * \param[in] data Data to calculate CRC for.
+ * \param[in] length Number of bytes in \c data.
+ * \return uint16_t CRC of \c data.
+ */
+uint16_t crc16_x25(const uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRC16_H
@@ -14,6 +14,8 @@
 #include "infineon/ifx-logger.h"
 
 #include "data-storage.h"
+#include "metrics.h"
+#include "profiled-mutex.h"
 
 /**
  * \brief String used as source information for logging.
@@ -36,6 +38,26 @@ static mtb_kvstore_bd_t block_device;
  */
 mtb_kvstore_t data_storage;
 
+/**
+ * \brief Lock guarding data_storage shared between BLE stack and application tasks.
+ */
+static struct profiled_mutex data_storage_lock;
+
+/**
+ * \brief Duration of data_storage_set() including garbage collection in microseconds.
+ */
+static struct metric write_latency = METRICS_HISTOGRAM("kv.write_us");
+
+/**
+ * \brief Number of failed writes to data_storage.
+ */
+static struct metric write_errors = METRICS_COUNTER("kv.write_errors");
+
+/**
+ * \brief Number of flash rows erased (i.e. garbage collection activity of data_storage).
+ */
+static struct metric erases = METRICS_COUNTER("kv.erases");
+
 /**
  * \brief mtb_kvstore_bd_read_size implementation for block_device.
  */
@@ -147,6 +169,7 @@ static cy_rslt_t data_storage_erase(void *context, uint32_t addr, uint32_t lengt
         {
             return result;
         }
+        metrics_increment(&erases, 1U);
     }
     return result;
 }
@@ -172,6 +195,12 @@ cy_rslt_t data_storage_initialize()
         return CY_RSLT_TYPE_ERROR;
     }
 
+    if (!profiled_mutex_initialize(&data_storage_lock, "storage"))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "Could not create persistent storage lock");
+        return CY_RSLT_TYPE_ERROR;
+    }
+
     // KV store for easier access to data
     block_device.read = data_storage_read;
     block_device.program = data_storage_program;
@@ -192,3 +221,52 @@ cy_rslt_t data_storage_initialize()
 
     return CY_RSLT_SUCCESS;
 }
+
+/**
+ * \brief Reads value from data_storage guarded by profiled lock.
+ * \param[in] key Key of value.
+ * \param[out] data Buffer for value (\c NULL to only query size).
+ * \param[in,out] size Size of \c data, set to actual size of value.
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t data_storage_get(const char *key, uint8_t *data, uint32_t *size)
+{
+    profiled_mutex_take(&data_storage_lock, portMAX_DELAY);
+    cy_rslt_t result = mtb_kvstore_read(&data_storage, key, data, size);
+    profiled_mutex_give(&data_storage_lock);
+    return result;
+}
+
+/**
+ * \brief Writes value to data_storage guarded by profiled lock.
+ * \param[in] key Key of value.
+ * \param[in] data Value to be written.
+ * \param[in] size Number of bytes in \c data.
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t data_storage_set(const char *key, const uint8_t *data, uint32_t size)
+{
+    profiled_mutex_take(&data_storage_lock, portMAX_DELAY);
+    uint32_t start = metrics_timestamp();
+    cy_rslt_t result = mtb_kvstore_write(&data_storage, key, data, size);
+    metrics_observe_since(&write_latency, start);
+    profiled_mutex_give(&data_storage_lock);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        metrics_increment(&write_errors, 1U);
+    }
+    return result;
+}
+
+/**
+ * \brief Removes value from data_storage guarded by profiled lock.
+ * \param[in] key Key of value.
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t data_storage_remove(const char *key)
+{
+    profiled_mutex_take(&data_storage_lock, portMAX_DELAY);
+    cy_rslt_t result = mtb_kvstore_delete(&data_storage, key);
+    profiled_mutex_give(&data_storage_lock);
+    return result;
+}
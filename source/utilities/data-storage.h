@@ -9,6 +9,8 @@
 #ifndef DATA_STORAGE_H
 #define DATA_STORAGE_H
 
+#include <stdint.h>
+
 #include "cyhal.h"
 #include "mtb_kvstore.h"
 
@@ -28,6 +30,31 @@ extern mtb_kvstore_t data_storage;
  */
 cy_rslt_t data_storage_initialize();
 
+/**
+ * \brief Reads value from data_storage guarded by profiled lock.
+ * \param[in] key Key of value.
+ * \param[out] data Buffer for value (\c NULL to only query size).
+ * \param[in,out] size Size of \c data, set to actual size of value.
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t data_storage_get(const char *key, uint8_t *data, uint32_t *size);
+
+/**
+ * \brief Writes value to data_storage guarded by profiled lock.
+ * \param[in] key Key of value.
+ * \param[in] data Value to be written.
+ * \param[in] size Number of bytes in \c data.
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t data_storage_set(const char *key, const uint8_t *data, uint32_t size);
+
+/**
+ * \brief Removes value from data_storage guarded by profiled lock.
+ * \param[in] key Key of value.
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t data_storage_remove(const char *key);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,191 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file gatt-provider.c
+ * \brief GATT attributes whose values are produced by callbacks when a central reads them.
+ * \details Attributes are defined statically (GATT_PROVIDER_ATTRIBUTE()) and registered via gatt_provider_register().
+ * \details Produced values are cached for the attribute's time-to-live, long reads (GATT_REQ_READ_BLOB) are always served from the value
+ *          produced for the preceding read at offset 0 so that centrals receive a consistent value.
+ * \details Not thread-safe apart from gatt_provider_invalidate(), only to be used from BLE stack callbacks.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wiced_bt_gatt.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "gatt-provider.h"
+
+/**
+ * \brief List of all registered attributes.
+ */
+static struct gatt_provider_attribute *attributes = NULL;
+
+/**
+ * \brief Registers attribute (no-op if already registered).
+ *
+ * \param[in,out] attribute Attribute to be registered (must stay valid).
+ */
+void gatt_provider_register(struct gatt_provider_attribute *attribute)
+{
+    if ((attribute != NULL) && !attribute->registered)
+    {
+        attribute->valid = false;
+        attribute->registered = true;
+        attribute->next = attributes;
+        attributes = attribute;
+    }
+}
+
+/**
+ * \brief Looks up registered attribute by handle.
+ *
+ * \param[in] handle Handle of attribute value.
+ * \return struct gatt_provider_attribute * Registered attribute or \c NULL if handle is served from the static GATT database.
+ */
+struct gatt_provider_attribute *gatt_provider_find(uint16_t handle)
+{
+    for (struct gatt_provider_attribute *attribute = attributes; attribute != NULL; attribute = attribute->next)
+    {
+        if (attribute->handle == handle)
+        {
+            return attribute;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Forces value to be produced again on next read (e.g. because underlying data changed).
+ *
+ * \details May be called from any task.
+ *
+ * \param[in,out] attribute Attribute to be invalidated.
+ */
+void gatt_provider_invalidate(struct gatt_provider_attribute *attribute)
+{
+    if (attribute != NULL)
+    {
+        attribute->valid = false;
+    }
+}
+
+/**
+ * \brief Returns attribute value for a read at \c offset, producing it if required.
+ *
+ * \param[in,out] attribute Attribute to be read.
+ * \param[in] offset Offset of read (0 for new reads).
+ * \param[out] value_len Buffer for number of bytes in returned value.
+ * \return const uint8_t * Complete attribute value or \c NULL if attribute is not readable.
+ */
+const uint8_t *gatt_provider_value(struct gatt_provider_attribute *attribute, uint16_t offset, uint16_t *value_len)
+{
+    if ((attribute == NULL) || (attribute->read == NULL) || (value_len == NULL))
+    {
+        return NULL;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    bool produce = !attribute->valid;
+    if (!produce && (offset == 0U))
+    {
+        // Long reads continue on the value produced for their first part even if it expired meanwhile
+        produce = (attribute->ttl_ms == 0U) || ((now - attribute->produced) >= pdMS_TO_TICKS(attribute->ttl_ms));
+    }
+    if (produce)
+    {
+        // Marked valid before producing so that an invalidation from another task during production is not lost
+        attribute->valid = true;
+        uint16_t len = attribute->read(attribute->value, attribute->value_size, attribute->context);
+        attribute->value_len = (len > attribute->value_size) ? attribute->value_size : len;
+        attribute->produced = now;
+        attribute->delivery_notified = false;
+    }
+    *value_len = attribute->value_len;
+    return attribute->value;
+}
+
+/**
+ * \brief Reports that part of the current value has been sent to the central.
+ *
+ * \details Notifies gatt_provider_attribute.delivered once the part reaches the end of the value.
+ *
+ * \param[in,out] attribute Attribute read.
+ * \param[in] offset Offset of sent part.
+ * \param[in] len Number of bytes sent.
+ */
+void gatt_provider_sent(struct gatt_provider_attribute *attribute, uint16_t offset, uint16_t len)
+{
+    if ((attribute == NULL) || !attribute->valid || attribute->delivery_notified || ((offset + len) < attribute->value_len))
+    {
+        return;
+    }
+    attribute->delivery_notified = true;
+    if (attribute->delivered != NULL)
+    {
+        attribute->delivered(attribute->context);
+    }
+}
+
+/**
+ * \brief Responds to GATT_REQ_READ or GATT_REQ_READ_BLOB of attribute.
+ *
+ * \param[in,out] attribute Attribute to be read.
+ * \param[in] request GATT read request.
+ * \returns WICED_BT_GATT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_bt_gatt_status_t gatt_provider_read(struct gatt_provider_attribute *attribute, wiced_bt_gatt_attribute_request_t *request)
+{
+    uint16_t offset = (request->opcode == GATT_REQ_READ_BLOB) ? request->data.read_req.offset : 0U;
+    uint16_t value_len = 0U;
+    const uint8_t *value = gatt_provider_value(attribute, offset, &value_len);
+    if (value == NULL)
+    {
+        wiced_bt_gatt_server_send_error_rsp(request->conn_id, request->opcode, attribute->handle, WICED_BT_GATT_READ_NOT_PERMIT);
+        return WICED_BT_GATT_READ_NOT_PERMIT;
+    }
+    if (offset > value_len)
+    {
+        wiced_bt_gatt_server_send_error_rsp(request->conn_id, request->opcode, attribute->handle, WICED_BT_GATT_INVALID_OFFSET);
+        return WICED_BT_GATT_INVALID_OFFSET;
+    }
+
+    uint16_t len = value_len - offset;
+    if (len > request->len_requested)
+    {
+        len = request->len_requested;
+    }
+    wiced_bt_gatt_status_t status = wiced_bt_gatt_server_send_read_handle_rsp(request->conn_id, request->opcode, len, (uint8_t *) value + offset, NULL);
+    if (status == WICED_BT_GATT_SUCCESS)
+    {
+        gatt_provider_sent(attribute, offset, len);
+    }
+    return status;
+}
+
+/**
+ * \brief Responds to GATT_REQ_WRITE or GATT_CMD_WRITE of attribute.
+ *
+ * \param[in,out] attribute Attribute to be written.
+ * \param[in] request GATT write request.
+ * \returns WICED_BT_GATT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_bt_gatt_status_t gatt_provider_write(struct gatt_provider_attribute *attribute, wiced_bt_gatt_attribute_request_t *request)
+{
+    wiced_bt_gatt_status_t status = WICED_BT_GATT_WRITE_NOT_PERMIT;
+    if (attribute->write != NULL)
+    {
+        status = attribute->write(request->data.write_req.p_val, request->data.write_req.val_len, attribute->context);
+        attribute->valid = false;
+    }
+    if (status != WICED_BT_GATT_SUCCESS)
+    {
+        wiced_bt_gatt_server_send_error_rsp(request->conn_id, request->opcode, attribute->handle, status);
+        return status;
+    }
+    return wiced_bt_gatt_server_send_write_rsp(request->conn_id, request->opcode, attribute->handle);
+}
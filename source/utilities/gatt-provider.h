@@ -0,0 +1,206 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file gatt-provider.h
+ * \brief GATT attributes whose values are produced by callbacks when a central reads them.
+ * \details Attributes are defined statically (GATT_PROVIDER_ATTRIBUTE()) and registered via gatt_provider_register().
+ * \details Produced values are cached for the attribute's time-to-live, long reads (GATT_REQ_READ_BLOB) are always served from the value
+ *          produced for the preceding read at offset 0 so that centrals receive a consistent value.
+ * \details Not thread-safe apart from gatt_provider_invalidate(), only to be used from BLE stack callbacks.
+ */
+#ifndef GATT_PROVIDER_H
+#define GATT_PROVIDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wiced_bt_gatt.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Produces current attribute value.
+ *
+ * \param[out] buffer Buffer for value.
+ * \param[in] buffer_len Size of \c buffer.
+ * \param[in] context Context registered with attribute.
+ * \return uint16_t Number of bytes written to \c buffer.
+ */
+typedef uint16_t (*gatt_provider_read_callback_t)(uint8_t *buffer, uint16_t buffer_len, void *context);
+
+/**
+ * \brief Consumes value written by central.
+ *
+ * \param[in] data Written value.
+ * \param[in] data_len Number of bytes in \c data.
+ * \param[in] context Context registered with attribute.
+ * \returns WICED_BT_GATT_SUCCESS if successful, any other value to be reported to central.
+ */
+typedef wiced_bt_gatt_status_t (*gatt_provider_write_callback_t)(const uint8_t *data, uint16_t data_len, void *context);
+
+/**
+ * \brief Notified once a produced value has been sent to the central completely.
+ *
+ * \param[in] context Context registered with attribute.
+ */
+typedef void (*gatt_provider_delivered_callback_t)(void *context);
+
+/** \struct gatt_provider_attribute
+ * \brief Attribute with callback-backed value.
+ */
+struct gatt_provider_attribute
+{
+    /**
+     * \brief Handle of attribute value in GATT database.
+     */
+    uint16_t handle;
+
+    /**
+     * \brief Callback producing value (\c NULL if not readable).
+     */
+    gatt_provider_read_callback_t read;
+
+    /**
+     * \brief Callback consuming written values (\c NULL if not writable).
+     */
+    gatt_provider_write_callback_t write;
+
+    /**
+     * \brief Callback notified once a produced value has been read completely (\c NULL if not required).
+     */
+    gatt_provider_delivered_callback_t delivered;
+
+    /**
+     * \brief Context passed to callbacks.
+     */
+    void *context;
+
+    /**
+     * \brief Time in milliseconds a produced value is reused for reads at offset 0 (0 to produce value for every read).
+     */
+    uint32_t ttl_ms;
+
+    /**
+     * \brief Buffer caching produced value.
+     */
+    uint8_t *value;
+
+    /**
+     * \brief Size of gatt_provider_attribute.value.
+     */
+    uint16_t value_size;
+
+    /**
+     * \brief Number of bytes in gatt_provider_attribute.value.
+     */
+    uint16_t value_len;
+
+    /**
+     * \brief Simple flag if gatt_provider_attribute.value holds a produced value.
+     */
+    volatile bool valid;
+
+    /**
+     * \brief FreeRTOS tick count when value was produced.
+     */
+    TickType_t produced;
+
+    /**
+     * \brief Simple flag if gatt_provider_attribute.delivered has been notified for current value.
+     */
+    bool delivery_notified;
+
+    /**
+     * \brief Simple flag if attribute has already been registered.
+     */
+    bool registered;
+
+    /**
+     * \brief Next attribute in list of all registered attributes.
+     */
+    struct gatt_provider_attribute *next;
+};
+
+/**
+ * \brief Static initializer for an attribute caching its value in \c buffer (array).
+ */
+#define GATT_PROVIDER_ATTRIBUTE(attribute_handle, read_callback, write_callback, delivered_callback, callback_context, buffer, time_to_live_ms) \
+    {                                                                                                                                      \
+        .handle = (attribute_handle), .read = (read_callback), .write = (write_callback), .delivered = (delivered_callback),              \
+        .context = (callback_context), .ttl_ms = (time_to_live_ms), .value = (buffer), .value_size = sizeof(buffer)                        \
+    }
+
+/**
+ * \brief Registers attribute (no-op if already registered).
+ *
+ * \param[in,out] attribute Attribute to be registered (must stay valid).
+ */
+void gatt_provider_register(struct gatt_provider_attribute *attribute);
+
+/**
+ * \brief Looks up registered attribute by handle.
+ *
+ * \param[in] handle Handle of attribute value.
+ * \return struct gatt_provider_attribute * Registered attribute or \c NULL if handle is served from the static GATT database.
+ */
+struct gatt_provider_attribute *gatt_provider_find(uint16_t handle);
+
+/**
+ * \brief Forces value to be produced again on next read (e.g. because underlying data changed).
+ *
+ * \details May be called from any task.
+ *
+ * \param[in,out] attribute Attribute to be invalidated.
+ */
+void gatt_provider_invalidate(struct gatt_provider_attribute *attribute);
+
+/**
+ * \brief Returns attribute value for a read at \c offset, producing it if required.
+ *
+ * \param[in,out] attribute Attribute to be read.
+ * \param[in] offset Offset of read (0 for new reads).
+ * \param[out] value_len Buffer for number of bytes in returned value.
+ * \return const uint8_t * Complete attribute value or \c NULL if attribute is not readable.
+ */
+const uint8_t *gatt_provider_value(struct gatt_provider_attribute *attribute, uint16_t offset, uint16_t *value_len);
+
+/**
+ * \brief Reports that part of the current value has been sent to the central.
+ *
+ * \details Notifies gatt_provider_attribute.delivered once the part reaches the end of the value.
+ *
+ * \param[in,out] attribute Attribute read.
+ * \param[in] offset Offset of sent part.
+ * \param[in] len Number of bytes sent.
+ */
+void gatt_provider_sent(struct gatt_provider_attribute *attribute, uint16_t offset, uint16_t len);
+
+/**
+ * \brief Responds to GATT_REQ_READ or GATT_REQ_READ_BLOB of attribute.
+ *
+ * \param[in,out] attribute Attribute to be read.
+ * \param[in] request GATT read request.
+ * \returns WICED_BT_GATT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_bt_gatt_status_t gatt_provider_read(struct gatt_provider_attribute *attribute, wiced_bt_gatt_attribute_request_t *request);
+
+/**
+ * \brief Responds to GATT_REQ_WRITE or GATT_CMD_WRITE of attribute.
+ *
+ * \param[in,out] attribute Attribute to be written.
+ * \param[in] request GATT write request.
+ * \returns WICED_BT_GATT_SUCCESS if successful, any other value in case of error.
+ */
+wiced_bt_gatt_status_t gatt_provider_write(struct gatt_provider_attribute *attribute, wiced_bt_gatt_attribute_request_t *request);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GATT_PROVIDER_H
@@ -0,0 +1,498 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file hci-snoop.c
+ * \brief Capture of HCI traffic between host stack and controller into a RAM ring exported in btsnoop format.
+ * \details Packets reported by the BLE stack's HCI trace hook are stored with timestamps in HCI_SNOOP_RECORDS fixed-size slots,
+ *          payloads are truncated to HCI_SNOOP_MAX_PAYLOAD bytes. When the ring is full, the oldest packets are overwritten.
+ * \details Key material passed to the controller (long term keys, encryption keys) and distributed via SMP (long term keys, identity
+ *          resolving keys, signature keys) is zeroed before packets are stored.
+ * \details The capture is streamed in btsnoop format (datalink H4, openable by Wireshark) via hci_snoop_read() or dumped to the
+ *          debug log as hex dump (convert via `xxd -r` after stripping the log prefix) via hci_snoop_report().
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cyhal.h"
+#include "wiced_bt_dev.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "infineon/ifx-logger.h"
+
+#include "hci-snoop.h"
+#include "metrics.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "HCI snoop"
+
+/**
+ * \brief Length of btsnoop file header.
+ */
+#define HCI_SNOOP_FILE_HEADER_LEN 16U
+
+/**
+ * \brief Length of btsnoop packet record header.
+ */
+#define HCI_SNOOP_RECORD_HEADER_LEN 24U
+
+/**
+ * \brief btsnoop datalink type of HCI UART (H4) packets (prefixed with packet indicator).
+ */
+#define HCI_SNOOP_DATALINK_H4 1002U
+
+/**
+ * \brief Offset of btsnoop timestamps (microseconds since midnight January 1st, 0 AD) to 1970 epoch.
+ * \details Capture only knows time since boot, so packets are shown relative to January 1st, 1970.
+ */
+#define HCI_SNOOP_EPOCH_OFFSET_US 0x00DCDDB30F2F8000ULL
+
+/**
+ * \brief Idle time after which timestamps are derived from tick count because the cycle counter may have wrapped.
+ */
+#define HCI_SNOOP_CYCLE_WRAP_GUARD_MS 10000U
+
+/**
+ * \brief Number of stream bytes per hex dump line.
+ */
+#define HCI_SNOOP_DUMP_LINE_LEN 16U
+
+/**
+ * \brief Length of HCI command header (opcode, parameter length).
+ */
+#define HCI_SNOOP_COMMAND_HEADER_LEN 3U
+
+/**
+ * \brief Opcode of HCI_LE_Encrypt command (parameters: key, plaintext).
+ */
+#define HCI_SNOOP_OPCODE_LE_ENCRYPT 0x2017U
+
+/**
+ * \brief Opcode of HCI_LE_Enable_Encryption command (parameters: connection handle, random, EDIV, long term key).
+ */
+#define HCI_SNOOP_OPCODE_LE_ENABLE_ENCRYPTION 0x2019U
+
+/**
+ * \brief Opcode of HCI_LE_Long_Term_Key_Request_Reply command (parameters: connection handle, long term key).
+ */
+#define HCI_SNOOP_OPCODE_LE_LTK_REQUEST_REPLY 0x201AU
+
+/**
+ * \brief Length of connection handle parameter kept when redacting commands.
+ */
+#define HCI_SNOOP_CONNECTION_HANDLE_LEN 2U
+
+/**
+ * \brief Length of HCI ACL data header (connection handle and flags, data length) and L2CAP basic header (length, channel ID).
+ */
+#define HCI_SNOOP_ACL_L2CAP_HEADER_LEN 8U
+
+/**
+ * \brief Mask of packet boundary flags in first 2 bytes of HCI ACL data header.
+ */
+#define HCI_SNOOP_ACL_PACKET_BOUNDARY_MASK 0x3000U
+
+/**
+ * \brief Packet boundary flags of continuation fragment (no L2CAP header).
+ */
+#define HCI_SNOOP_ACL_CONTINUATION 0x1000U
+
+/**
+ * \brief L2CAP channel ID of LE Security Manager Protocol.
+ */
+#define HCI_SNOOP_L2CAP_CID_SMP 0x0006U
+
+/**
+ * \brief SMP Encryption Information code (parameter: long term key).
+ */
+#define HCI_SNOOP_SMP_ENCRYPTION_INFORMATION 0x06U
+
+/**
+ * \brief SMP Identity Information code (parameter: identity resolving key).
+ */
+#define HCI_SNOOP_SMP_IDENTITY_INFORMATION 0x08U
+
+/**
+ * \brief SMP Signing Information code (parameter: connection signature resolving key).
+ */
+#define HCI_SNOOP_SMP_SIGNING_INFORMATION 0x0AU
+
+/** \struct hci_snoop_record
+ * \brief Single captured packet.
+ */
+struct hci_snoop_record
+{
+    /**
+     * \brief Time since boot in microseconds.
+     */
+    uint64_t timestamp_us;
+
+    /**
+     * \brief Original length of packet.
+     */
+    uint16_t orig_len;
+
+    /**
+     * \brief Number of bytes kept in hci_snoop_record.data.
+     */
+    uint8_t incl_len;
+
+    /**
+     * \brief Kind of packet (wiced_bt_hci_trace_type_t).
+     */
+    uint8_t type;
+
+    /**
+     * \brief Truncated packet.
+     */
+    uint8_t data[HCI_SNOOP_MAX_PAYLOAD];
+};
+
+/**
+ * \brief Ring of captured packets (slot of packet is its sequence number modulo HCI_SNOOP_RECORDS).
+ */
+static struct hci_snoop_record records[HCI_SNOOP_RECORDS];
+
+/**
+ * \brief Sequence number of next captured packet (number of packets captured so far).
+ */
+static uint32_t next_sequence = 0U;
+
+/**
+ * \brief Time of last captured packet since boot in microseconds.
+ */
+static uint64_t clock_us = 0U;
+
+/**
+ * \brief CPU cycle count (metrics_timestamp()) corresponding to clock_us.
+ */
+static uint32_t clock_cycles = 0U;
+
+/**
+ * \brief FreeRTOS tick count of last captured packet.
+ */
+static TickType_t clock_ticks = 0U;
+
+/**
+ * \brief Simple flag if hci_snoop_report() shall dump capture.
+ */
+static volatile bool dump_requested = false;
+
+/**
+ * \brief Number of packets captured.
+ */
+static struct metric captured = METRICS_COUNTER("hci.packets");
+
+/**
+ * \brief Writes 32 bit value in big endian byte order.
+ * \param[out] buffer Buffer for value (at least 4 bytes).
+ * \param[in] value Value to be written.
+ */
+static void hci_snoop_put_u32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t) (value >> 24U);
+    buffer[1] = (uint8_t) (value >> 16U);
+    buffer[2] = (uint8_t) (value >> 8U);
+    buffer[3] = (uint8_t) value;
+}
+
+#if HCI_SNOOP_ENABLED
+/**
+ * \brief Determines number of leading bytes of HCI command without key material.
+ * \param[in] record Captured HCI command.
+ * \return size_t Number of bytes not to be zeroed.
+ */
+static size_t hci_snoop_command_keep(const struct hci_snoop_record *record)
+{
+    if (record->incl_len < 2U)
+    {
+        return record->incl_len;
+    }
+    uint16_t opcode = (uint16_t) (record->data[0] | (record->data[1] << 8U));
+    size_t keep = record->incl_len;
+    switch (opcode)
+    {
+    case HCI_SNOOP_OPCODE_LE_ENCRYPT:
+        keep = HCI_SNOOP_COMMAND_HEADER_LEN;
+        break;
+    case HCI_SNOOP_OPCODE_LE_ENABLE_ENCRYPTION:
+    case HCI_SNOOP_OPCODE_LE_LTK_REQUEST_REPLY:
+        keep = HCI_SNOOP_COMMAND_HEADER_LEN + HCI_SNOOP_CONNECTION_HANDLE_LEN;
+        break;
+    default:
+        break;
+    }
+    return keep;
+}
+
+/**
+ * \brief Determines number of leading bytes of HCI ACL data packet without key material.
+ * \details SMP key distribution PDUs are plaintext at HCI level, only their code is kept. They fit into the minimum LE ACL buffer, so
+ *          continuation fragments do not carry keys.
+ * \param[in] record Captured HCI ACL data packet.
+ * \return size_t Number of bytes not to be zeroed.
+ */
+static size_t hci_snoop_acl_keep(const struct hci_snoop_record *record)
+{
+    if (record->incl_len <= HCI_SNOOP_ACL_L2CAP_HEADER_LEN)
+    {
+        return record->incl_len;
+    }
+    uint16_t handle = (uint16_t) (record->data[0] | (record->data[1] << 8U));
+    uint16_t cid = (uint16_t) (record->data[6] | (record->data[7] << 8U));
+    if (((handle & HCI_SNOOP_ACL_PACKET_BOUNDARY_MASK) == HCI_SNOOP_ACL_CONTINUATION) || (cid != HCI_SNOOP_L2CAP_CID_SMP))
+    {
+        return record->incl_len;
+    }
+    switch (record->data[HCI_SNOOP_ACL_L2CAP_HEADER_LEN])
+    {
+    case HCI_SNOOP_SMP_ENCRYPTION_INFORMATION:
+    case HCI_SNOOP_SMP_IDENTITY_INFORMATION:
+    case HCI_SNOOP_SMP_SIGNING_INFORMATION:
+        return HCI_SNOOP_ACL_L2CAP_HEADER_LEN + 1U;
+    default:
+        return record->incl_len;
+    }
+}
+
+/**
+ * \brief Zeroes key material of HCI commands and SMP key distribution PDUs in captured packet.
+ * \param[in,out] record Captured packet.
+ */
+static void hci_snoop_redact(struct hci_snoop_record *record)
+{
+    size_t keep = record->incl_len;
+    switch ((wiced_bt_hci_trace_type_t) record->type)
+    {
+    case HCI_TRACE_COMMAND:
+        keep = hci_snoop_command_keep(record);
+        break;
+    case HCI_TRACE_INCOMING_ACL_DATA:
+    case HCI_TRACE_OUTGOING_ACL_DATA:
+        keep = hci_snoop_acl_keep(record);
+        break;
+    default:
+        break;
+    }
+    if (keep < record->incl_len)
+    {
+        memset(record->data + keep, 0x00U, record->incl_len - keep);
+    }
+}
+
+/**
+ * \brief Advances capture clock to now.
+ * \details Must be called from within a critical section.
+ * \return uint64_t Current time since boot in microseconds.
+ */
+static uint64_t hci_snoop_now(void)
+{
+    uint32_t cycles = metrics_timestamp();
+    TickType_t ticks = xTaskGetTickCount();
+    uint32_t elapsed_ms = (uint32_t) (ticks - clock_ticks) * portTICK_PERIOD_MS;
+    if (elapsed_ms < HCI_SNOOP_CYCLE_WRAP_GUARD_MS)
+    {
+        // Keep sub-microsecond remainder for next packet
+        uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+        uint32_t elapsed_us = (cycles - clock_cycles) / cycles_per_us;
+        clock_us += elapsed_us;
+        clock_cycles += elapsed_us * cycles_per_us;
+    }
+    else
+    {
+        clock_us += (uint64_t) elapsed_ms * 1000U;
+        clock_cycles = cycles;
+    }
+    clock_ticks = ticks;
+    return clock_us;
+}
+
+/**
+ * \brief Records packet reported by BLE stack.
+ * \param[in] type Kind of packet.
+ * \param[in] length Number of bytes in \c data.
+ * \param[in] data Packet (without H4 packet indicator).
+ */
+static void hci_snoop_tap(wiced_bt_hci_trace_type_t type, uint16_t length, uint8_t *data)
+{
+    uint8_t incl_len = (uint8_t) ((length > HCI_SNOOP_MAX_PAYLOAD) ? HCI_SNOOP_MAX_PAYLOAD : length);
+    taskENTER_CRITICAL();
+    struct hci_snoop_record *record = &records[next_sequence % HCI_SNOOP_RECORDS];
+    record->timestamp_us = hci_snoop_now();
+    record->orig_len = length;
+    record->incl_len = incl_len;
+    record->type = (uint8_t) type;
+    memcpy(record->data, data, incl_len);
+    hci_snoop_redact(record);
+    next_sequence++;
+    taskEXIT_CRITICAL();
+    metrics_increment(&captured, 1U);
+}
+#endif
+
+/**
+ * \brief Encodes packet record in btsnoop format.
+ * \param[out] buffer Buffer for record (at least HCI_SNOOP_RECORD_HEADER_LEN + 1 + HCI_SNOOP_MAX_PAYLOAD bytes).
+ * \param[in] record Packet to be encoded.
+ * \param[in] drops Number of packets dropped so far.
+ * \return size_t Number of bytes written to \c buffer.
+ */
+static size_t hci_snoop_encode(uint8_t *buffer, const struct hci_snoop_record *record, uint32_t drops)
+{
+    // H4 packet indicator and btsnoop flags (bit 0: received, bit 1: command / event)
+    uint8_t indicator = 0x02U;
+    uint32_t flags = 0U;
+    switch ((wiced_bt_hci_trace_type_t) record->type)
+    {
+    case HCI_TRACE_COMMAND:
+        indicator = 0x01U;
+        flags = 0x02U;
+        break;
+    case HCI_TRACE_EVENT:
+        indicator = 0x04U;
+        flags = 0x03U;
+        break;
+    case HCI_TRACE_INCOMING_ACL_DATA:
+        flags = 0x01U;
+        break;
+    default:
+        break;
+    }
+
+    uint64_t timestamp = record->timestamp_us + HCI_SNOOP_EPOCH_OFFSET_US;
+    hci_snoop_put_u32(buffer, (uint32_t) record->orig_len + 1U);
+    hci_snoop_put_u32(buffer + 4U, (uint32_t) record->incl_len + 1U);
+    hci_snoop_put_u32(buffer + 8U, flags);
+    hci_snoop_put_u32(buffer + 12U, drops);
+    hci_snoop_put_u32(buffer + 16U, (uint32_t) (timestamp >> 32U));
+    hci_snoop_put_u32(buffer + 20U, (uint32_t) timestamp);
+    buffer[HCI_SNOOP_RECORD_HEADER_LEN] = indicator;
+    memcpy(buffer + HCI_SNOOP_RECORD_HEADER_LEN + 1U, record->data, record->incl_len);
+    return HCI_SNOOP_RECORD_HEADER_LEN + 1U + record->incl_len;
+}
+
+/**
+ * \brief Registers capture with BLE stack's HCI trace hook.
+ *
+ * \details Must be called once the BLE stack is enabled (BTM_ENABLED_EVT).
+ */
+void hci_snoop_initialize(void)
+{
+#if HCI_SNOOP_ENABLED
+    taskENTER_CRITICAL();
+    clock_cycles = metrics_timestamp();
+    clock_ticks = xTaskGetTickCount();
+    clock_us = (uint64_t) clock_ticks * portTICK_PERIOD_MS * 1000U;
+    taskEXIT_CRITICAL();
+    wiced_bt_dev_register_hci_trace(hci_snoop_tap);
+#endif
+}
+
+/**
+ * \brief Continues btsnoop stream of capture.
+ *
+ * \details Only complete packet records are returned, so \c buffer must hold at least 25 + HCI_SNOOP_MAX_PAYLOAD bytes.
+ *
+ * \param[in,out] cursor Position in stream.
+ * \param[out] buffer Buffer for stream data.
+ * \param[in] buffer_len Size of \c buffer.
+ * \return size_t Number of bytes written to \c buffer (0 if all captured packets have been read).
+ */
+size_t hci_snoop_read(struct hci_snoop_cursor *cursor, uint8_t *buffer, size_t buffer_len)
+{
+    if ((cursor == NULL) || (buffer == NULL))
+    {
+        return 0U;
+    }
+
+    size_t len = 0U;
+    if (!cursor->header_sent)
+    {
+        if (buffer_len < HCI_SNOOP_FILE_HEADER_LEN)
+        {
+            return 0U;
+        }
+        memcpy(buffer, "btsnoop", 8U);
+        hci_snoop_put_u32(buffer + 8U, 1U);
+        hci_snoop_put_u32(buffer + 12U, HCI_SNOOP_DATALINK_H4);
+        len = HCI_SNOOP_FILE_HEADER_LEN;
+        cursor->header_sent = true;
+    }
+
+    while ((buffer_len - len) >= (HCI_SNOOP_RECORD_HEADER_LEN + 1U + HCI_SNOOP_MAX_PAYLOAD))
+    {
+        // Consistent copy of next packet, skipping packets overwritten meanwhile
+        struct hci_snoop_record record;
+        taskENTER_CRITICAL();
+        uint32_t available = next_sequence;
+        uint32_t oldest = (available > HCI_SNOOP_RECORDS) ? (available - HCI_SNOOP_RECORDS) : 0U;
+        if (cursor->next < oldest)
+        {
+            cursor->drops += oldest - cursor->next;
+            cursor->next = oldest;
+        }
+        if (cursor->next < available)
+        {
+            memcpy(&record, &records[cursor->next % HCI_SNOOP_RECORDS], sizeof(record));
+        }
+        taskEXIT_CRITICAL();
+
+        if (cursor->next >= available)
+        {
+            break;
+        }
+        len += hci_snoop_encode(buffer + len, &record, cursor->drops);
+        cursor->next++;
+    }
+    return len;
+}
+
+/**
+ * \brief Requests capture to be dumped to the debug log by next hci_snoop_report().
+ */
+void hci_snoop_request_dump(void)
+{
+    dump_requested = true;
+}
+
+/**
+ * \brief Dumps capture to the debug log as hex dump if requested via hci_snoop_request_dump().
+ *
+ * \details To be called periodically from a low priority task, dumping blocks until all data has been printed.
+ */
+void hci_snoop_report(void)
+{
+    if (!dump_requested)
+    {
+        return;
+    }
+    dump_requested = false;
+
+    static uint8_t chunk[HCI_SNOOP_RECORD_HEADER_LEN + 1U + HCI_SNOOP_MAX_PAYLOAD];
+    static char line[sizeof("00000000:") + (HCI_SNOOP_DUMP_LINE_LEN * sizeof(" 00"))];
+    struct hci_snoop_cursor cursor = {0};
+    uint32_t offset = 0U;
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "HCI snoop dump begin (convert via xxd -r)");
+    size_t chunk_len;
+    while ((chunk_len = hci_snoop_read(&cursor, chunk, sizeof(chunk))) > 0U)
+    {
+        for (size_t i = 0U; i < chunk_len; i += HCI_SNOOP_DUMP_LINE_LEN)
+        {
+            int line_len = snprintf(line, sizeof(line), "%08lx:", (unsigned long) offset);
+            for (size_t j = i; (j < chunk_len) && (j < (i + HCI_SNOOP_DUMP_LINE_LEN)); j++)
+            {
+                line_len += snprintf(line + line_len, sizeof(line) - (size_t) line_len, " %02x", chunk[j]);
+                offset++;
+            }
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "%s", line);
+        }
+    }
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "HCI snoop dump end (%lu packets dropped)", (unsigned long) cursor.drops);
+}
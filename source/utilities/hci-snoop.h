@@ -0,0 +1,104 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file hci-snoop.h
+ * \brief Capture of HCI traffic between host stack and controller into a RAM ring exported in btsnoop format.
+ * \details Packets reported by the BLE stack's HCI trace hook are stored with timestamps in HCI_SNOOP_RECORDS fixed-size slots,
+ *          payloads are truncated to HCI_SNOOP_MAX_PAYLOAD bytes. When the ring is full, the oldest packets are overwritten.
+ * \details Key material passed to the controller (long term keys, encryption keys) and distributed via SMP (long term keys, identity
+ *          resolving keys, signature keys) is zeroed before packets are stored.
+ * \details The capture is streamed in btsnoop format (datalink H4, openable by Wireshark) via hci_snoop_read() or dumped to the
+ *          debug log as hex dump (convert via `xxd -r` after stripping the log prefix) via hci_snoop_report().
+ */
+#ifndef HCI_SNOOP_H
+#define HCI_SNOOP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Simple flag if HCI traffic is captured.
+ * \details Key material is redacted and the capture is only served via authenticated links, so it can stay enabled in field builds.
+ */
+#ifndef HCI_SNOOP_ENABLED
+#define HCI_SNOOP_ENABLED 1
+#endif
+
+/**
+ * \brief Number of packets kept in ring.
+ */
+#ifndef HCI_SNOOP_RECORDS
+#define HCI_SNOOP_RECORDS 64U
+#endif
+
+/**
+ * \brief Maximum number of payload bytes kept per packet (longer packets are truncated).
+ */
+#ifndef HCI_SNOOP_MAX_PAYLOAD
+#define HCI_SNOOP_MAX_PAYLOAD 32U
+#endif
+
+/** \struct hci_snoop_cursor
+ * \brief Position of a reader in the btsnoop stream.
+ * \details Zero-initialized cursor starts with btsnoop file header and oldest available packet.
+ */
+struct hci_snoop_cursor
+{
+    /**
+     * \brief Simple flag if btsnoop file header has already been read.
+     */
+    bool header_sent;
+
+    /**
+     * \brief Sequence number of next packet to be read.
+     */
+    uint32_t next;
+
+    /**
+     * \brief Number of packets overwritten before they could be read.
+     */
+    uint32_t drops;
+};
+
+/**
+ * \brief Registers capture with BLE stack's HCI trace hook.
+ *
+ * \details Must be called once the BLE stack is enabled (BTM_ENABLED_EVT).
+ */
+void hci_snoop_initialize(void);
+
+/**
+ * \brief Continues btsnoop stream of capture.
+ *
+ * \details Only complete packet records are returned, so \c buffer must hold at least 25 + HCI_SNOOP_MAX_PAYLOAD bytes.
+ *
+ * \param[in,out] cursor Position in stream.
+ * \param[out] buffer Buffer for stream data.
+ * \param[in] buffer_len Size of \c buffer.
+ * \return size_t Number of bytes written to \c buffer (0 if all captured packets have been read).
+ */
+size_t hci_snoop_read(struct hci_snoop_cursor *cursor, uint8_t *buffer, size_t buffer_len);
+
+/**
+ * \brief Requests capture to be dumped to the debug log by next hci_snoop_report().
+ */
+void hci_snoop_request_dump(void);
+
+/**
+ * \brief Dumps capture to the debug log as hex dump if requested via hci_snoop_request_dump().
+ *
+ * \details To be called periodically from a low priority task, dumping blocks until all data has been printed.
+ */
+void hci_snoop_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_SNOOP_H
@@ -0,0 +1,473 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file heap-guard.c
+ * \brief Static arenas for steady-state allocations and guard against general heap allocations after start-up.
+ * \details Arenas hand out fixed-size blocks from statically allocated storage in constant time (three size classes, see
+ *          HEAP_GUARD_SMALL_SIZE, HEAP_GUARD_MEDIUM_SIZE, HEAP_GUARD_LARGE_SIZE), so long-running devices do not fragment the heap.
+ * \details With HEAP_GUARD_WRAP_MALLOC (linker option `--wrap` for malloc, free, calloc, realloc and pvPortMalloc, see *Makefile*), all
+ *          allocations (including those of the NBT library, FreeRTOS heap_3 and the BLE stack) are served from the arenas if they fit.
+ *          Allocations falling back to the general heap after heap_guard_boot_complete() are recorded with their call site and logged by
+ *          heap_guard_report(). With HEAP_GUARD_ASSERT, they trigger an assertion instead.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cyhal.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "infineon/ifx-logger.h"
+
+#include "heap-guard.h"
+#include "metrics.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT example"
+
+#ifdef HEAP_GUARD_WRAP_MALLOC
+void *__real_malloc(size_t size);
+void __real_free(void *block);
+void *__real_realloc(void *block, size_t size);
+extern void vApplicationMallocFailedHook(void);
+
+/**
+ * \brief General heap allocation bypassing the guard.
+ */
+#define HEAP_GUARD_HEAP_MALLOC __real_malloc
+
+/**
+ * \brief General heap deallocation bypassing the guard.
+ */
+#define HEAP_GUARD_HEAP_FREE __real_free
+#else
+#define HEAP_GUARD_HEAP_MALLOC malloc
+#define HEAP_GUARD_HEAP_FREE   free
+#endif
+
+/** \struct heap_guard_arena
+ * \brief Pool of fixed-size blocks.
+ */
+struct heap_guard_arena
+{
+    /**
+     * \brief Size of each block in bytes.
+     */
+    size_t block_size;
+
+    /**
+     * \brief Number of blocks in heap_guard_arena.storage.
+     */
+    size_t blocks;
+
+    /**
+     * \brief Storage of all blocks.
+     */
+    uint8_t *storage;
+
+    /**
+     * \brief Number of blocks handed out at least once (blocks above have never been used).
+     */
+    size_t touched;
+
+    /**
+     * \brief List of returned blocks (first bytes of each free block link to next free block).
+     */
+    void *free_list;
+
+    /**
+     * \brief Number of blocks currently in use.
+     */
+    size_t used;
+
+    /**
+     * \brief Maximum number of blocks in use at the same time.
+     */
+    size_t peak;
+};
+
+/** \struct heap_guard_call_site
+ * \brief Call site allocating from the general heap after start-up.
+ */
+struct heap_guard_call_site
+{
+    /**
+     * \brief Return address of allocation (resolve via addr2line).
+     */
+    void *site;
+
+    /**
+     * \brief Number of allocations from call site.
+     */
+    uint32_t count;
+
+    /**
+     * \brief Size of last allocation from call site.
+     */
+    size_t last_size;
+};
+
+/**
+ * \brief Storage of small arena.
+ */
+static uint8_t small_storage[HEAP_GUARD_SMALL_BLOCKS * HEAP_GUARD_SMALL_SIZE] __attribute__((aligned(8)));
+
+/**
+ * \brief Storage of medium arena.
+ */
+static uint8_t medium_storage[HEAP_GUARD_MEDIUM_BLOCKS * HEAP_GUARD_MEDIUM_SIZE] __attribute__((aligned(8)));
+
+/**
+ * \brief Storage of large arena.
+ */
+static uint8_t large_storage[HEAP_GUARD_LARGE_BLOCKS * HEAP_GUARD_LARGE_SIZE] __attribute__((aligned(8)));
+
+/**
+ * \brief All arenas ordered by block size.
+ */
+static struct heap_guard_arena arenas[] = {
+    {.block_size = HEAP_GUARD_SMALL_SIZE, .blocks = HEAP_GUARD_SMALL_BLOCKS, .storage = small_storage},
+    {.block_size = HEAP_GUARD_MEDIUM_SIZE, .blocks = HEAP_GUARD_MEDIUM_BLOCKS, .storage = medium_storage},
+    {.block_size = HEAP_GUARD_LARGE_SIZE, .blocks = HEAP_GUARD_LARGE_BLOCKS, .storage = large_storage}};
+
+/**
+ * \brief Number of entries in arenas.
+ */
+#define HEAP_GUARD_ARENAS (sizeof(arenas) / sizeof(arenas[0]))
+
+/**
+ * \brief Simple flag if start-up is complete.
+ */
+static volatile bool boot_complete = false;
+
+/**
+ * \brief Call sites of general heap allocations after start-up.
+ */
+static struct heap_guard_call_site call_sites[HEAP_GUARD_CALL_SITES];
+
+/**
+ * \brief Number of general heap allocations after start-up.
+ */
+static struct metric steady_allocations = METRICS_COUNTER("heap.steady_allocs");
+
+/**
+ * \brief Enters critical section once the FreeRTOS scheduler has been started.
+ *
+ * \details Before that, allocations run in a single context and a critical section would leave interrupts masked until the scheduler
+ *          starts.
+ *
+ * \return bool \c true if critical section has been entered (to be passed to heap_guard_unlock()).
+ */
+static bool heap_guard_lock(void)
+{
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+    {
+        return false;
+    }
+    taskENTER_CRITICAL();
+    return true;
+}
+
+/**
+ * \brief Leaves critical section entered by heap_guard_lock().
+ * \param[in] locked Return value of heap_guard_lock().
+ */
+static void heap_guard_unlock(bool locked)
+{
+    if (locked)
+    {
+        taskEXIT_CRITICAL();
+    }
+}
+
+/**
+ * \brief Returns arena owning block.
+ * \param[in] block Block to look up.
+ * \return struct heap_guard_arena * Owning arena or \c NULL if block is not part of any arena.
+ */
+static struct heap_guard_arena *heap_guard_owner(const void *block)
+{
+    const uint8_t *address = (const uint8_t *) block;
+    for (size_t i = 0U; i < HEAP_GUARD_ARENAS; i++)
+    {
+        if ((address >= arenas[i].storage) && (address < (arenas[i].storage + (arenas[i].blocks * arenas[i].block_size))))
+        {
+            return &arenas[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Allocates block from smallest fitting arena with a free block.
+ * \param[in] size Number of bytes required.
+ * \return void * Block of at least \c size bytes or \c NULL if no arena block is available.
+ */
+static void *heap_guard_arena_alloc(size_t size)
+{
+    void *block = NULL;
+    bool locked = heap_guard_lock();
+    for (size_t i = 0U; (block == NULL) && (i < HEAP_GUARD_ARENAS); i++)
+    {
+        struct heap_guard_arena *arena = &arenas[i];
+        if (size > arena->block_size)
+        {
+            continue;
+        }
+        if (arena->free_list != NULL)
+        {
+            block = arena->free_list;
+            arena->free_list = *((void **) block);
+        }
+        else if (arena->touched < arena->blocks)
+        {
+            block = arena->storage + (arena->touched++ * arena->block_size);
+        }
+        else
+        {
+            continue;
+        }
+        if (++arena->used > arena->peak)
+        {
+            arena->peak = arena->used;
+        }
+    }
+    heap_guard_unlock(locked);
+    return block;
+}
+
+/**
+ * \brief Records general heap allocation if start-up is complete.
+ * \param[in] size Number of bytes allocated.
+ * \param[in] site Return address of allocating function.
+ */
+static void heap_guard_record(size_t size, void *site)
+{
+    if (!boot_complete)
+    {
+        return;
+    }
+    bool locked = heap_guard_lock();
+    struct heap_guard_call_site *entry = NULL;
+    for (size_t i = 0U; i < HEAP_GUARD_CALL_SITES; i++)
+    {
+        if ((call_sites[i].site == site) || (call_sites[i].site == NULL))
+        {
+            entry = &call_sites[i];
+            break;
+        }
+    }
+    if (entry != NULL)
+    {
+        entry->site = site;
+        entry->count++;
+        entry->last_size = size;
+    }
+    heap_guard_unlock(locked);
+    metrics_increment(&steady_allocations, 1U);
+#if HEAP_GUARD_ASSERT
+    CY_ASSERT(0);
+#endif
+}
+
+/**
+ * \brief Allocates from general heap, recording call site after start-up.
+ * \param[in] size Number of bytes required.
+ * \param[in] site Return address of allocating function.
+ * \return void * Allocated block or \c NULL if out of memory.
+ */
+static void *heap_guard_heap_alloc(size_t size, void *site)
+{
+    heap_guard_record(size, site);
+    return HEAP_GUARD_HEAP_MALLOC(size);
+}
+
+/**
+ * \brief Allocates block from smallest fitting arena, falling back to the general heap.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in] size Number of bytes required.
+ * \return void * Block of at least \c size bytes or \c NULL if out of memory.
+ */
+void *heap_guard_malloc(size_t size)
+{
+    void *block = heap_guard_arena_alloc(size);
+    return (block != NULL) ? block : heap_guard_heap_alloc(size, __builtin_return_address(0));
+}
+
+/**
+ * \brief Returns block to its arena or the general heap.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in] block Block from heap_guard_malloc() (\c NULL is ignored).
+ */
+void heap_guard_free(void *block)
+{
+    if (block == NULL)
+    {
+        return;
+    }
+    struct heap_guard_arena *arena = heap_guard_owner(block);
+    if (arena == NULL)
+    {
+        HEAP_GUARD_HEAP_FREE(block);
+        return;
+    }
+    bool locked = heap_guard_lock();
+    *((void **) block) = arena->free_list;
+    arena->free_list = block;
+    arena->used--;
+    heap_guard_unlock(locked);
+}
+
+/**
+ * \brief Marks start-up as complete, all following general heap allocations are steady-state allocations.
+ */
+void heap_guard_boot_complete(void)
+{
+    boot_complete = true;
+}
+
+/**
+ * \brief Logs call sites of general heap allocations after start-up and arena usage.
+ */
+void heap_guard_report(void)
+{
+    for (size_t i = 0U; i < HEAP_GUARD_ARENAS; i++)
+    {
+        taskENTER_CRITICAL();
+        struct heap_guard_arena arena = arenas[i];
+        taskEXIT_CRITICAL();
+        // clang-format off
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "Arena of %u byte blocks: %u of %u in use, peak %u", (unsigned int) arena.block_size, (unsigned int) arena.used, (unsigned int) arena.blocks, (unsigned int) arena.peak);
+        // clang-format on
+    }
+    for (size_t i = 0U; i < HEAP_GUARD_CALL_SITES; i++)
+    {
+        taskENTER_CRITICAL();
+        struct heap_guard_call_site entry = call_sites[i];
+        taskEXIT_CRITICAL();
+        if (entry.site == NULL)
+        {
+            break;
+        }
+        // clang-format off
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Heap allocation after start-up from 0x%08lX: %lu time(s), last %u bytes", (unsigned long) (uintptr_t) entry.site, (unsigned long) entry.count, (unsigned int) entry.last_size);
+        // clang-format on
+    }
+}
+
+#ifdef HEAP_GUARD_WRAP_MALLOC
+/**
+ * \brief Replaces malloc() via linker option `--wrap=malloc`.
+ * \param[in] size Number of bytes required.
+ * \return void * Allocated block or \c NULL if out of memory.
+ */
+void *__wrap_malloc(size_t size)
+{
+    void *block = heap_guard_arena_alloc(size);
+    return (block != NULL) ? block : heap_guard_heap_alloc(size, __builtin_return_address(0));
+}
+
+/**
+ * \brief Replaces FreeRTOS heap_3 pvPortMalloc() via linker option `--wrap=pvPortMalloc`.
+ *
+ * \details heap_3 allocates via malloc(), which would record pvPortMalloc() itself as call site of every FreeRTOS allocation. The call
+ *          site is therefore recorded here and the general heap is used directly, as heap_3 does.
+ *
+ * \param[in] size Number of bytes required.
+ * \return void * Allocated block or \c NULL if out of memory.
+ */
+void *__wrap_pvPortMalloc(size_t size)
+{
+    void *block = heap_guard_arena_alloc(size);
+    if (block != NULL)
+    {
+        return block;
+    }
+    heap_guard_record(size, __builtin_return_address(0));
+    vTaskSuspendAll();
+    block = HEAP_GUARD_HEAP_MALLOC(size);
+    (void) xTaskResumeAll();
+#if configUSE_MALLOC_FAILED_HOOK == 1
+    if (block == NULL)
+    {
+        vApplicationMallocFailedHook();
+    }
+#endif
+    return block;
+}
+
+/**
+ * \brief Replaces free() via linker option `--wrap=free`.
+ * \param[in] block Block to be freed (\c NULL is ignored).
+ */
+void __wrap_free(void *block)
+{
+    heap_guard_free(block);
+}
+
+/**
+ * \brief Replaces calloc() via linker option `--wrap=calloc`.
+ * \param[in] count Number of elements.
+ * \param[in] size Size of each element.
+ * \return void * Zeroed block or \c NULL if out of memory.
+ */
+void *__wrap_calloc(size_t count, size_t size)
+{
+    if ((size != 0U) && (count > (SIZE_MAX / size)))
+    {
+        return NULL;
+    }
+    void *block = heap_guard_arena_alloc(count * size);
+    if (block == NULL)
+    {
+        block = heap_guard_heap_alloc(count * size, __builtin_return_address(0));
+    }
+    if (block != NULL)
+    {
+        memset(block, 0x00, count * size);
+    }
+    return block;
+}
+
+/**
+ * \brief Replaces realloc() via linker option `--wrap=realloc`.
+ * \param[in] block Block to be resized (\c NULL to allocate new block).
+ * \param[in] size New number of bytes required.
+ * \return void * Resized block or \c NULL if out of memory (original block stays valid).
+ */
+void *__wrap_realloc(void *block, size_t size)
+{
+    struct heap_guard_arena *arena = heap_guard_owner(block);
+    if ((block != NULL) && (arena == NULL))
+    {
+        heap_guard_record(size, __builtin_return_address(0));
+        return __real_realloc(block, size);
+    }
+    if ((arena != NULL) && (size <= arena->block_size))
+    {
+        return block;
+    }
+    void *resized = heap_guard_arena_alloc(size);
+    if (resized == NULL)
+    {
+        resized = heap_guard_heap_alloc(size, __builtin_return_address(0));
+    }
+    if ((resized != NULL) && (block != NULL))
+    {
+        memcpy(resized, block, arena->block_size);
+        heap_guard_free(block);
+    }
+    return resized;
+}
+#endif
@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file heap-guard.h
+ * \brief Static arenas for steady-state allocations and guard against general heap allocations after start-up.
+ * \details Arenas hand out fixed-size blocks from statically allocated storage in constant time (three size classes, see
+ *          HEAP_GUARD_SMALL_SIZE, HEAP_GUARD_MEDIUM_SIZE, HEAP_GUARD_LARGE_SIZE), so long-running devices do not fragment the heap.
+ * \details With HEAP_GUARD_WRAP_MALLOC (linker option `--wrap` for malloc, free, calloc, realloc and pvPortMalloc, see *Makefile*), all
+ *          allocations (including those of the NBT library, FreeRTOS heap_3 and the BLE stack) are served from the arenas if they fit.
+ *          Allocations falling back to the general heap after heap_guard_boot_complete() are recorded with their call site and logged by
+ *          heap_guard_report(). With HEAP_GUARD_ASSERT, they trigger an assertion instead.
+ */
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Block size of small arena in bytes.
+ */
+#ifndef HEAP_GUARD_SMALL_SIZE
+#define HEAP_GUARD_SMALL_SIZE 32U
+#endif
+
+/**
+ * \brief Number of blocks in small arena.
+ */
+#ifndef HEAP_GUARD_SMALL_BLOCKS
+#define HEAP_GUARD_SMALL_BLOCKS 32U
+#endif
+
+/**
+ * \brief Block size of medium arena in bytes.
+ */
+#ifndef HEAP_GUARD_MEDIUM_SIZE
+#define HEAP_GUARD_MEDIUM_SIZE 128U
+#endif
+
+/**
+ * \brief Number of blocks in medium arena.
+ */
+#ifndef HEAP_GUARD_MEDIUM_BLOCKS
+#define HEAP_GUARD_MEDIUM_BLOCKS 16U
+#endif
+
+/**
+ * \brief Block size of large arena in bytes (fits complete T=1' frames and APDUs with 255 bytes of data).
+ */
+#ifndef HEAP_GUARD_LARGE_SIZE
+#define HEAP_GUARD_LARGE_SIZE 288U
+#endif
+
+/**
+ * \brief Number of blocks in large arena.
+ */
+#ifndef HEAP_GUARD_LARGE_BLOCKS
+#define HEAP_GUARD_LARGE_BLOCKS 8U
+#endif
+
+/**
+ * \brief Number of distinct call sites recorded for general heap allocations after start-up.
+ */
+#ifndef HEAP_GUARD_CALL_SITES
+#define HEAP_GUARD_CALL_SITES 8U
+#endif
+
+/**
+ * \brief Simple flag if general heap allocations after start-up trigger an assertion (opt-in, e.g. to locate a reported call site).
+ */
+#ifndef HEAP_GUARD_ASSERT
+#define HEAP_GUARD_ASSERT 0
+#endif
+
+/**
+ * \brief Allocates block from smallest fitting arena, falling back to the general heap.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in] size Number of bytes required.
+ * \return void * Block of at least \c size bytes or \c NULL if out of memory.
+ */
+void *heap_guard_malloc(size_t size);
+
+/**
+ * \brief Returns block to its arena or the general heap.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in] block Block from heap_guard_malloc() (\c NULL is ignored).
+ */
+void heap_guard_free(void *block);
+
+/**
+ * \brief Marks start-up as complete, all following general heap allocations are steady-state allocations.
+ */
+void heap_guard_boot_complete(void);
+
+/**
+ * \brief Logs call sites of general heap allocations after start-up and arena usage.
+ */
+void heap_guard_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEAP_GUARD_H
@@ -0,0 +1,324 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file key-cache.c
+ * \brief RAM-resident cache of BLE security keys backed by persistent storage.
+ * \details Local identity keys and link keys of bonded devices are read from data storage once (key_cache_load()) so that key requests
+ *          of the BLE stack are answered from RAM without flash access. Local identity keys are written through immediately. Link keys
+ *          reported during pairing (also re-pairing of a bonded device) are only staged and bonded and persisted once pairing completed
+ *          successfully (key_cache_commit_bond()).
+ * \details Link keys are persisted under "bonding" as array of KEY_CACHE_LINK_KEYS entries (for one entry identical to the previous
+ *          single bond layout), local identity keys under "identity_keys".
+ * \details Not thread-safe, only to be used from BLE stack context (apart from key_cache_load() before starting the BLE stack).
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cyhal.h"
+#include "wiced_bt_dev.h"
+
+#include "data-storage.h"
+#include "key-cache.h"
+
+/**
+ * \brief Data storage key of link keys.
+ */
+#define KEY_CACHE_LINK_KEYS_KEY "bonding"
+
+/**
+ * \brief Data storage key of local identity keys.
+ */
+#define KEY_CACHE_IDENTITY_KEYS_KEY "identity_keys"
+
+/** \struct key_cache_entry
+ * \brief Link keys of a single device (persisted layout).
+ */
+struct key_cache_entry
+{
+    /**
+     * \brief Device link keys.
+     */
+    wiced_bt_device_link_keys_t device_link_keys;
+
+    /**
+     * \brief Simple flag if device is bonded.
+     */
+    bool bonded;
+};
+
+/**
+ * \brief Link keys of bonded devices.
+ */
+static struct key_cache_entry entries[KEY_CACHE_LINK_KEYS];
+
+/**
+ * \brief Simple flag per entry if it holds link keys of a bonded device.
+ */
+static bool entries_used[KEY_CACHE_LINK_KEYS];
+
+/**
+ * \brief Link keys of device currently pairing, moved to entries by key_cache_commit_bond().
+ */
+static wiced_bt_device_link_keys_t pending;
+
+/**
+ * \brief Simple flag if pending holds link keys.
+ */
+static bool pending_used = false;
+
+/**
+ * \brief Order in which entries were bonded (higher is newer).
+ */
+static uint32_t entries_age[KEY_CACHE_LINK_KEYS];
+
+/**
+ * \brief Age assigned to next bonded entry.
+ */
+static uint32_t next_age = 0U;
+
+/**
+ * \brief Local identity keys.
+ */
+static wiced_bt_local_identity_keys_t identity_keys;
+
+/**
+ * \brief Simple flag if identity_keys is valid.
+ */
+static bool identity_keys_valid = false;
+
+/**
+ * \brief Returns entry of bonded device.
+ * \param[in] address Address of device.
+ * \return struct key_cache_entry * Entry holding link keys of device or \c NULL if not bonded.
+ */
+static struct key_cache_entry *key_cache_find(const wiced_bt_device_address_t address)
+{
+    for (size_t i = 0U; i < KEY_CACHE_LINK_KEYS; i++)
+    {
+        if (entries_used[i] && (memcmp(entries[i].device_link_keys.bd_addr, address, sizeof(wiced_bt_device_address_t)) == 0))
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Writes link keys of all bonded devices to data storage.
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+static cy_rslt_t key_cache_persist(void)
+{
+    static struct key_cache_entry persisted[KEY_CACHE_LINK_KEYS];
+    memset(persisted, 0x00, sizeof(persisted));
+    for (size_t i = 0U; i < KEY_CACHE_LINK_KEYS; i++)
+    {
+        if (entries_used[i])
+        {
+            persisted[i] = entries[i];
+        }
+    }
+    return data_storage_set(KEY_CACHE_LINK_KEYS_KEY, (uint8_t *) persisted, sizeof(persisted));
+}
+
+/**
+ * \brief Loads all keys from data storage.
+ *
+ * \details Must be called once data storage is initialized and before the BLE stack is started.
+ *
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful (also if no keys are stored yet), any other value in case of error.
+ */
+cy_rslt_t key_cache_load(void)
+{
+    memset(entries, 0x00, sizeof(entries));
+    memset(entries_used, 0x00, sizeof(entries_used));
+    pending_used = false;
+    uint32_t read_size = sizeof(entries);
+    if (data_storage_get(KEY_CACHE_LINK_KEYS_KEY, (uint8_t *) entries, &read_size) == CY_RSLT_SUCCESS)
+    {
+        for (size_t i = 0U; i < (read_size / sizeof(struct key_cache_entry)); i++)
+        {
+            entries_used[i] = entries[i].bonded;
+            entries_age[i] = next_age++;
+        }
+    }
+
+    read_size = sizeof(identity_keys);
+    identity_keys_valid = (data_storage_get(KEY_CACHE_IDENTITY_KEYS_KEY, (uint8_t *) &identity_keys, &read_size) == CY_RSLT_SUCCESS) &&
+                          (read_size == sizeof(identity_keys));
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * \brief Copies local identity keys.
+ *
+ * \param[out] keys Buffer for local identity keys.
+ * \return bool \c true if local identity keys are available, \c false otherwise.
+ */
+bool key_cache_get_identity_keys(wiced_bt_local_identity_keys_t *keys)
+{
+    if (!identity_keys_valid || (keys == NULL))
+    {
+        return false;
+    }
+    memcpy(keys, &identity_keys, sizeof(identity_keys));
+    return true;
+}
+
+/**
+ * \brief Updates local identity keys (written through to data storage).
+ *
+ * \param[in] keys New local identity keys.
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_set_identity_keys(const wiced_bt_local_identity_keys_t *keys)
+{
+    memcpy(&identity_keys, keys, sizeof(identity_keys));
+    identity_keys_valid = true;
+    return data_storage_set(KEY_CACHE_IDENTITY_KEYS_KEY, (const uint8_t *) &identity_keys, sizeof(identity_keys));
+}
+
+/**
+ * \brief Copies link keys of bonded device.
+ *
+ * \param[in] address Address of device.
+ * \param[out] keys Buffer for link keys (\c NULL to only check if device is bonded).
+ * \return bool \c true if device is bonded, \c false otherwise.
+ */
+bool key_cache_get_link_keys(const wiced_bt_device_address_t address, wiced_bt_device_link_keys_t *keys)
+{
+    const struct key_cache_entry *entry = key_cache_find(address);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    if (keys != NULL)
+    {
+        memcpy(keys, &entry->device_link_keys, sizeof(wiced_bt_device_link_keys_t));
+    }
+    return true;
+}
+
+/**
+ * \brief Stages link keys of device currently pairing.
+ *
+ * \details Keys are kept in a separate pending slot until key_cache_commit_bond(), bonded entries are left untouched until then.
+ *          A newer pairing replaces keys still pending.
+ *
+ * \param[in] keys New link keys (including device address).
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_update_link_keys(const wiced_bt_device_link_keys_t *keys)
+{
+    if (keys == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    memcpy(&pending, keys, sizeof(wiced_bt_device_link_keys_t));
+    pending_used = true;
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * \brief Completes pairing of device, on success its pending link keys are bonded and persisted.
+ *
+ * \details Successful pairing replaces an existing bond of the device, then uses a free entry and evicts the oldest bond only if the
+ *          cache is full. Failed pairing discards the pending link keys.
+ *
+ * \param[in] address Address of device.
+ * \param[in] success \c true if pairing succeeded.
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_commit_bond(const wiced_bt_device_address_t address, bool success)
+{
+    bool matching = pending_used && (memcmp(pending.bd_addr, address, sizeof(wiced_bt_device_address_t)) == 0);
+    if (!success || !matching)
+    {
+        // Keys of a failed pairing never replace a bond
+        pending_used = pending_used && !matching;
+        return (!success || (key_cache_find(address) != NULL)) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+    }
+
+    // Prefer existing bond of device, then unused entry, then oldest bond
+    struct key_cache_entry *entry = key_cache_find(address);
+    if (entry == NULL)
+    {
+        size_t index = 0U;
+        for (size_t i = 0U; i < KEY_CACHE_LINK_KEYS; i++)
+        {
+            if (!entries_used[i])
+            {
+                index = i;
+                break;
+            }
+            if (entries_age[i] < entries_age[index])
+            {
+                index = i;
+            }
+        }
+        entry = &entries[index];
+    }
+    size_t index = (size_t) (entry - entries);
+    memcpy(&entry->device_link_keys, &pending, sizeof(wiced_bt_device_link_keys_t));
+    entry->bonded = true;
+    entries_used[index] = true;
+    entries_age[index] = next_age++;
+    pending_used = false;
+    return key_cache_persist();
+}
+
+/**
+ * \brief Returns bonded device.
+ *
+ * \param[in] index Index of bonded device (0 to key_cache_bond_count() - 1).
+ * \return const wiced_bt_device_link_keys_t * Link keys of bonded device or \c NULL if index is out of range.
+ */
+const wiced_bt_device_link_keys_t *key_cache_bond(size_t index)
+{
+    for (size_t i = 0U; i < KEY_CACHE_LINK_KEYS; i++)
+    {
+        if (entries_used[i])
+        {
+            if (index == 0U)
+            {
+                return &entries[i].device_link_keys;
+            }
+            index--;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Returns number of bonded devices.
+ *
+ * \return uint8_t Number of bonded devices.
+ */
+uint8_t key_cache_bond_count(void)
+{
+    uint8_t count = 0U;
+    for (size_t i = 0U; i < KEY_CACHE_LINK_KEYS; i++)
+    {
+        if (entries_used[i])
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * \brief Forgets all bonded devices (written through to data storage).
+ *
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_clear_bonds(void)
+{
+    memset(entries, 0x00, sizeof(entries));
+    memset(entries_used, 0x00, sizeof(entries_used));
+    pending_used = false;
+    return key_cache_persist();
+}
@@ -0,0 +1,119 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file key-cache.h
+ * \brief RAM-resident cache of BLE security keys backed by persistent storage.
+ * \details Local identity keys and link keys of bonded devices are read from data storage once (key_cache_load()) so that key requests
+ *          of the BLE stack are answered from RAM without flash access. Local identity keys are written through immediately. Link keys
+ *          reported during pairing (also re-pairing of a bonded device) are only staged and bonded and persisted once pairing completed
+ *          successfully (key_cache_commit_bond()).
+ * \details Link keys are persisted under "bonding" as array of KEY_CACHE_LINK_KEYS entries (for one entry identical to the previous
+ *          single bond layout), local identity keys under "identity_keys".
+ * \details Not thread-safe, only to be used from BLE stack context (apart from key_cache_load() before starting the BLE stack).
+ */
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cyhal.h"
+#include "wiced_bt_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Maximum number of bonded devices.
+ */
+#ifndef KEY_CACHE_LINK_KEYS
+#define KEY_CACHE_LINK_KEYS 1U
+#endif
+
+/**
+ * \brief Loads all keys from data storage.
+ *
+ * \details Must be called once data storage is initialized and before the BLE stack is started.
+ *
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful (also if no keys are stored yet), any other value in case of error.
+ */
+cy_rslt_t key_cache_load(void);
+
+/**
+ * \brief Copies local identity keys.
+ *
+ * \param[out] keys Buffer for local identity keys.
+ * \return bool \c true if local identity keys are available, \c false otherwise.
+ */
+bool key_cache_get_identity_keys(wiced_bt_local_identity_keys_t *keys);
+
+/**
+ * \brief Updates local identity keys (written through to data storage).
+ *
+ * \param[in] keys New local identity keys.
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_set_identity_keys(const wiced_bt_local_identity_keys_t *keys);
+
+/**
+ * \brief Copies link keys of bonded device.
+ *
+ * \param[in] address Address of device.
+ * \param[out] keys Buffer for link keys (\c NULL to only check if device is bonded).
+ * \return bool \c true if device is bonded, \c false otherwise.
+ */
+bool key_cache_get_link_keys(const wiced_bt_device_address_t address, wiced_bt_device_link_keys_t *keys);
+
+/**
+ * \brief Stages link keys of device currently pairing.
+ *
+ * \details Keys are kept in a separate pending slot until key_cache_commit_bond(), bonded entries are left untouched until then.
+ *          A newer pairing replaces keys still pending.
+ *
+ * \param[in] keys New link keys (including device address).
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_update_link_keys(const wiced_bt_device_link_keys_t *keys);
+
+/**
+ * \brief Completes pairing of device, on success its pending link keys are bonded and persisted.
+ *
+ * \details Successful pairing replaces an existing bond of the device, then uses a free entry and evicts the oldest bond only if the
+ *          cache is full. Failed pairing discards the pending link keys.
+ *
+ * \param[in] address Address of device.
+ * \param[in] success \c true if pairing succeeded.
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_commit_bond(const wiced_bt_device_address_t address, bool success);
+
+/**
+ * \brief Returns bonded device.
+ *
+ * \param[in] index Index of bonded device (0 to key_cache_bond_count() - 1).
+ * \return const wiced_bt_device_link_keys_t * Link keys of bonded device or \c NULL if index is out of range.
+ */
+const wiced_bt_device_link_keys_t *key_cache_bond(size_t index);
+
+/**
+ * \brief Returns number of bonded devices.
+ *
+ * \return uint8_t Number of bonded devices.
+ */
+uint8_t key_cache_bond_count(void);
+
+/**
+ * \brief Forgets all bonded devices (written through to data storage).
+ *
+ * \return cy_rslt_t CY_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t key_cache_clear_bonds(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KEY_CACHE_H
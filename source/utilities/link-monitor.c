@@ -0,0 +1,204 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file link-monitor.c
+ * \brief Connection quality monitoring with adaptive transmit power.
+ * \details While a central is connected, the RSSI of the link is sampled every LINK_MONITOR_PERIOD_MS and exported as metrics.
+ * \details The transmit power policy steps down slowly while the (smoothed) RSSI indicates a strong link and jumps back to the
+ *          maximum as soon as a single sample indicates a weak link or RSSI cannot be read, so that the link is not lost at range.
+ * \details Not thread-safe, only to be used from BLE stack context.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "wiced_bt_dev.h"
+#include "wiced_timer.h"
+
+#include "link-monitor.h"
+#include "metrics.h"
+
+/**
+ * \brief Weight of previous smoothed RSSI as power of two (new sample contributes 1 / 2^n).
+ */
+#define LINK_MONITOR_SMOOTHING_SHIFT 2U
+
+/**
+ * \brief Address of monitored central.
+ */
+static wiced_bt_device_address_t peer;
+
+/**
+ * \brief Simple flag if a link is currently monitored.
+ */
+static bool active = false;
+
+/**
+ * \brief Smoothed RSSI in dBm scaled by 2^LINK_MONITOR_SMOOTHING_SHIFT.
+ */
+static int32_t smoothed_rssi = 0;
+
+/**
+ * \brief Simple flag if smoothed_rssi holds at least one sample.
+ */
+static bool smoothed_valid = false;
+
+/**
+ * \brief Transmit power currently requested for link in dBm.
+ */
+static int8_t tx_power = LINK_MONITOR_TX_POWER_MAX_DBM;
+
+/**
+ * \brief WICED timer triggering RSSI samples.
+ */
+static wiced_timer_t sample_timer;
+
+/**
+ * \brief Simple flag if sample_timer has been initialized.
+ */
+static bool timer_initialized = false;
+
+/**
+ * \brief Last RSSI sample in dBm.
+ */
+static struct metric rssi_metric = METRICS_GAUGE("link.rssi_dbm");
+
+/**
+ * \brief Transmit power currently used for link in dBm.
+ */
+static struct metric tx_power_metric = METRICS_GAUGE("link.tx_power_dbm");
+
+/**
+ * \brief Number of changes of transmit power.
+ */
+static struct metric tx_power_changes = METRICS_COUNTER("link.tx_power_changes");
+
+/**
+ * \brief Number of failed RSSI samples.
+ */
+static struct metric sample_failures = METRICS_COUNTER("link.rssi_failures");
+
+/**
+ * \brief Requests transmit power for monitored link.
+ * \param[in] power Transmit power in dBm.
+ */
+static void link_monitor_set_tx_power(int8_t power)
+{
+#if LINK_MONITOR_ADAPTIVE_TX_POWER
+    if ((power == tx_power) || (wiced_bt_set_tx_power(peer, power, NULL) != WICED_BT_SUCCESS))
+    {
+        return;
+    }
+    tx_power = power;
+    metrics_increment(&tx_power_changes, 1U);
+    metrics_set(&tx_power_metric, (uint32_t) (int32_t) tx_power);
+#else
+    (void) power;
+#endif
+}
+
+/**
+ * \brief Applies transmit power policy to new sample.
+ * \param[in] valid Simple flag if RSSI could be read.
+ * \param[in] rssi RSSI sample in dBm.
+ */
+static void link_monitor_apply(bool valid, int8_t rssi)
+{
+    // Weak or unknown link: raise power at once, supervision timeouts must be prevented before they happen
+    if (!valid || (rssi < LINK_MONITOR_WEAK_RSSI_DBM))
+    {
+        smoothed_valid = false;
+        link_monitor_set_tx_power(LINK_MONITOR_TX_POWER_MAX_DBM);
+        return;
+    }
+
+    if (!smoothed_valid)
+    {
+        smoothed_rssi = (int32_t) rssi * (1 << LINK_MONITOR_SMOOTHING_SHIFT);
+        smoothed_valid = true;
+    }
+    else
+    {
+        smoothed_rssi += (int32_t) rssi - (smoothed_rssi / (1 << LINK_MONITOR_SMOOTHING_SHIFT));
+    }
+
+    // Strong link: lower power one step per sample
+    if ((smoothed_rssi / (1 << LINK_MONITOR_SMOOTHING_SHIFT)) > LINK_MONITOR_STRONG_RSSI_DBM)
+    {
+        int32_t power = (int32_t) tx_power - LINK_MONITOR_TX_POWER_STEP_DB;
+        link_monitor_set_tx_power((int8_t) ((power < LINK_MONITOR_TX_POWER_MIN_DBM) ? LINK_MONITOR_TX_POWER_MIN_DBM : power));
+    }
+}
+
+/**
+ * \brief Handles RSSI read result.
+ * \param[in] data wiced_bt_dev_rssi_result_t of sample.
+ */
+static void link_monitor_rssi_complete(void *data)
+{
+    const wiced_bt_dev_rssi_result_t *result = (const wiced_bt_dev_rssi_result_t *) data;
+    if (!active || (result == NULL) || (memcmp(result->rem_bda, peer, sizeof(peer)) != 0))
+    {
+        return;
+    }
+    bool valid = (result->status == WICED_BT_SUCCESS) && (result->hci_status == 0x00U);
+    if (valid)
+    {
+        metrics_set(&rssi_metric, (uint32_t) (int32_t) result->rssi);
+    }
+    else
+    {
+        metrics_increment(&sample_failures, 1U);
+    }
+    link_monitor_apply(valid, result->rssi);
+}
+
+/**
+ * \brief Requests next RSSI sample.
+ * \param[in] param Ignored.
+ */
+static void link_monitor_sample(WICED_TIMER_PARAM_TYPE param)
+{
+    (void) param;
+
+    if (active && (wiced_bt_dev_read_rssi(peer, BT_TRANSPORT_LE, link_monitor_rssi_complete) != WICED_BT_PENDING))
+    {
+        metrics_increment(&sample_failures, 1U);
+        link_monitor_apply(false, 0);
+    }
+}
+
+/**
+ * \brief Starts monitoring link to connected central.
+ *
+ * \param[in] address Address of connected central.
+ */
+void link_monitor_start(const wiced_bt_device_address_t address)
+{
+    if (!timer_initialized)
+    {
+        wiced_init_timer(&sample_timer, link_monitor_sample, 0U, WICED_MILLI_SECONDS_PERIODIC_TIMER);
+        timer_initialized = true;
+    }
+    memcpy(peer, address, sizeof(peer));
+    active = true;
+    smoothed_valid = false;
+
+    // New connections start at configured power
+    tx_power = LINK_MONITOR_TX_POWER_MAX_DBM;
+    metrics_set(&tx_power_metric, (uint32_t) (int32_t) tx_power);
+    wiced_start_timer(&sample_timer, LINK_MONITOR_PERIOD_MS);
+}
+
+/**
+ * \brief Stops monitoring (e.g. on disconnect).
+ */
+void link_monitor_stop(void)
+{
+    active = false;
+    if (timer_initialized)
+    {
+        wiced_stop_timer(&sample_timer);
+    }
+}
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file link-monitor.h
+ * \brief Connection quality monitoring with adaptive transmit power.
+ * \details While a central is connected, the RSSI of the link is sampled every LINK_MONITOR_PERIOD_MS and exported as metrics.
+ * \details The transmit power policy steps down slowly while the (smoothed) RSSI indicates a strong link and jumps back to the
+ *          maximum as soon as a single sample indicates a weak link or RSSI cannot be read, so that the link is not lost at range.
+ * \details Not thread-safe, only to be used from BLE stack context.
+ */
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+#include <stdint.h>
+
+#include "wiced_bt_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Period of RSSI samples in milliseconds.
+ */
+#ifndef LINK_MONITOR_PERIOD_MS
+#define LINK_MONITOR_PERIOD_MS 1000U
+#endif
+
+/**
+ * \brief Simple flag if transmit power is adapted to link quality.
+ */
+#ifndef LINK_MONITOR_ADAPTIVE_TX_POWER
+#define LINK_MONITOR_ADAPTIVE_TX_POWER 1
+#endif
+
+/**
+ * \brief Smoothed RSSI in dBm above which transmit power is lowered.
+ */
+#ifndef LINK_MONITOR_STRONG_RSSI_DBM
+#define LINK_MONITOR_STRONG_RSSI_DBM (-55)
+#endif
+
+/**
+ * \brief RSSI in dBm below which transmit power is raised to LINK_MONITOR_TX_POWER_MAX_DBM immediately.
+ */
+#ifndef LINK_MONITOR_WEAK_RSSI_DBM
+#define LINK_MONITOR_WEAK_RSSI_DBM (-75)
+#endif
+
+/**
+ * \brief Lowest transmit power in dBm used by the policy.
+ */
+#ifndef LINK_MONITOR_TX_POWER_MIN_DBM
+#define LINK_MONITOR_TX_POWER_MIN_DBM (-12)
+#endif
+
+/**
+ * \brief Highest transmit power in dBm used by the policy (configured host TX power level).
+ */
+#ifndef LINK_MONITOR_TX_POWER_MAX_DBM
+#define LINK_MONITOR_TX_POWER_MAX_DBM 0
+#endif
+
+/**
+ * \brief Step in dB by which transmit power is lowered per sample.
+ */
+#ifndef LINK_MONITOR_TX_POWER_STEP_DB
+#define LINK_MONITOR_TX_POWER_STEP_DB 4
+#endif
+
+/**
+ * \brief Starts monitoring link to connected central.
+ *
+ * \param[in] address Address of connected central.
+ */
+void link_monitor_start(const wiced_bt_device_address_t address);
+
+/**
+ * \brief Stops monitoring (e.g. on disconnect).
+ */
+void link_monitor_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LINK_MONITOR_H
@@ -0,0 +1,135 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file log-limiter.c
+ * \brief Per call site rate limiting of log messages.
+ * \details Every LOG_LIMITED() call site owns a token bucket of LOG_LIMITER_BURST messages refilled by one message every
+ *          LOG_LIMITER_REFILL_MS. Messages exceeding the budget are dropped and counted, so that repeating errors cannot flood the logger
+ *          queue under fault conditions.
+ * \details The number of dropped messages is logged once the call site logs again and by log_limiter_report() for call sites that
+ *          went silent.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "infineon/ifx-logger.h"
+
+#include "log-limiter.h"
+#include "metrics.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT example"
+
+/**
+ * \brief Call sites registered on first use.
+ */
+static struct log_limiter_site *sites = NULL;
+
+/**
+ * \brief Total number of dropped messages.
+ */
+static struct metric suppressed_metric = METRICS_COUNTER("log.suppressed");
+
+/**
+ * \brief Logs summary of messages dropped at call site.
+ * \param[in] site Call site.
+ * \param[in] suppressed Number of dropped messages.
+ */
+static void log_limiter_summary(const struct log_limiter_site *site, uint32_t suppressed)
+{
+    // clang-format off
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Suppressed %lu message(s) of %s at %s:%lu", (unsigned long) suppressed, site->tag, site->file, (unsigned long) site->line);
+    // clang-format on
+}
+
+/**
+ * \brief Takes token of call site and logs summary of previously dropped messages.
+ *
+ * \details Use via LOG_LIMITED().
+ *
+ * \param[in,out] site Call site.
+ * \return bool \c true if message may be logged, \c false if it must be dropped.
+ */
+bool log_limiter_admit(struct log_limiter_site *site)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint32_t suppressed = 0U;
+    bool admitted = false;
+
+    taskENTER_CRITICAL();
+    if (!site->registered)
+    {
+        site->refilled = now;
+        site->next = sites;
+        sites = site;
+        site->registered = true;
+    }
+
+    // Refill whole tokens only, partial periods carry over
+    uint32_t refills = (uint32_t) ((now - site->refilled) / pdMS_TO_TICKS(LOG_LIMITER_REFILL_MS));
+    if (refills > 0U)
+    {
+        if ((site->tokens + refills) >= LOG_LIMITER_BURST)
+        {
+            site->tokens = LOG_LIMITER_BURST;
+            site->refilled = now;
+        }
+        else
+        {
+            site->tokens += refills;
+            site->refilled += (TickType_t) (refills * pdMS_TO_TICKS(LOG_LIMITER_REFILL_MS));
+        }
+    }
+
+    if (site->tokens > 0U)
+    {
+        site->tokens--;
+        suppressed = site->suppressed;
+        site->suppressed = 0U;
+        admitted = true;
+    }
+    else
+    {
+        site->suppressed++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (!admitted)
+    {
+        metrics_increment(&suppressed_metric, 1U);
+    }
+    else if (suppressed > 0U)
+    {
+        log_limiter_summary(site, suppressed);
+    }
+    return admitted;
+}
+
+/**
+ * \brief Logs number of messages dropped per call site since last summary.
+ */
+void log_limiter_report(void)
+{
+    taskENTER_CRITICAL();
+    struct log_limiter_site *site = sites;
+    taskEXIT_CRITICAL();
+
+    // Sites are only ever prepended, the list behind the head is stable
+    for (; site != NULL; site = site->next)
+    {
+        taskENTER_CRITICAL();
+        uint32_t suppressed = site->suppressed;
+        site->suppressed = 0U;
+        taskEXIT_CRITICAL();
+        if (suppressed > 0U)
+        {
+            log_limiter_summary(site, suppressed);
+        }
+    }
+}
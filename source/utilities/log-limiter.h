@@ -0,0 +1,124 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file log-limiter.h
+ * \brief Per call site rate limiting of log messages.
+ * \details Every LOG_LIMITED() call site owns a token bucket of LOG_LIMITER_BURST messages refilled by one message every
+ *          LOG_LIMITER_REFILL_MS. Messages exceeding the budget are dropped and counted, so that repeating errors cannot flood the logger
+ *          queue under fault conditions.
+ * \details The number of dropped messages is logged once the call site logs again and by log_limiter_report() for call sites that
+ *          went silent.
+ */
+#ifndef LOG_LIMITER_H
+#define LOG_LIMITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "infineon/ifx-logger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Number of messages a call site may log back-to-back.
+ */
+#ifndef LOG_LIMITER_BURST
+#define LOG_LIMITER_BURST 5U
+#endif
+
+/**
+ * \brief Time in milliseconds after which a call site may log one more message.
+ */
+#ifndef LOG_LIMITER_REFILL_MS
+#define LOG_LIMITER_REFILL_MS 1000U
+#endif
+
+/** \struct log_limiter_site
+ * \brief Token bucket of a single call site.
+ */
+struct log_limiter_site
+{
+    /**
+     * \brief Log tag of call site used for reporting.
+     */
+    const char *tag;
+
+    /**
+     * \brief Source file of call site used for reporting.
+     */
+    const char *file;
+
+    /**
+     * \brief Source line of call site used for reporting.
+     */
+    uint32_t line;
+
+    /**
+     * \brief Messages call site may currently log.
+     */
+    uint32_t tokens;
+
+    /**
+     * \brief Tick count of last refill.
+     */
+    TickType_t refilled;
+
+    /**
+     * \brief Number of messages dropped since last summary.
+     */
+    uint32_t suppressed;
+
+    /**
+     * \brief Simple flag if call site has been registered for reporting.
+     */
+    bool registered;
+
+    /**
+     * \brief Next registered call site.
+     */
+    struct log_limiter_site *next;
+};
+
+/**
+ * \brief Static initializer for a call site.
+ */
+#define LOG_LIMITER_SITE(site_tag) {.tag = (site_tag), .file = __FILE__, .line = __LINE__, .tokens = LOG_LIMITER_BURST}
+
+/**
+ * \brief Logs message via ifx_logger_log() unless call site exceeded its budget.
+ */
+#define LOG_LIMITED(logger, tag, level, ...)                                                                                                \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        static struct log_limiter_site log_limiter_site = LOG_LIMITER_SITE(tag);                                                           \
+        if (log_limiter_admit(&log_limiter_site))                                                                                          \
+        {                                                                                                                                  \
+            ifx_logger_log((logger), (tag), (level), __VA_ARGS__);                                                                         \
+        }                                                                                                                                  \
+    } while (0)
+
+/**
+ * \brief Takes token of call site and logs summary of previously dropped messages.
+ *
+ * \details Use via LOG_LIMITED().
+ *
+ * \param[in,out] site Call site.
+ * \return bool \c true if message may be logged, \c false if it must be dropped.
+ */
+bool log_limiter_admit(struct log_limiter_site *site);
+
+/**
+ * \brief Logs number of messages dropped per call site since last summary.
+ */
+void log_limiter_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_LIMITER_H
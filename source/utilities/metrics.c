@@ -0,0 +1,407 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file metrics.c
+ * \brief Registry of counters, gauges and histograms exported as compact delta encoded snapshots.
+ * \details Metrics are defined statically (METRICS_COUNTER(), METRICS_GAUGE(), METRICS_HISTOGRAM()) and registered on first update.
+ * \details Snapshot format (all numbers unsigned LEB128 varints unless stated otherwise):
+ *     * Header: 1B version (METRICS_SNAPSHOT_VERSION), 1B flags (METRICS_SNAPSHOT_FULL, METRICS_SNAPSHOT_MORE), sequence number, uptime in ms
+ *     * Per metric changed since previous snapshot: 1B metric ID
+ *         * Full snapshots only: 1B type (enum metrics_type), 1B name length, name
+ *         * Counter: increment
+ *         * Gauge: zigzag encoded change
+ *         * Histogram: count increment, sum increment, METRICS_HISTOGRAM_BUCKETS bucket increments
+ * \details Full snapshots contain all metrics with values relative to zero. Full snapshots exceeding the snapshot buffer are split into
+ *          consecutive snapshots, all but the last one flagged METRICS_SNAPSHOT_MORE.
+ * \details Encoded values only become the baseline of the next snapshot once delivery is confirmed via metrics_snapshot_commit().
+ */
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cyhal.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "metrics.h"
+
+/**
+ * \brief Maximum number of tasks inspected for system metrics.
+ */
+#define METRICS_MAX_TASKS 12U
+
+/**
+ * \brief Maximum number of bytes of a single encoded metric (excluding name).
+ */
+#define METRICS_MAX_ENCODED_LEN (3U + ((2U + METRICS_HISTOGRAM_BUCKETS) * 5U))
+
+/**
+ * \brief List of all registered metrics.
+ */
+static struct metric *metrics = NULL;
+
+/**
+ * \brief ID assigned to next registered metric.
+ */
+static uint8_t next_id = 0U;
+
+/**
+ * \brief Sequence number of next snapshot.
+ */
+static uint32_t sequence = 0U;
+
+/**
+ * \brief Number of full snapshot requests (initial snapshot is always full).
+ */
+static uint32_t full_requests = 1U;
+
+/**
+ * \brief Value of full_requests served by the last delivered full snapshot.
+ */
+static uint32_t full_requests_served = 0U;
+
+/**
+ * \brief Metric the next part of a full snapshot split across snapshots starts with (\c NULL if no full snapshot in progress).
+ */
+static struct metric *full_resume = NULL;
+
+/**
+ * \brief Simple flag if a snapshot awaits metrics_snapshot_commit().
+ */
+static bool snapshot_staged = false;
+
+/**
+ * \brief Value of full_requests served by snapshot awaiting metrics_snapshot_commit().
+ */
+static uint32_t staged_requests = 0U;
+
+/**
+ * \brief Metric a full snapshot continues with after snapshot awaiting metrics_snapshot_commit() (\c NULL if complete).
+ */
+static struct metric *staged_resume = NULL;
+
+/**
+ * \brief Bytes of heap currently allocated.
+ */
+static struct metric heap_used = METRICS_GAUGE("heap.used");
+
+/**
+ * \brief Bytes of heap obtained from system.
+ */
+static struct metric heap_arena = METRICS_GAUGE("heap.arena");
+
+/**
+ * \brief Number of FreeRTOS tasks.
+ */
+static struct metric task_count = METRICS_GAUGE("tasks");
+
+/**
+ * \brief Smallest stack headroom of all tasks in bytes.
+ */
+static struct metric stack_min_free = METRICS_GAUGE("stack.min_free");
+
+/**
+ * \brief Returns current CPU cycle count, enabling DWT cycle counter on first use.
+ * \return uint32_t Current CPU cycle count.
+ */
+static uint32_t cycles_now(void)
+{
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0U)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0U;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    return DWT->CYCCNT;
+}
+
+/**
+ * \brief Registers metric on first update.
+ * \details Must be called from within a critical section.
+ * \param[in,out] metric Metric to be registered.
+ */
+static void metrics_register(struct metric *metric)
+{
+    if (!metric->registered)
+    {
+        metric->id = next_id++;
+        metric->registered = true;
+        metric->next = metrics;
+        metrics = metric;
+    }
+}
+
+/**
+ * \brief Encodes unsigned LEB128 varint.
+ * \param[out] buffer Buffer for encoded value (at least 5 bytes).
+ * \param[in] value Value to be encoded.
+ * \return size_t Number of bytes written.
+ */
+static size_t metrics_put_varint(uint8_t *buffer, uint32_t value)
+{
+    size_t len = 0U;
+    while (value >= 0x80U)
+    {
+        buffer[len++] = (uint8_t) (value | 0x80U);
+        value >>= 7U;
+    }
+    buffer[len++] = (uint8_t) value;
+    return len;
+}
+
+/**
+ * \brief Increments counter.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in,out] metric Counter to be incremented.
+ * \param[in] amount Value to be added.
+ */
+void metrics_increment(struct metric *metric, uint32_t amount)
+{
+    taskENTER_CRITICAL();
+    metrics_register(metric);
+    metric->value += amount;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * \brief Sets gauge to current value.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in,out] metric Gauge to be set.
+ * \param[in] value Current value.
+ */
+void metrics_set(struct metric *metric, uint32_t value)
+{
+    taskENTER_CRITICAL();
+    metrics_register(metric);
+    metric->value = value;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * \brief Records observation in histogram.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in,out] metric Histogram to record observation in.
+ * \param[in] value Observed value.
+ */
+void metrics_observe(struct metric *metric, uint32_t value)
+{
+    // Bucket by powers of four: floor(log2(value) / 2)
+    size_t bucket = (value > 0U) ? ((31U - (size_t) __builtin_clz(value)) / 2U) : 0U;
+    if (bucket >= METRICS_HISTOGRAM_BUCKETS)
+    {
+        bucket = METRICS_HISTOGRAM_BUCKETS - 1U;
+    }
+    taskENTER_CRITICAL();
+    metrics_register(metric);
+    metric->value++;
+    metric->sum += value;
+    metric->buckets[bucket]++;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * \brief Returns timestamp for measuring durations via metrics_observe_since().
+ * \return uint32_t Current CPU cycle count.
+ */
+uint32_t metrics_timestamp(void)
+{
+    return cycles_now();
+}
+
+/**
+ * \brief Records time elapsed since timestamp in microseconds in histogram.
+ *
+ * \param[in,out] metric Histogram to record duration in.
+ * \param[in] timestamp Start of measurement from metrics_timestamp().
+ */
+void metrics_observe_since(struct metric *metric, uint32_t timestamp)
+{
+    metrics_observe(metric, (cycles_now() - timestamp) / (SystemCoreClock / 1000000U));
+}
+
+/**
+ * \brief Requests next snapshot to be a full snapshot (e.g. because a client lost track of previous snapshots).
+ */
+void metrics_request_full_snapshot(void)
+{
+    full_requests++;
+}
+
+/**
+ * \brief Samples heap and task metrics.
+ */
+static void metrics_sample_system(void)
+{
+#if defined(__GLIBC__)
+    struct mallinfo2 heap = mallinfo2();
+#else
+    struct mallinfo heap = mallinfo();
+#endif
+    metrics_set(&heap_used, (uint32_t) heap.uordblks);
+    metrics_set(&heap_arena, (uint32_t) heap.arena);
+
+    static TaskStatus_t tasks[METRICS_MAX_TASKS];
+    UBaseType_t tasks_len = uxTaskGetSystemState(tasks, METRICS_MAX_TASKS, NULL);
+    metrics_set(&task_count, (uint32_t) uxTaskGetNumberOfTasks());
+    uint32_t min_free = UINT32_MAX;
+    for (UBaseType_t i = 0U; i < tasks_len; i++)
+    {
+        uint32_t free_bytes = (uint32_t) tasks[i].usStackHighWaterMark * sizeof(StackType_t);
+        if (free_bytes < min_free)
+        {
+            min_free = free_bytes;
+        }
+    }
+    if (tasks_len > 0U)
+    {
+        metrics_set(&stack_min_free, min_free);
+    }
+}
+
+/**
+ * \brief Samples system metrics and encodes all metrics changed since the previous snapshot.
+ *
+ * \details Metrics not fitting into \c buffer are kept for the next snapshot, full snapshots are continued there.
+ * \details Without metrics_snapshot_commit(), the next call encodes the same snapshot (sequence number) again with current values.
+ *
+ * \param[out] buffer Buffer for encoded snapshot.
+ * \param[in] buffer_len Size of \c buffer.
+ * \return size_t Number of bytes written to \c buffer (0 if buffer is too small for header).
+ */
+size_t metrics_snapshot(uint8_t *buffer, size_t buffer_len)
+{
+    if ((buffer == NULL) || (buffer_len < 12U))
+    {
+        return 0U;
+    }
+    metrics_sample_system();
+
+    taskENTER_CRITICAL();
+    struct metric *first = metrics;
+    taskEXIT_CRITICAL();
+
+    // Values of a previous undelivered snapshot are encoded again
+    for (struct metric *metric = first; metric != NULL; metric = metric->next)
+    {
+        metric->staged = false;
+    }
+
+    uint32_t requests = full_requests;
+    bool restart = (requests != full_requests_served) || ((full_resume == NULL) && ((sequence % METRICS_KEYFRAME_INTERVAL) == 0U));
+    bool full = restart || (full_resume != NULL);
+    struct metric *start = (full && !restart) ? full_resume : first;
+    size_t len = 0U;
+    buffer[len++] = METRICS_SNAPSHOT_VERSION;
+    size_t flags_offset = len++;
+    buffer[flags_offset] = full ? METRICS_SNAPSHOT_FULL : 0x00U;
+    len += metrics_put_varint(buffer + len, sequence);
+    len += metrics_put_varint(buffer + len, (uint32_t) xTaskGetTickCount() * portTICK_PERIOD_MS);
+
+    struct metric *metric = start;
+    for (; metric != NULL; metric = metric->next)
+    {
+        // Consistent copy of current values
+        struct metric current;
+        taskENTER_CRITICAL();
+        memcpy(&current, metric, sizeof(current));
+        taskEXIT_CRITICAL();
+
+        if (full)
+        {
+            current.exported_value = 0U;
+            current.exported_sum = 0U;
+            memset(current.exported_buckets, 0x00, sizeof(current.exported_buckets));
+        }
+        else if (current.value == current.exported_value)
+        {
+            continue;
+        }
+
+        size_t name_len = full ? strnlen(current.name, UINT8_MAX) : 0U;
+        if ((buffer_len - len) < (METRICS_MAX_ENCODED_LEN + name_len))
+        {
+            break;
+        }
+        buffer[len++] = current.id;
+        if (full)
+        {
+            buffer[len++] = (uint8_t) current.type;
+            buffer[len++] = (uint8_t) name_len;
+            memcpy(buffer + len, current.name, name_len);
+            len += name_len;
+        }
+        if (current.type == METRICS_TYPE_GAUGE)
+        {
+            int32_t change = (int32_t) (current.value - current.exported_value);
+            len += metrics_put_varint(buffer + len, ((uint32_t) change << 1U) ^ (uint32_t) (change >> 31));
+        }
+        else
+        {
+            len += metrics_put_varint(buffer + len, current.value - current.exported_value);
+        }
+        if (current.type == METRICS_TYPE_HISTOGRAM)
+        {
+            len += metrics_put_varint(buffer + len, current.sum - current.exported_sum);
+            for (size_t i = 0U; i < METRICS_HISTOGRAM_BUCKETS; i++)
+            {
+                len += metrics_put_varint(buffer + len, current.buckets[i] - current.exported_buckets[i]);
+            }
+        }
+
+        // Only exported values become new baseline once delivered, updates since copy are part of next snapshot
+        metric->staged = true;
+        metric->staged_value = current.value;
+        metric->staged_sum = current.sum;
+        memcpy(metric->staged_buckets, current.buckets, sizeof(current.buckets));
+    }
+
+    // Full snapshot continues with first metric not fitting
+    staged_requests = full ? requests : full_requests_served;
+    staged_resume = full ? metric : NULL;
+    if (staged_resume != NULL)
+    {
+        buffer[flags_offset] |= METRICS_SNAPSHOT_MORE;
+    }
+    snapshot_staged = true;
+    return len;
+}
+
+/**
+ * \brief Confirms delivery of the last snapshot encoded via metrics_snapshot().
+ *
+ * \details Encoded values become the baseline of the next snapshot, no-op if no snapshot is pending.
+ */
+void metrics_snapshot_commit(void)
+{
+    if (!snapshot_staged)
+    {
+        return;
+    }
+    taskENTER_CRITICAL();
+    struct metric *first = metrics;
+    taskEXIT_CRITICAL();
+    for (struct metric *metric = first; metric != NULL; metric = metric->next)
+    {
+        if (metric->staged)
+        {
+            metric->exported_value = metric->staged_value;
+            metric->exported_sum = metric->staged_sum;
+            memcpy(metric->exported_buckets, metric->staged_buckets, sizeof(metric->staged_buckets));
+            metric->staged = false;
+        }
+    }
+    full_requests_served = staged_requests;
+    full_resume = staged_resume;
+    sequence++;
+    snapshot_staged = false;
+}
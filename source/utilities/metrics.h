@@ -0,0 +1,246 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file metrics.h
+ * \brief Registry of counters, gauges and histograms exported as compact delta encoded snapshots.
+ * \details Metrics are defined statically (METRICS_COUNTER(), METRICS_GAUGE(), METRICS_HISTOGRAM()) and registered on first update.
+ * \details Snapshot format (all numbers unsigned LEB128 varints unless stated otherwise):
+ *     * Header: 1B version (METRICS_SNAPSHOT_VERSION), 1B flags (METRICS_SNAPSHOT_FULL, METRICS_SNAPSHOT_MORE), sequence number, uptime in ms
+ *     * Per metric changed since previous snapshot: 1B metric ID
+ *         * Full snapshots only: 1B type (enum metrics_type), 1B name length, name
+ *         * Counter: increment
+ *         * Gauge: zigzag encoded change
+ *         * Histogram: count increment, sum increment, METRICS_HISTOGRAM_BUCKETS bucket increments
+ * \details Full snapshots contain all metrics with values relative to zero. Full snapshots exceeding the snapshot buffer are split into
+ *          consecutive snapshots, all but the last one flagged METRICS_SNAPSHOT_MORE.
+ * \details Encoded values only become the baseline of the next snapshot once delivery is confirmed via metrics_snapshot_commit().
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Number of histogram buckets, bucket \c i counts values in [4^i, 4^(i+1)) (first and last bucket unbounded).
+ */
+#define METRICS_HISTOGRAM_BUCKETS 8U
+
+/**
+ * \brief Current snapshot format version.
+ */
+#define METRICS_SNAPSHOT_VERSION 0x01U
+
+/**
+ * \brief Snapshot flag signalling values relative to zero including metric names.
+ */
+#define METRICS_SNAPSHOT_FULL 0x01U
+
+/**
+ * \brief Snapshot flag signalling that the full snapshot continues in the next snapshot.
+ */
+#define METRICS_SNAPSHOT_MORE 0x02U
+
+/**
+ * \brief Number of snapshots after which a full snapshot is created regardless of requests.
+ */
+#ifndef METRICS_KEYFRAME_INTERVAL
+#define METRICS_KEYFRAME_INTERVAL 16U
+#endif
+
+/** \enum metrics_type
+ * \brief Types of metrics.
+ */
+enum metrics_type
+{
+    /**
+     * \brief Monotonically increasing value.
+     */
+    METRICS_TYPE_COUNTER = 0x01U,
+
+    /**
+     * \brief Arbitrary current value.
+     */
+    METRICS_TYPE_GAUGE = 0x02U,
+
+    /**
+     * \brief Distribution of observed values (e.g. latencies in microseconds).
+     */
+    METRICS_TYPE_HISTOGRAM = 0x03U
+};
+
+/** \struct metric
+ * \brief Single metric with values at time of last snapshot.
+ */
+struct metric
+{
+    /**
+     * \brief Name of metric used in full snapshots.
+     */
+    const char *name;
+
+    /**
+     * \brief Type of metric.
+     */
+    enum metrics_type type;
+
+    /**
+     * \brief ID of metric in snapshots (assigned on registration).
+     */
+    uint8_t id;
+
+    /**
+     * \brief Simple flag if metric has already been registered.
+     */
+    bool registered;
+
+    /**
+     * \brief Counter or gauge value, number of observations for histograms.
+     */
+    uint32_t value;
+
+    /**
+     * \brief Sum of all observed values (histograms only).
+     */
+    uint32_t sum;
+
+    /**
+     * \brief Number of observations per bucket (histograms only).
+     */
+    uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+
+    /**
+     * \brief metric.value at time of last snapshot.
+     */
+    uint32_t exported_value;
+
+    /**
+     * \brief metric.sum at time of last snapshot.
+     */
+    uint32_t exported_sum;
+
+    /**
+     * \brief metric.buckets at time of last snapshot.
+     */
+    uint32_t exported_buckets[METRICS_HISTOGRAM_BUCKETS];
+
+    /**
+     * \brief Simple flag if metric is part of the snapshot awaiting metrics_snapshot_commit().
+     */
+    bool staged;
+
+    /**
+     * \brief metric.value encoded in snapshot awaiting metrics_snapshot_commit().
+     */
+    uint32_t staged_value;
+
+    /**
+     * \brief metric.sum encoded in snapshot awaiting metrics_snapshot_commit().
+     */
+    uint32_t staged_sum;
+
+    /**
+     * \brief metric.buckets encoded in snapshot awaiting metrics_snapshot_commit().
+     */
+    uint32_t staged_buckets[METRICS_HISTOGRAM_BUCKETS];
+
+    /**
+     * \brief Next metric in list of all registered metrics.
+     */
+    struct metric *next;
+};
+
+/**
+ * \brief Static initializer for a counter.
+ */
+#define METRICS_COUNTER(metric_name) {.name = (metric_name), .type = METRICS_TYPE_COUNTER}
+
+/**
+ * \brief Static initializer for a gauge.
+ */
+#define METRICS_GAUGE(metric_name) {.name = (metric_name), .type = METRICS_TYPE_GAUGE}
+
+/**
+ * \brief Static initializer for a histogram.
+ */
+#define METRICS_HISTOGRAM(metric_name) {.name = (metric_name), .type = METRICS_TYPE_HISTOGRAM}
+
+/**
+ * \brief Increments counter.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in,out] metric Counter to be incremented.
+ * \param[in] amount Value to be added.
+ */
+void metrics_increment(struct metric *metric, uint32_t amount);
+
+/**
+ * \brief Sets gauge to current value.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in,out] metric Gauge to be set.
+ * \param[in] value Current value.
+ */
+void metrics_set(struct metric *metric, uint32_t value);
+
+/**
+ * \brief Records observation in histogram.
+ *
+ * \details Not to be used from interrupt context.
+ *
+ * \param[in,out] metric Histogram to record observation in.
+ * \param[in] value Observed value.
+ */
+void metrics_observe(struct metric *metric, uint32_t value);
+
+/**
+ * \brief Returns timestamp for measuring durations via metrics_observe_since().
+ * \return uint32_t Current CPU cycle count.
+ */
+uint32_t metrics_timestamp(void);
+
+/**
+ * \brief Records time elapsed since timestamp in microseconds in histogram.
+ *
+ * \param[in,out] metric Histogram to record duration in.
+ * \param[in] timestamp Start of measurement from metrics_timestamp().
+ */
+void metrics_observe_since(struct metric *metric, uint32_t timestamp);
+
+/**
+ * \brief Requests next snapshot to be a full snapshot (e.g. because a client lost track of previous snapshots).
+ */
+void metrics_request_full_snapshot(void);
+
+/**
+ * \brief Samples system metrics and encodes all metrics changed since the previous snapshot.
+ *
+ * \details Metrics not fitting into \c buffer are kept for the next snapshot, full snapshots are continued there.
+ * \details Without metrics_snapshot_commit(), the next call encodes the same snapshot (sequence number) again with current values.
+ *
+ * \param[out] buffer Buffer for encoded snapshot.
+ * \param[in] buffer_len Size of \c buffer.
+ * \return size_t Number of bytes written to \c buffer (0 if buffer is too small for header).
+ */
+size_t metrics_snapshot(uint8_t *buffer, size_t buffer_len);
+
+/**
+ * \brief Confirms delivery of the last snapshot encoded via metrics_snapshot().
+ *
+ * \details Encoded values become the baseline of the next snapshot, no-op if no snapshot is pending.
+ */
+void metrics_snapshot_commit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
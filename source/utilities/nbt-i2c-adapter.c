@@ -0,0 +1,214 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-i2c-adapter.c
+ * \brief I2C driver adapter reading whole T=1' frames in a single combined I2C transaction.
+ * \details Extends the CYHAL I2C driver adapter of the NBT library: when the T=1' layer requests a frame's prologue, the prologue is read
+ *          without stop condition and the remaining frame (information field and CRC) is read right away via repeated start. The
+ *          following request for the remaining frame is then served without any bus access.
+ * \details Frames are read into a buffer preallocated in struct nbt_i2c_adapter, the NBT I2C guard time is kept before every transaction.
+ * \details All other transfers (frame writes, polling, other lengths) are passed on to the CYHAL I2C driver adapter unchanged.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cyhal.h"
+
+#include "infineon/i2c-cyhal.h"
+#include "infineon/ifx-error.h"
+#include "infineon/ifx-protocol.h"
+
+#include "metrics.h"
+#include "nbt-i2c-adapter.h"
+
+/**
+ * \brief Time between two I2C transactions in microseconds.
+ */
+static struct metric bus_idle = METRICS_HISTOGRAM("i2c.idle_us");
+
+/**
+ * \brief Number of I2C transactions.
+ */
+static struct metric transactions = METRICS_COUNTER("i2c.transactions");
+
+/**
+ * \brief Number of frames read in a single combined I2C transaction.
+ */
+static struct metric combined_reads = METRICS_COUNTER("i2c.combined_reads");
+
+/**
+ * \brief Waits for NBT_I2C_ADAPTER_GUARD_TIME_US since last I2C transaction and records bus idle time before a new I2C transaction.
+ *
+ * \details The CYHAL I2C driver adapter only knows about its own transactions, so the guard time is kept here for all transactions.
+ *
+ * \param[in] adapter Adapter starting transaction.
+ */
+static void nbt_i2c_adapter_transaction_start(const struct nbt_i2c_adapter *adapter)
+{
+    if (adapter->last_transaction != 0U)
+    {
+        uint32_t elapsed_us = (metrics_timestamp() - adapter->last_transaction) / (SystemCoreClock / 1000000U);
+        if (elapsed_us < NBT_I2C_ADAPTER_GUARD_TIME_US)
+        {
+            cyhal_system_delay_us((uint16_t) (NBT_I2C_ADAPTER_GUARD_TIME_US - elapsed_us));
+        }
+        metrics_observe_since(&bus_idle, adapter->last_transaction);
+    }
+    metrics_increment(&transactions, 1U);
+}
+
+/**
+ * \brief Reads prologue and remaining frame into nbt_i2c_adapter.frame in a single I2C transaction using repeated start.
+ *
+ * \details Only the response buffers owned by the T=1' layer are allocated, after the bus has been released.
+ *
+ * \param[in,out] adapter Adapter to read frame with.
+ * \param[out] response Buffer for prologue (to be freed by caller), remaining frame stays in nbt_i2c_adapter.frame.
+ * \param[out] response_len Buffer for number of bytes in \c response.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_i2c_adapter_read_frame(struct nbt_i2c_adapter *adapter, uint8_t **response, size_t *response_len)
+{
+    nbt_i2c_adapter_transaction_start(adapter);
+    cy_rslt_t result = cyhal_i2c_master_read(adapter->i2c, adapter->address, adapter->frame, NBT_I2C_ADAPTER_PROLOGUE_LEN, NBT_I2C_ADAPTER_TIMEOUT_MS, false);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        // NBT still busy (address not acknowledged), T=1' layer keeps polling
+        adapter->last_transaction = metrics_timestamp();
+        return IFX_ERROR(LIB_NBT_I2C_ADAPTER, NBT_I2C_ADAPTER_RECEIVE, IFX_UNSPECIFIED_ERROR);
+    }
+
+    // Remaining frame follows via repeated start, bus is released by stop condition in any case
+    size_t remainder_len = (((size_t) adapter->frame[2] << 8U) | adapter->frame[3]) + NBT_I2C_ADAPTER_EPILOGUE_LEN;
+    if (remainder_len > (sizeof(adapter->frame) - NBT_I2C_ADAPTER_PROLOGUE_LEN))
+    {
+        uint8_t discard;
+        (void) cyhal_i2c_master_read(adapter->i2c, adapter->address, &discard, 1U, NBT_I2C_ADAPTER_TIMEOUT_MS, true);
+        adapter->last_transaction = metrics_timestamp();
+        return IFX_ERROR(LIB_NBT_I2C_ADAPTER, NBT_I2C_ADAPTER_RECEIVE, IFX_OUT_OF_MEMORY);
+    }
+    uint8_t *remainder = adapter->frame + NBT_I2C_ADAPTER_PROLOGUE_LEN;
+    result = cyhal_i2c_master_read(adapter->i2c, adapter->address, remainder, (uint16_t) remainder_len, NBT_I2C_ADAPTER_TIMEOUT_MS, true);
+    adapter->last_transaction = metrics_timestamp();
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return IFX_ERROR(LIB_NBT_I2C_ADAPTER, NBT_I2C_ADAPTER_RECEIVE, IFX_UNSPECIFIED_ERROR);
+    }
+    metrics_increment(&combined_reads, 1U);
+
+    uint8_t *prologue = malloc(NBT_I2C_ADAPTER_PROLOGUE_LEN);
+    if (prologue == NULL)
+    {
+        return IFX_ERROR(LIB_NBT_I2C_ADAPTER, NBT_I2C_ADAPTER_RECEIVE, IFX_OUT_OF_MEMORY);
+    }
+    memcpy(prologue, adapter->frame, NBT_I2C_ADAPTER_PROLOGUE_LEN);
+    adapter->remainder_len = remainder_len;
+    *response = prologue;
+    *response_len = NBT_I2C_ADAPTER_PROLOGUE_LEN;
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Protocol layer receive function serving remaining frames from nbt_i2c_adapter.frame.
+ *
+ * \param[in] self Protocol layer (first member of struct nbt_i2c_adapter).
+ * \param[in] expected_len Number of bytes requested by T=1' layer.
+ * \param[out] response Buffer for received data (to be freed by caller).
+ * \param[out] response_len Buffer for number of bytes in \c response.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_i2c_adapter_receive(ifx_protocol_t *self, size_t expected_len, uint8_t **response, size_t *response_len)
+{
+    struct nbt_i2c_adapter *adapter = (struct nbt_i2c_adapter *) self;
+    size_t remainder_len = adapter->remainder_len;
+    adapter->remainder_len = 0U;
+    if ((remainder_len > 0U) && (expected_len == remainder_len))
+    {
+        uint8_t *remainder = malloc(remainder_len);
+        if (remainder == NULL)
+        {
+            return IFX_ERROR(LIB_NBT_I2C_ADAPTER, NBT_I2C_ADAPTER_RECEIVE, IFX_OUT_OF_MEMORY);
+        }
+        memcpy(remainder, adapter->frame + NBT_I2C_ADAPTER_PROLOGUE_LEN, remainder_len);
+        *response = remainder;
+        *response_len = remainder_len;
+        return IFX_SUCCESS;
+    }
+
+    // Any pending remainder is dropped if not requested as expected (e.g. T=1' layer aborted frame)
+    if (NBT_I2C_ADAPTER_COMBINED_READ && (expected_len == NBT_I2C_ADAPTER_PROLOGUE_LEN))
+    {
+        return nbt_i2c_adapter_read_frame(adapter, response, response_len);
+    }
+    nbt_i2c_adapter_transaction_start(adapter);
+    ifx_status_t status = adapter->base_receive(self, expected_len, response, response_len);
+    adapter->last_transaction = metrics_timestamp();
+    return status;
+}
+
+/**
+ * \brief Protocol layer transmit function recording bus idle time.
+ *
+ * \param[in] self Protocol layer (first member of struct nbt_i2c_adapter).
+ * \param[in] data Data to be sent.
+ * \param[in] data_len Number of bytes in \c data.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_i2c_adapter_transmit(ifx_protocol_t *self, const uint8_t *data, size_t data_len)
+{
+    struct nbt_i2c_adapter *adapter = (struct nbt_i2c_adapter *) self;
+    nbt_i2c_adapter_transaction_start(adapter);
+    ifx_status_t status = adapter->base_transmit(self, data, data_len);
+    adapter->last_transaction = metrics_timestamp();
+    return status;
+}
+
+/**
+ * \brief Protocol layer destroy function dropping a pending remainder.
+ *
+ * \param[in] self Protocol layer (first member of struct nbt_i2c_adapter).
+ */
+static void nbt_i2c_adapter_destroy(ifx_protocol_t *self)
+{
+    struct nbt_i2c_adapter *adapter = (struct nbt_i2c_adapter *) self;
+    adapter->remainder_len = 0U;
+    adapter->base_destroy(self);
+}
+
+/**
+ * \brief Initializes I2C driver adapter on top of the CYHAL I2C driver adapter of the NBT library.
+ *
+ * \param[out] adapter Adapter to be initialized (must stay valid).
+ * \param[in] i2c CYHAL I2C driver (already configured).
+ * \param[in] address I2C address of NBT.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_i2c_adapter_initialize(struct nbt_i2c_adapter *adapter, cyhal_i2c_t *i2c, uint8_t address)
+{
+    if ((adapter == NULL) || (i2c == NULL))
+    {
+        return IFX_ERROR(LIB_NBT_I2C_ADAPTER, NBT_I2C_ADAPTER_INITIALIZE, IFX_ILLEGAL_ARGUMENT);
+    }
+    ifx_status_t status = i2c_cyhal_initialize(&adapter->protocol, i2c, address);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+    adapter->i2c = i2c;
+    adapter->address = address;
+    adapter->remainder_len = 0U;
+    adapter->last_transaction = 0U;
+
+    // Hook into CYHAL I2C driver adapter, its properties (address, guard times) remain in place
+    adapter->base_receive = adapter->protocol._receive;
+    adapter->base_transmit = adapter->protocol._transmit;
+    adapter->base_destroy = adapter->protocol._destroy;
+    adapter->protocol._receive = nbt_i2c_adapter_receive;
+    adapter->protocol._transmit = nbt_i2c_adapter_transmit;
+    adapter->protocol._destroy = nbt_i2c_adapter_destroy;
+    return IFX_SUCCESS;
+}
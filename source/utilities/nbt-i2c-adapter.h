@@ -0,0 +1,147 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-i2c-adapter.h
+ * \brief I2C driver adapter reading whole T=1' frames in a single combined I2C transaction.
+ * \details Extends the CYHAL I2C driver adapter of the NBT library: when the T=1' layer requests a frame's prologue, the prologue is read
+ *          without stop condition and the remaining frame (information field and CRC) is read right away via repeated start. The
+ *          following request for the remaining frame is then served without any bus access.
+ * \details Frames are read into a buffer preallocated in struct nbt_i2c_adapter, the NBT I2C guard time is kept before every transaction.
+ * \details All other transfers (frame writes, polling, other lengths) are passed on to the CYHAL I2C driver adapter unchanged.
+ */
+#ifndef NBT_I2C_ADAPTER_H
+#define NBT_I2C_ADAPTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cyhal.h"
+
+#include "infineon/ifx-error.h"
+#include "infineon/ifx-protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Simple flag if frames are read in a single combined I2C transaction.
+ */
+#ifndef NBT_I2C_ADAPTER_COMBINED_READ
+#define NBT_I2C_ADAPTER_COMBINED_READ 1
+#endif
+
+/**
+ * \brief Timeout of a single I2C transaction in milliseconds (0 to wait forever).
+ */
+#ifndef NBT_I2C_ADAPTER_TIMEOUT_MS
+#define NBT_I2C_ADAPTER_TIMEOUT_MS 100U
+#endif
+
+/**
+ * \brief Minimum time between two I2C transactions required by the NBT in microseconds.
+ */
+#ifndef NBT_I2C_ADAPTER_GUARD_TIME_US
+#define NBT_I2C_ADAPTER_GUARD_TIME_US 50U
+#endif
+
+/**
+ * \brief Maximum length of information field of frames read in a single combined I2C transaction.
+ */
+#ifndef NBT_I2C_ADAPTER_MAX_INF_LEN
+#define NBT_I2C_ADAPTER_MAX_INF_LEN 0x0200U
+#endif
+
+/**
+ * \brief Length of T=1' prologue (NAD, PCB, 2B LEN).
+ */
+#define NBT_I2C_ADAPTER_PROLOGUE_LEN 4U
+
+/**
+ * \brief Length of T=1' epilogue (CRC).
+ */
+#define NBT_I2C_ADAPTER_EPILOGUE_LEN 2U
+
+/**
+ * \brief Identifier for error codes.
+ */
+#define LIB_NBT_I2C_ADAPTER 0x3AU
+
+/**
+ * \brief Function identifier for nbt_i2c_adapter_initialize().
+ */
+#define NBT_I2C_ADAPTER_INITIALIZE 0x01U
+
+/**
+ * \brief Function identifier for receiving data.
+ */
+#define NBT_I2C_ADAPTER_RECEIVE 0x02U
+
+/** \struct nbt_i2c_adapter
+ * \brief I2C driver adapter state (protocol layer must be first member).
+ */
+struct nbt_i2c_adapter
+{
+    /**
+     * \brief Protocol layer handed to the T=1' layer.
+     */
+    ifx_protocol_t protocol;
+
+    /**
+     * \brief CYHAL I2C driver.
+     */
+    cyhal_i2c_t *i2c;
+
+    /**
+     * \brief I2C address of NBT.
+     */
+    uint8_t address;
+
+    /**
+     * \brief Receive function of CYHAL I2C driver adapter.
+     */
+    ifx_status_t (*base_receive)(ifx_protocol_t *self, size_t expected_len, uint8_t **response, size_t *response_len);
+
+    /**
+     * \brief Transmit function of CYHAL I2C driver adapter.
+     */
+    ifx_status_t (*base_transmit)(ifx_protocol_t *self, const uint8_t *data, size_t data_len);
+
+    /**
+     * \brief Destroy function of CYHAL I2C driver adapter.
+     */
+    void (*base_destroy)(ifx_protocol_t *self);
+
+    /**
+     * \brief Frame read in last combined I2C transaction (prologue followed by remaining frame).
+     */
+    uint8_t frame[NBT_I2C_ADAPTER_PROLOGUE_LEN + NBT_I2C_ADAPTER_MAX_INF_LEN + NBT_I2C_ADAPTER_EPILOGUE_LEN];
+
+    /**
+     * \brief Number of bytes of remaining frame in nbt_i2c_adapter.frame not yet requested by the T=1' layer (0 if none).
+     */
+    size_t remainder_len;
+
+    /**
+     * \brief Timestamp (metrics_timestamp()) of end of last I2C transaction (0 if none).
+     */
+    uint32_t last_transaction;
+};
+
+/**
+ * \brief Initializes I2C driver adapter on top of the CYHAL I2C driver adapter of the NBT library.
+ *
+ * \param[out] adapter Adapter to be initialized (must stay valid).
+ * \param[in] i2c CYHAL I2C driver (already configured).
+ * \param[in] address I2C address of NBT.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_i2c_adapter_initialize(struct nbt_i2c_adapter *adapter, cyhal_i2c_t *i2c, uint8_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NBT_I2C_ADAPTER_H
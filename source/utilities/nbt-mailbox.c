@@ -0,0 +1,128 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-mailbox.c
+ * \brief NFC writable NBT file used as mailbox for phone-to-device messages.
+ * \details The phone writes a message to the mailbox file using the NDEF style update procedure:
+ *     * Set 2 byte big endian length header to \c 0
+ *     * Write message payload after the header
+ *     * Set length header to actual payload length
+ *     * Wait until length header reads \c 0 again before writing the next message
+ * \details The NBT GPIO signals each NFC write, the MCU then calls nbt_mailbox_process() which reads the header and only the announced payload.
+ * \details Once the message has been dispatched, the MCU acknowledges it by clearing the length header, so the mailbox file must be writable via I2C as well as NFC.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "infineon/ifx-error.h"
+#include "infineon/ifx-logger.h"
+#include "infineon/nbt-apdu.h"
+#include "infineon/nbt-cmd.h"
+
+#include "log-limiter.h"
+#include "nbt-mailbox.h"
+#include "nbt-utilities.h"
+#include "nbt-write-budget.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT mailbox"
+
+/**
+ * \brief Registered message parser.
+ */
+static nbt_mailbox_parser_t mailbox_parser = NULL;
+
+/**
+ * \brief Context for mailbox_parser.
+ */
+static void *mailbox_parser_context = NULL;
+
+/**
+ * \brief Buffer mailbox file is read into, header followed by message (handed to mailbox_parser without further copies).
+ */
+static uint8_t mailbox[NBT_MAILBOX_HEADER_LEN + NBT_MAILBOX_MAX_LEN];
+
+/**
+ * \brief Length header acknowledging a dispatched message.
+ */
+static const uint8_t mailbox_acknowledge[NBT_MAILBOX_HEADER_LEN] = {0x00U, 0x00U};
+
+/**
+ * \brief Registers parser for mailbox messages.
+ *
+ * \param[in] parser Parser called by nbt_mailbox_process() for each complete message (\c NULL to unregister).
+ * \param[in] context Arbitrary context passed to \c parser.
+ */
+void nbt_mailbox_register_parser(nbt_mailbox_parser_t parser, void *context)
+{
+    mailbox_parser = parser;
+    mailbox_parser_context = context;
+}
+
+/**
+ * \brief Reads message from mailbox and hands it to registered parser.
+ *
+ * \details Must be called after the NBT signalled an NFC write. Messages with length header \c 0 are still being written (or already acknowledged) and ignored.
+ * \details The message is handed to the parser as view of the buffer it has been read into and acknowledged afterwards by clearing the length header.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_mailbox_process(nbt_cmd_t *nbt)
+{
+    if (nbt == NULL)
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_ILLEGAL_ARGUMENT);
+    }
+
+    // Acknowledgement of last message still waiting for NVM write budget, nothing new to process
+    if (nbt_write_budget_is_deferred(NBT_MAILBOX_FILEID, 0x00U, NBT_MAILBOX_HEADER_LEN))
+    {
+        return IFX_SUCCESS;
+    }
+
+    // Header announces length of message, 0 while phone is still writing
+    ifx_status_t status = nbt_read_file(nbt, NBT_MAILBOX_FILEID, 0x00U, NBT_MAILBOX_HEADER_LEN, mailbox);
+    if (ifx_error_check(status))
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not read mailbox header");
+        return status;
+    }
+    size_t length = ((size_t) mailbox[0] << 8U) | mailbox[1];
+    if (length == 0U)
+    {
+        return IFX_SUCCESS;
+    }
+    if ((length > NBT_MAILBOX_MAX_LEN) || ((length + NBT_MAILBOX_HEADER_LEN) > nbt_get_file_size(NBT_MAILBOX_FILEID)))
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Ignoring mailbox message with invalid length %u", (unsigned int) length);
+        status = IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_ILLEGAL_ARGUMENT);
+    }
+    else
+    {
+        // Only read announced payload, directly behind header in read buffer
+        status = nbt_read_file(nbt, NBT_MAILBOX_FILEID, NBT_MAILBOX_HEADER_LEN, length, mailbox + NBT_MAILBOX_HEADER_LEN);
+        if (ifx_error_check(status))
+        {
+            LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not read mailbox message");
+            return status;
+        }
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_DEBUG, "Received mailbox message of %u bytes", (unsigned int) length);
+        if (mailbox_parser != NULL)
+        {
+            mailbox_parser(mailbox + NBT_MAILBOX_HEADER_LEN, length, mailbox_parser_context);
+        }
+    }
+
+    // Acknowledge (or drop invalid) message so that it is not dispatched again and the phone may write the next one
+    ifx_status_t acknowledged = nbt_write_file(nbt, NBT_MAILBOX_FILEID, 0x00U, mailbox_acknowledge, sizeof(mailbox_acknowledge));
+    if (ifx_error_check(acknowledged))
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not acknowledge mailbox message");
+        return acknowledged;
+    }
+    return status;
+}
@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-mailbox.h
+ * \brief NFC writable NBT file used as mailbox for phone-to-device messages.
+ * \details The phone writes a message to the mailbox file using the NDEF style update procedure:
+ *     * Set 2 byte big endian length header to \c 0
+ *     * Write message payload after the header
+ *     * Set length header to actual payload length
+ *     * Wait until length header reads \c 0 again before writing the next message
+ * \details The NBT GPIO signals each NFC write, the MCU then calls nbt_mailbox_process() which reads the header and only the announced payload.
+ * \details Once the message has been dispatched, the MCU acknowledges it by clearing the length header, so the mailbox file must be writable via I2C as well as NFC.
+ */
+#ifndef NBT_MAILBOX_H
+#define NBT_MAILBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "infineon/ifx-error.h"
+#include "infineon/nbt-cmd.h"
+
+#include "nbt-utilities.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief NBT file used as mailbox.
+ */
+#ifndef NBT_MAILBOX_FILEID
+#define NBT_MAILBOX_FILEID NBT_FILEID_PROPRIETARY1
+#endif
+
+/**
+ * \brief NBT GPIO function signalling completed NFC writes.
+ */
+#ifndef NBT_MAILBOX_GPIO_FUNCTION
+#define NBT_MAILBOX_GPIO_FUNCTION NBT_GPIO_FUNCTION_WRITE_NOTIFICATION
+#endif
+
+/**
+ * \brief Maximum payload length of a single mailbox message.
+ */
+#ifndef NBT_MAILBOX_MAX_LEN
+#define NBT_MAILBOX_MAX_LEN 256U
+#endif
+
+/**
+ * \brief Number of bytes of mailbox length header.
+ */
+#define NBT_MAILBOX_HEADER_LEN 2U
+
+/**
+ * \brief Parser for mailbox messages.
+ *
+ * \details \c message is only valid for the duration of the call and must not be modified.
+ *
+ * \param[in] message Message payload as written by phone.
+ * \param[in] length Number of bytes in \c message.
+ * \param[in] context Context as given to nbt_mailbox_register_parser().
+ */
+typedef void (*nbt_mailbox_parser_t)(const uint8_t *message, size_t length, void *context);
+
+/**
+ * \brief Registers parser for mailbox messages.
+ *
+ * \param[in] parser Parser called by nbt_mailbox_process() for each complete message (\c NULL to unregister).
+ * \param[in] context Arbitrary context passed to \c parser.
+ */
+void nbt_mailbox_register_parser(nbt_mailbox_parser_t parser, void *context);
+
+/**
+ * \brief Reads message from mailbox and hands it to registered parser.
+ *
+ * \details Must be called after the NBT signalled an NFC write. Messages with length header \c 0 are still being written (or already acknowledged) and ignored.
+ * \details The message is handed to the parser as view of the buffer it has been read into and acknowledged afterwards by clearing the length header.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_mailbox_process(nbt_cmd_t *nbt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NBT_MAILBOX_H
@@ -0,0 +1,673 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-pipeline.c
+ * \brief Single execution pipeline for all NBT commands with build time configurable middleware.
+ * \details Every command passes the middleware listed in NBT_PIPELINE_MIDDLEWARE (outermost first) before being sent by the NBT library.
+ * \details The most frequent SELECT commands are sent as precompiled byte streams, everything else is encoded by the NBT library.
+ * \details The final stage performs the common cleanup (APDU destruction, status word check, response destruction) and logs errors.
+ * \details Not thread-safe, callers must serialize NBT access (e.g. via the NBT lock).
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cyhal.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "infineon/ifx-apdu.h"
+#include "infineon/ifx-error.h"
+#include "infineon/ifx-logger.h"
+#include "infineon/ifx-protocol.h"
+#include "infineon/nbt-apdu.h"
+#include "infineon/nbt-cmd.h"
+
+#include "log-limiter.h"
+#include "metrics.h"
+#include "nbt-pipeline.h"
+#include "nbt-utilities.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT pipeline"
+
+/**
+ * \brief Middleware chain as configured via NBT_PIPELINE_MIDDLEWARE.
+ */
+static const nbt_pipeline_middleware_t middleware[] = {NBT_PIPELINE_MIDDLEWARE};
+
+/**
+ * \brief Instruction byte of READ BINARY command.
+ */
+#define NBT_PIPELINE_INS_READ_BINARY 0xB0U
+
+/**
+ * \brief Length of encoded READ BINARY command (CLA, INS, P1, P2, Le).
+ */
+#define NBT_PIPELINE_READ_BINARY_LEN 5U
+
+/**
+ * \brief Instruction byte of UPDATE BINARY command.
+ */
+#define NBT_PIPELINE_INS_UPDATE_BINARY 0xD6U
+
+/**
+ * \brief Length of header of encoded UPDATE BINARY command (CLA, INS, P1, P2, Lc).
+ */
+#define NBT_PIPELINE_UPDATE_BINARY_HEADER_LEN 5U
+
+/**
+ * \brief SELECT of NFC Forum Type 4 Tag (NDEF) application, the NBT application.
+ */
+static const uint8_t select_nbt_application[] = {0x00U, 0xA4U, 0x04U, 0x00U, 0x07U, 0xD2U, 0x76U, 0x00U, 0x00U, 0x85U, 0x01U, 0x01U, 0x00U};
+
+/**
+ * \brief SELECT of capability container file by file ID without response data.
+ */
+static const uint8_t select_cc_file[] = {0x00U, 0xA4U, 0x00U, 0x0CU, 0x02U, 0xE1U, 0x03U};
+
+/**
+ * \brief SELECT of NDEF file by file ID without response data.
+ */
+static const uint8_t select_ndef_file[] = {0x00U, 0xA4U, 0x00U, 0x0CU, 0x02U, 0xE1U, 0x04U};
+
+/**
+ * \brief Expected response to all precompiled commands.
+ */
+static const uint8_t precompiled_response[] = {0x90U, 0x00U};
+
+/**
+ * \brief Files whose READ BINARY responses may be cached.
+ */
+static const uint16_t cacheable_files[] = {NBT_PIPELINE_CACHEABLE_FILES};
+
+/**
+ * \brief Buffer for UPDATE BINARY commands of password protected files encoded by nbt_pipeline_update_binary_with_password().
+ */
+static uint8_t protected_update[NBT_PIPELINE_UPDATE_BINARY_HEADER_LEN + 0xFFU];
+
+/**
+ * \brief Descriptions of command kinds used for logging.
+ */
+static const char *const descriptions[] = {
+    [NBT_PIPELINE_SELECT_APPLICATION] = "select NBT application",
+    [NBT_PIPELINE_SELECT_CONFIGURATOR] = "select NBT configurator application",
+    [NBT_PIPELINE_SELECT_FILE] = "select NBT file",
+    [NBT_PIPELINE_READ_BINARY] = "read NBT file",
+    [NBT_PIPELINE_UPDATE_BINARY] = "write NBT file",
+    [NBT_PIPELINE_OTHER] = "execute NBT command",
+};
+
+/**
+ * \brief Latency of commands actually sent to the NBT in microseconds.
+ */
+static struct metric apdu_latency = METRICS_HISTOGRAM("nbt.apdu_us");
+
+/**
+ * \brief Number of commands that failed on transport level.
+ */
+static struct metric apdu_errors = METRICS_COUNTER("nbt.apdu_errors");
+
+/**
+ * \brief Number of SELECT commands skipped by nbt_pipeline_select_tracking().
+ */
+static struct metric selects_skipped = METRICS_COUNTER("nbt.selects_skipped");
+
+/**
+ * \brief Number of READ BINARY commands answered by nbt_pipeline_cache().
+ */
+static struct metric cache_hits = METRICS_COUNTER("nbt.cache_hits");
+
+/**
+ * \brief Selection state tracked by nbt_pipeline_select_tracking().
+ */
+static struct
+{
+    /**
+     * \brief NBT the selection state belongs to (\c NULL if unknown).
+     */
+    nbt_cmd_t *nbt;
+
+    /**
+     * \brief Currently selected file (0 if unknown).
+     */
+    uint16_t file_id;
+} selection;
+
+/**
+ * \brief Command recorded by nbt_pipeline_trace().
+ */
+struct nbt_pipeline_trace_entry
+{
+    /**
+     * \brief FreeRTOS tick count when command finished.
+     */
+    TickType_t tick;
+
+    /**
+     * \brief Duration in microseconds.
+     */
+    uint32_t duration_us;
+
+    /**
+     * \brief Kind of command.
+     */
+    enum nbt_pipeline_kind kind;
+
+    /**
+     * \brief File concerned by command.
+     */
+    uint16_t file_id;
+
+    /**
+     * \brief Status word of response (0 if none).
+     */
+    uint16_t sw;
+
+    /**
+     * \brief Simple flag if command succeeded.
+     */
+    bool success;
+};
+
+/**
+ * \brief Ring buffer of commands recorded by nbt_pipeline_trace().
+ */
+static struct nbt_pipeline_trace_entry trace[NBT_PIPELINE_TRACE_LEN];
+
+/**
+ * \brief Total number of commands recorded by nbt_pipeline_trace().
+ */
+static uint32_t trace_count = 0U;
+
+/**
+ * \brief READ BINARY response kept by nbt_pipeline_cache().
+ */
+struct nbt_pipeline_cache_entry
+{
+    /**
+     * \brief NBT response belongs to (\c NULL if entry is unused).
+     */
+    nbt_cmd_t *nbt;
+
+    /**
+     * \brief File ID.
+     */
+    uint16_t file_id;
+
+    /**
+     * \brief Offset within file.
+     */
+    uint16_t offset;
+
+    /**
+     * \brief Number of bytes in nbt_pipeline_cache_entry.data.
+     */
+    uint16_t length;
+
+    /**
+     * \brief Response data.
+     */
+    uint8_t data[NBT_PIPELINE_CACHE_ENTRY_LEN];
+};
+
+/**
+ * \brief Responses kept by nbt_pipeline_cache().
+ */
+static struct nbt_pipeline_cache_entry cache[NBT_PIPELINE_CACHE_ENTRIES];
+
+/**
+ * \brief Index of cache entry replaced next.
+ */
+static size_t cache_next = 0U;
+
+/**
+ * \brief Returns description of command for logging.
+ * \param[in] request Command to be described.
+ * \return const char * Description.
+ */
+static const char *nbt_pipeline_description(const struct nbt_pipeline_request *request)
+{
+    if ((request->kind == NBT_PIPELINE_OTHER) && (request->description != NULL))
+    {
+        return request->description;
+    }
+    return descriptions[request->kind];
+}
+
+/**
+ * \brief Returns precompiled encoding of command if available.
+ * \param[in] request Command to be executed.
+ * \param[out] command_len Length of precompiled command.
+ * \return const uint8_t * Precompiled command or \c NULL if command has to be encoded by NBT library.
+ */
+static const uint8_t *nbt_pipeline_precompiled(const struct nbt_pipeline_request *request, size_t *command_len)
+{
+#if NBT_PIPELINE_PRECOMPILED_COMMANDS
+    if (request->kind == NBT_PIPELINE_SELECT_APPLICATION)
+    {
+        *command_len = sizeof(select_nbt_application);
+        return select_nbt_application;
+    }
+    if ((request->kind == NBT_PIPELINE_SELECT_FILE) && (request->file_id == NBT_FILEID_CC))
+    {
+        *command_len = sizeof(select_cc_file);
+        return select_cc_file;
+    }
+    if ((request->kind == NBT_PIPELINE_SELECT_FILE) && (request->file_id == NBT_FILEID_NDEF))
+    {
+        *command_len = sizeof(select_ndef_file);
+        return select_ndef_file;
+    }
+#else
+    (void) request;
+    (void) command_len;
+#endif
+    return NULL;
+}
+
+/**
+ * \brief Sends precompiled command straight to protocol layer.
+ *
+ * \details Responses matching precompiled_response are accepted without further parsing, anything else is checked for its trailing status word.
+ *
+ * \param[in,out] request Command to be executed.
+ * \param[in] command Precompiled command.
+ * \param[in] command_len Length of \c command.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_pipeline_send_precompiled(struct nbt_pipeline_request *request, const uint8_t *command, size_t command_len)
+{
+    uint8_t *response = NULL;
+    size_t response_len = 0U;
+    ifx_status_t status = ifx_protocol_transceive(request->nbt->protocol, command, command_len, &response, &response_len);
+    if (ifx_error_check(status) || (response == NULL) || (response_len < 2U))
+    {
+        free(response);
+        return ifx_error_check(status) ? status : IFX_ERROR(LIB_NBT_APDU, request->function, IFX_PROGRAMMING_ERROR);
+    }
+    if ((response_len == sizeof(precompiled_response)) && (memcmp(response, precompiled_response, sizeof(precompiled_response)) == 0))
+    {
+        request->sw = 0x9000U;
+    }
+    else
+    {
+        request->sw = (uint16_t) ((response[response_len - 2U] << 8U) | response[response_len - 1U]);
+    }
+    free(response);
+    return (request->sw == 0x9000U) ? IFX_SUCCESS : IFX_ERROR(LIB_NBT_APDU, request->function, IFX_SW_ERROR);
+}
+
+/**
+ * \brief Sends READ BINARY command and decodes response data directly into nbt_pipeline_request.data.
+ *
+ * \details Bypasses the APDU abstraction of the NBT library so that neither the command nor the response object is allocated.
+ * \details Only the raw response of the protocol stack is allocated, the status word is parsed from its trailing bytes.
+ * \details For password protected files the password is sent as command data (CLA, INS, P1, P2, Lc, password, Le).
+ *
+ * \param[in,out] request READ BINARY command with at most 255 bytes expected.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_pipeline_read_binary(struct nbt_pipeline_request *request)
+{
+    if ((request->length == 0U) || (request->length > 0xFFU) || (request->data == NULL))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, request->function, IFX_ILLEGAL_ARGUMENT);
+    }
+    uint8_t command[NBT_PIPELINE_READ_BINARY_LEN + 1U + NBT_PASSWORD_LEN] = {0x00U,
+                                                                             NBT_PIPELINE_INS_READ_BINARY,
+                                                                             (uint8_t) (request->offset >> 8U),
+                                                                             (uint8_t) request->offset};
+    size_t command_len = 4U;
+    if (request->password != NULL)
+    {
+        command[command_len++] = NBT_PASSWORD_LEN;
+        memcpy(command + command_len, request->password, NBT_PASSWORD_LEN);
+        command_len += NBT_PASSWORD_LEN;
+    }
+    command[command_len++] = (uint8_t) request->length;
+    uint8_t *response = NULL;
+    size_t response_len = 0U;
+    ifx_status_t status = ifx_protocol_transceive(request->nbt->protocol, command, command_len, &response, &response_len);
+    if (ifx_error_check(status) || (response == NULL) || (response_len < 2U))
+    {
+        free(response);
+        return ifx_error_check(status) ? status : IFX_ERROR(LIB_NBT_APDU, request->function, IFX_PROGRAMMING_ERROR);
+    }
+
+    // Status word in trailing bytes, data field (if any) in front of it
+    size_t data_len = response_len - 2U;
+    request->sw = (uint16_t) ((response[data_len] << 8U) | response[data_len + 1U]);
+    if (request->sw != 0x9000U)
+    {
+        status = IFX_ERROR(LIB_NBT_APDU, request->function, IFX_SW_ERROR);
+    }
+    else if (data_len != request->length)
+    {
+        status = IFX_ERROR(LIB_NBT_APDU, request->function, IFX_PROGRAMMING_ERROR);
+    }
+    else
+    {
+        memcpy(request->data, response, data_len);
+    }
+    free(response);
+    return status;
+}
+
+/**
+ * \brief Sends UPDATE BINARY command of password protected file with password appended to command data.
+ *
+ * \details The NBT library does not encode the password, so the command is encoded into protected_update and sent straight to the
+ *          protocol layer.
+ *
+ * \param[in,out] request UPDATE BINARY command with nbt_pipeline_request.password set.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_pipeline_update_binary_with_password(struct nbt_pipeline_request *request)
+{
+    if ((request->length == 0U) || ((request->length + NBT_PASSWORD_LEN) > 0xFFU) || (request->data == NULL))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, request->function, IFX_ILLEGAL_ARGUMENT);
+    }
+    protected_update[0] = 0x00U;
+    protected_update[1] = NBT_PIPELINE_INS_UPDATE_BINARY;
+    protected_update[2] = (uint8_t) (request->offset >> 8U);
+    protected_update[3] = (uint8_t) request->offset;
+    protected_update[4] = (uint8_t) (request->length + NBT_PASSWORD_LEN);
+    memcpy(protected_update + NBT_PIPELINE_UPDATE_BINARY_HEADER_LEN, request->data, request->length);
+    memcpy(protected_update + NBT_PIPELINE_UPDATE_BINARY_HEADER_LEN + request->length, request->password, NBT_PASSWORD_LEN);
+    size_t command_len = NBT_PIPELINE_UPDATE_BINARY_HEADER_LEN + request->length + NBT_PASSWORD_LEN;
+
+    uint8_t *response = NULL;
+    size_t response_len = 0U;
+    ifx_status_t status = ifx_protocol_transceive(request->nbt->protocol, protected_update, command_len, &response, &response_len);
+    memset(protected_update, 0x00, command_len);
+    if (ifx_error_check(status) || (response == NULL) || (response_len < 2U))
+    {
+        free(response);
+        return ifx_error_check(status) ? status : IFX_ERROR(LIB_NBT_APDU, request->function, IFX_PROGRAMMING_ERROR);
+    }
+    request->sw = (uint16_t) ((response[response_len - 2U] << 8U) | response[response_len - 1U]);
+    free(response);
+    return (request->sw == 0x9000U) ? IFX_SUCCESS : IFX_ERROR(LIB_NBT_APDU, request->function, IFX_SW_ERROR);
+}
+
+/**
+ * \brief Final stage sending command via NBT library and performing common cleanup.
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_pipeline_transceive(struct nbt_pipeline_request *request)
+{
+    nbt_cmd_t *nbt = request->nbt;
+    ifx_status_t status;
+    request->sw = 0U;
+    size_t command_len = 0U;
+    const uint8_t *command = nbt_pipeline_precompiled(request, &command_len);
+    if (command != NULL)
+    {
+        return nbt_pipeline_send_precompiled(request, command, command_len);
+    }
+    switch (request->kind)
+    {
+    case NBT_PIPELINE_SELECT_APPLICATION:
+        status = nbt_select_application(nbt);
+        break;
+    case NBT_PIPELINE_SELECT_CONFIGURATOR:
+        status = nbt_select_configurator_application(nbt);
+        break;
+    case NBT_PIPELINE_SELECT_FILE:
+        status = nbt_select_file(nbt, request->file_id);
+        break;
+    case NBT_PIPELINE_READ_BINARY:
+        return nbt_pipeline_read_binary(request);
+    case NBT_PIPELINE_UPDATE_BINARY:
+        if (request->password != NULL)
+        {
+            return nbt_pipeline_update_binary_with_password(request);
+        }
+        status = nbt_update_binary(nbt, request->offset, request->length, request->data);
+        break;
+    default:
+        status = request->issue(request);
+        break;
+    }
+    ifx_apdu_destroy(nbt->apdu);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+    request->sw = nbt->response->sw;
+    if (request->sw != 0x9000U)
+    {
+        ifx_apdu_response_destroy(nbt->response);
+        return IFX_ERROR(LIB_NBT_APDU, request->function, IFX_SW_ERROR);
+    }
+    if (!request->keep_response)
+    {
+        ifx_apdu_response_destroy(nbt->response);
+    }
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Executes command through whole pipeline.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful (status word 0x9000), any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_execute(struct nbt_pipeline_request *request)
+{
+    if ((request == NULL) || (request->nbt == NULL) || ((request->kind == NBT_PIPELINE_OTHER) && (request->issue == NULL)))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, (request != NULL) ? request->function : NBT_SELECT_APPLICATION, IFX_ILLEGAL_ARGUMENT);
+    }
+    request->stage = 0U;
+    ifx_status_t status = nbt_pipeline_next(request);
+    if (ifx_error_check(status))
+    {
+        const char *description = nbt_pipeline_description(request);
+        if (request->sw == 0U)
+        {
+            LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not %s (file 0x%04X)", description, request->file_id);
+        }
+        else if (request->sw != request->tolerated_sw)
+        {
+            // clang-format off
+            LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word to %s (file 0x%04X): 0x%04X", description, request->file_id, request->sw);
+            // clang-format on
+        }
+    }
+    return status;
+}
+
+/**
+ * \brief Passes request on to next middleware or finally to the NBT.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_next(struct nbt_pipeline_request *request)
+{
+    if (request->stage < (sizeof(middleware) / sizeof(middleware[0])))
+    {
+        return middleware[request->stage++](request);
+    }
+    return nbt_pipeline_transceive(request);
+}
+
+/**
+ * \brief Forgets selection state and cached responses.
+ *
+ * \details Must be called after reactivating the NBT.
+ */
+void nbt_pipeline_invalidate(void)
+{
+    memset(&selection, 0x00, sizeof(selection));
+    memset(cache, 0x00, sizeof(cache));
+}
+
+/**
+ * \brief Middleware recording the most recent commands for nbt_pipeline_trace_report().
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_trace(struct nbt_pipeline_request *request)
+{
+    uint32_t start = metrics_timestamp();
+    ifx_status_t status = nbt_pipeline_next(request);
+    struct nbt_pipeline_trace_entry *entry = &trace[trace_count % NBT_PIPELINE_TRACE_LEN];
+    entry->tick = xTaskGetTickCount();
+    entry->duration_us = (metrics_timestamp() - start) / (SystemCoreClock / 1000000U);
+    entry->kind = request->kind;
+    entry->file_id = request->file_id;
+    entry->sw = request->sw;
+    entry->success = !ifx_error_check(status);
+    trace_count++;
+    return status;
+}
+
+/**
+ * \brief Middleware skipping SELECT of the file that is already selected.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_select_tracking(struct nbt_pipeline_request *request)
+{
+    if ((request->kind == NBT_PIPELINE_SELECT_FILE) && (selection.nbt == request->nbt) && (selection.file_id == request->file_id))
+    {
+        metrics_increment(&selects_skipped, 1U);
+        request->sw = 0x9000U;
+        return IFX_SUCCESS;
+    }
+    ifx_status_t status = nbt_pipeline_next(request);
+
+    // Only successful file selections and data access keep state, anything else may have changed it
+    if (!ifx_error_check(status) && (request->kind == NBT_PIPELINE_SELECT_FILE))
+    {
+        selection.nbt = request->nbt;
+        selection.file_id = request->file_id;
+    }
+    else if (ifx_error_check(status) || ((request->kind != NBT_PIPELINE_READ_BINARY) && (request->kind != NBT_PIPELINE_UPDATE_BINARY)))
+    {
+        memset(&selection, 0x00, sizeof(selection));
+    }
+    return status;
+}
+
+/**
+ * \brief Middleware answering READ BINARY of NBT_PIPELINE_CACHEABLE_FILES from previous responses.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_cache(struct nbt_pipeline_request *request)
+{
+    bool cacheable = false;
+    for (size_t i = 0U; i < (sizeof(cacheable_files) / sizeof(cacheable_files[0])); i++)
+    {
+        cacheable = cacheable || (cacheable_files[i] == request->file_id);
+    }
+    if (!cacheable || ((request->kind != NBT_PIPELINE_READ_BINARY) && (request->kind != NBT_PIPELINE_UPDATE_BINARY)))
+    {
+        return nbt_pipeline_next(request);
+    }
+
+    for (size_t i = 0U; i < NBT_PIPELINE_CACHE_ENTRIES; i++)
+    {
+        struct nbt_pipeline_cache_entry *entry = &cache[i];
+        if ((entry->nbt != request->nbt) || (entry->file_id != request->file_id))
+        {
+            continue;
+        }
+        if (request->kind == NBT_PIPELINE_UPDATE_BINARY)
+        {
+            entry->nbt = NULL;
+        }
+        else if ((request->offset >= entry->offset) && ((request->offset + request->length) <= (entry->offset + entry->length)))
+        {
+            memcpy(request->data, entry->data + (request->offset - entry->offset), request->length);
+            metrics_increment(&cache_hits, 1U);
+            request->sw = 0x9000U;
+            return IFX_SUCCESS;
+        }
+    }
+
+    ifx_status_t status = nbt_pipeline_next(request);
+    if (!ifx_error_check(status) && (request->kind == NBT_PIPELINE_READ_BINARY) && (request->length <= NBT_PIPELINE_CACHE_ENTRY_LEN))
+    {
+        struct nbt_pipeline_cache_entry *entry = &cache[cache_next];
+        cache_next = (cache_next + 1U) % NBT_PIPELINE_CACHE_ENTRIES;
+        entry->nbt = request->nbt;
+        entry->file_id = request->file_id;
+        entry->offset = request->offset;
+        entry->length = request->length;
+        memcpy(entry->data, request->data, request->length);
+    }
+    return status;
+}
+
+/**
+ * \brief Middleware retrying idempotent commands failing on transport level.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_retry(struct nbt_pipeline_request *request)
+{
+    size_t stage = request->stage;
+    ifx_status_t status = nbt_pipeline_next(request);
+
+    // Commands with side effects beyond file contents (e.g. password verification) are never repeated
+    for (size_t retry = 0U; (retry < NBT_PIPELINE_RETRIES) && ifx_error_check(status) && (request->sw == 0U) && (request->kind != NBT_PIPELINE_OTHER);
+         retry++)
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Retrying to %s (file 0x%04X)", nbt_pipeline_description(request), request->file_id);
+        request->stage = stage;
+        status = nbt_pipeline_next(request);
+    }
+    return status;
+}
+
+/**
+ * \brief Middleware recording command latency and failures as metrics.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_metrics(struct nbt_pipeline_request *request)
+{
+    uint32_t start = metrics_timestamp();
+    ifx_status_t status = nbt_pipeline_next(request);
+    metrics_observe_since(&apdu_latency, start);
+    if (ifx_error_check(status) && (request->sw == 0U))
+    {
+        metrics_increment(&apdu_errors, 1U);
+    }
+    return status;
+}
+
+/**
+ * \brief Logs commands recorded by nbt_pipeline_trace(), oldest first.
+ */
+void nbt_pipeline_trace_report(void)
+{
+    uint32_t first = (trace_count > NBT_PIPELINE_TRACE_LEN) ? (trace_count - NBT_PIPELINE_TRACE_LEN) : 0U;
+    for (uint32_t i = first; i < trace_count; i++)
+    {
+        const struct nbt_pipeline_trace_entry *entry = &trace[i % NBT_PIPELINE_TRACE_LEN];
+        // clang-format off
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "%lu: %s (file 0x%04X) %s, SW 0x%04X, %lu us",
+                       (unsigned long) entry->tick, descriptions[entry->kind], entry->file_id, entry->success ? "ok" : "failed", entry->sw,
+                       (unsigned long) entry->duration_us);
+        // clang-format on
+    }
+}
@@ -0,0 +1,269 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-pipeline.h
+ * \brief Single execution pipeline for all NBT commands with build time configurable middleware.
+ * \details Every command passes the middleware listed in NBT_PIPELINE_MIDDLEWARE (outermost first) before being sent by the NBT library.
+ * \details The most frequent SELECT commands are sent as precompiled byte streams, everything else is encoded by the NBT library.
+ * \details The final stage performs the common cleanup (APDU destruction, status word check, response destruction) and logs errors.
+ * \details Not thread-safe, callers must serialize NBT access (e.g. via the NBT lock).
+ */
+#ifndef NBT_PIPELINE_H
+#define NBT_PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "infineon/ifx-error.h"
+#include "infineon/nbt-cmd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Number of retries for idempotent commands failing on transport level.
+ */
+#ifndef NBT_PIPELINE_RETRIES
+#define NBT_PIPELINE_RETRIES 1U
+#endif
+
+/**
+ * \brief Number of commands kept by nbt_pipeline_trace().
+ */
+#ifndef NBT_PIPELINE_TRACE_LEN
+#define NBT_PIPELINE_TRACE_LEN 16U
+#endif
+
+/**
+ * \brief Number of READ BINARY responses kept by nbt_pipeline_cache().
+ */
+#ifndef NBT_PIPELINE_CACHE_ENTRIES
+#define NBT_PIPELINE_CACHE_ENTRIES 4U
+#endif
+
+/**
+ * \brief Maximum length of a READ BINARY response kept by nbt_pipeline_cache().
+ */
+#ifndef NBT_PIPELINE_CACHE_ENTRY_LEN
+#define NBT_PIPELINE_CACHE_ENTRY_LEN 32U
+#endif
+
+/**
+ * \brief Files whose READ BINARY responses may be cached (must not be writable via NFC).
+ */
+#ifndef NBT_PIPELINE_CACHEABLE_FILES
+#define NBT_PIPELINE_CACHEABLE_FILES 0xE103U
+#endif
+
+/**
+ * \brief Simple flag if SELECT of NBT application, CC file and NDEF file are sent as precompiled byte streams.
+ */
+#ifndef NBT_PIPELINE_PRECOMPILED_COMMANDS
+#define NBT_PIPELINE_PRECOMPILED_COMMANDS 1
+#endif
+
+/**
+ * \brief Ordered list of middleware every command passes (outermost first).
+ */
+#ifndef NBT_PIPELINE_MIDDLEWARE
+#define NBT_PIPELINE_MIDDLEWARE nbt_pipeline_trace, nbt_pipeline_select_tracking, nbt_pipeline_cache, nbt_pipeline_retry, nbt_pipeline_metrics
+#endif
+
+/** \enum nbt_pipeline_kind
+ * \brief Kinds of commands known to the pipeline.
+ */
+enum nbt_pipeline_kind
+{
+    /**
+     * \brief SELECT of NBT (operational) application.
+     */
+    NBT_PIPELINE_SELECT_APPLICATION,
+
+    /**
+     * \brief SELECT of NBT configurator application.
+     */
+    NBT_PIPELINE_SELECT_CONFIGURATOR,
+
+    /**
+     * \brief SELECT of file by ID (nbt_pipeline_request.file_id).
+     */
+    NBT_PIPELINE_SELECT_FILE,
+
+    /**
+     * \brief READ BINARY of currently selected file decoded directly into nbt_pipeline_request.data (at most 255 bytes).
+     */
+    NBT_PIPELINE_READ_BINARY,
+
+    /**
+     * \brief UPDATE BINARY of currently selected file from nbt_pipeline_request.data.
+     */
+    NBT_PIPELINE_UPDATE_BINARY,
+
+    /**
+     * \brief Any other command issued via nbt_pipeline_request.issue.
+     */
+    NBT_PIPELINE_OTHER
+};
+
+/** \struct nbt_pipeline_request
+ * \brief Single command passing the pipeline.
+ */
+struct nbt_pipeline_request
+{
+    /**
+     * \brief NBT command abstraction.
+     */
+    nbt_cmd_t *nbt;
+
+    /**
+     * \brief Kind of command.
+     */
+    enum nbt_pipeline_kind kind;
+
+    /**
+     * \brief NBT library function code used for error reporting (e.g. \c NBT_READ_BINARY).
+     */
+    uint8_t function;
+
+    /**
+     * \brief File concerned by command (0 if none).
+     */
+    uint16_t file_id;
+
+    /**
+     * \brief Offset within file (READ BINARY and UPDATE BINARY only).
+     */
+    uint16_t offset;
+
+    /**
+     * \brief Number of data bytes (READ BINARY and UPDATE BINARY only).
+     */
+    uint16_t length;
+
+    /**
+     * \brief Data buffer (READ BINARY and UPDATE BINARY only).
+     */
+    uint8_t *data;
+
+    /**
+     * \brief Password sent along with READ BINARY and UPDATE BINARY of password protected files (NBT_PASSWORD_LEN bytes, \c NULL if none).
+     */
+    const uint8_t *password;
+
+    /**
+     * \brief Command issuing function (NBT_PIPELINE_OTHER only) leaving response in \c nbt->response.
+     */
+    ifx_status_t (*issue)(struct nbt_pipeline_request *request);
+
+    /**
+     * \brief Command specific context for nbt_pipeline_request.issue.
+     */
+    void *context;
+
+    /**
+     * \brief Description used for logging (NBT_PIPELINE_OTHER only, e.g. "read file access policies").
+     */
+    const char *description;
+
+    /**
+     * \brief Status word not logged as error because caller handles it (0 if none).
+     */
+    uint16_t tolerated_sw;
+
+    /**
+     * \brief Simple flag if successful response is kept in \c nbt->response to be consumed and destroyed by caller (not for READ BINARY).
+     */
+    bool keep_response;
+
+    /**
+     * \brief Status word of response (0 if no response has been received).
+     */
+    uint16_t sw;
+
+    /**
+     * \brief Current position in middleware chain (managed by pipeline).
+     */
+    size_t stage;
+};
+
+/**
+ * \brief Middleware processing request and passing it on via nbt_pipeline_next().
+ */
+typedef ifx_status_t (*nbt_pipeline_middleware_t)(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Executes command through whole pipeline.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful (status word 0x9000), any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_execute(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Passes request on to next middleware or finally to the NBT.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_next(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Forgets selection state and cached responses.
+ *
+ * \details Must be called after reactivating the NBT.
+ */
+void nbt_pipeline_invalidate(void);
+
+/**
+ * \brief Middleware recording the most recent commands for nbt_pipeline_trace_report().
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_trace(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Middleware skipping SELECT of the file that is already selected.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_select_tracking(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Middleware answering READ BINARY of NBT_PIPELINE_CACHEABLE_FILES from previous responses.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_cache(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Middleware retrying idempotent commands failing on transport level.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_retry(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Middleware recording command latency and failures as metrics.
+ *
+ * \param[in,out] request Command to be executed.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_pipeline_metrics(struct nbt_pipeline_request *request);
+
+/**
+ * \brief Logs commands recorded by nbt_pipeline_trace(), oldest first.
+ */
+void nbt_pipeline_trace_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NBT_PIPELINE_H
@@ -0,0 +1,730 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-provisioning.c
+ * \brief Factory provisioning of one or more NBTs from a compact binary manifest.
+ * \details Manifest format (multi-byte values big endian):
+ *     * Header: magic "NBTM", 1B version (NBT_PROVISIONING_VERSION), 1B number of entries
+ *     * FAP entry: 1B type (NBT_PROVISIONING_ENTRY_FAP), 2B file ID, 1B I2C read, 1B I2C write, 1B NFC read, 1B NFC write access condition
+ *     * Configuration entry: 1B type (NBT_PROVISIONING_ENTRY_CONFIGURATION), 1B key (enum nbt_provisioning_configuration_key), 1B value
+ *     * File entry: 1B type (NBT_PROVISIONING_ENTRY_FILE), 2B file ID, 2B offset, 2B length, data
+ *     * Optional integrity entry (last entry only): 1B type (NBT_PROVISIONING_ENTRY_CRC), 2B CRC-16/X.25 of all preceding manifest bytes
+ * \details Tags are processed in a two stage pipeline: while the writer applies the image to tag N, a reader task already reads tag N+1 and
+ *          computes the minimal set of differing file ranges. Both stages share the I2C bus via a lock taken per file operation.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cyhal.h"
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+
+#include "infineon/ifx-error.h"
+#include "infineon/ifx-logger.h"
+#include "infineon/ifx-protocol.h"
+#include "infineon/ifx-t1prime.h"
+#include "infineon/nbt-apdu.h"
+#include "infineon/nbt-cmd.h"
+
+#include "crc16.h"
+#include "nbt-i2c-adapter.h"
+#include "nbt-pipeline.h"
+#include "nbt-provisioning.h"
+#include "nbt-utilities.h"
+#include "nbt-write-budget.h"
+#include "profiled-mutex.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT provisioning"
+
+/**
+ * \brief Number of bytes read per file operation while computing differences.
+ */
+#define NBT_PROVISIONING_READ_CHUNK 128U
+
+/**
+ * \brief Maximum number of file access policies in a manifest (one per NBT file).
+ */
+#define NBT_PROVISIONING_MAX_FAPS 7U
+
+/**
+ * \brief Number of plans being processed by the pipeline at the same time (one per stage).
+ */
+#define NBT_PROVISIONING_PLANS 2U
+
+/**
+ * \brief Tag being provisioned.
+ */
+struct nbt_provisioning_tag
+{
+    /**
+     * \brief NBT command abstraction.
+     */
+    nbt_cmd_t *nbt;
+
+    /**
+     * \brief I2C address used for reporting.
+     */
+    uint8_t address;
+
+    /**
+     * \brief Simple flag if communication channel has already been activated.
+     */
+    bool activated;
+
+    /**
+     * \brief Protocol stack to be activated before first use (\c NULL for tags added via nbt_provisioning_add_tag()).
+     */
+    ifx_protocol_t *protocol;
+};
+
+/**
+ * \brief Communication stack of tags attached via nbt_provisioning_attach_tag().
+ */
+struct nbt_provisioning_stack
+{
+    /**
+     * \brief Adapter between ModusToolbox CYHAL I2C driver and NBT library framework.
+     */
+    struct nbt_i2c_adapter driver;
+
+    /**
+     * \brief Communication protocol stack.
+     */
+    ifx_protocol_t protocol;
+
+    /**
+     * \brief NBT command abstraction.
+     */
+    nbt_cmd_t nbt;
+};
+
+/**
+ * \brief File contents from manifest.
+ */
+struct nbt_provisioning_file
+{
+    /**
+     * \brief NBT file ID.
+     */
+    uint16_t file_id;
+
+    /**
+     * \brief Offset within NBT file.
+     */
+    uint16_t offset;
+
+    /**
+     * \brief Number of bytes in nbt_provisioning_file.data.
+     */
+    uint16_t length;
+
+    /**
+     * \brief File contents (points into manifest).
+     */
+    const uint8_t *data;
+};
+
+/**
+ * \brief Tag image parsed from manifest.
+ */
+struct nbt_provisioning_image
+{
+    /**
+     * \brief File access policies.
+     */
+    nbt_file_access_policy_t faps[NBT_PROVISIONING_MAX_FAPS];
+
+    /**
+     * \brief Pointers to nbt_provisioning_image.faps as required by nbt_configuration.
+     */
+    nbt_file_access_policy_t *fap_pointers[NBT_PROVISIONING_MAX_FAPS];
+
+    /**
+     * \brief Configuration applied via nbt_configure().
+     */
+    struct nbt_configuration configuration;
+
+    /**
+     * \brief File contents.
+     */
+    struct nbt_provisioning_file files[NBT_PROVISIONING_MAX_FILES];
+
+    /**
+     * \brief Number of entries in nbt_provisioning_image.files.
+     */
+    size_t files_len;
+};
+
+/**
+ * \brief Range of a file entry that differs from current tag contents.
+ */
+struct nbt_provisioning_range
+{
+    /**
+     * \brief Index in nbt_provisioning_image.files.
+     */
+    uint8_t file;
+
+    /**
+     * \brief Offset relative to file entry.
+     */
+    uint16_t offset;
+
+    /**
+     * \brief Number of bytes to be written.
+     */
+    uint16_t length;
+};
+
+/**
+ * \brief Writes required for a single tag as computed by reader stage.
+ */
+struct nbt_provisioning_plan
+{
+    /**
+     * \brief Index of tag in tags.
+     */
+    size_t tag;
+
+    /**
+     * \brief Status of reader stage (writes are skipped in case of error).
+     */
+    ifx_status_t status;
+
+    /**
+     * \brief Differing ranges.
+     */
+    struct nbt_provisioning_range ranges[NBT_PROVISIONING_MAX_RUNS];
+
+    /**
+     * \brief Number of entries in nbt_provisioning_plan.ranges.
+     */
+    size_t ranges_len;
+
+    /**
+     * \brief Simple flag if differences did not fit into nbt_provisioning_plan.ranges and all file entries need to be written.
+     */
+    bool overflow;
+
+    /**
+     * \brief Duration of reader stage.
+     */
+    uint32_t read_ms;
+};
+
+/**
+ * \brief Tags being provisioned.
+ */
+static struct nbt_provisioning_tag tags[NBT_PROVISIONING_MAX_TAGS];
+
+/**
+ * \brief Number of entries in tags.
+ */
+static size_t tags_len = 0U;
+
+/**
+ * \brief Communication stacks of tags attached via nbt_provisioning_attach_tag().
+ */
+static struct nbt_provisioning_stack stacks[NBT_PROVISIONING_MAX_TAGS];
+
+/**
+ * \brief Number of entries in stacks.
+ */
+static size_t stacks_len = 0U;
+
+/**
+ * \brief Image of current run.
+ */
+static struct nbt_provisioning_image image;
+
+/**
+ * \brief Plans passed between reader and writer stage.
+ */
+static struct nbt_provisioning_plan plans[NBT_PROVISIONING_PLANS];
+
+/**
+ * \brief Plans available to reader stage.
+ */
+static QueueHandle_t free_plans = NULL;
+
+/**
+ * \brief Plans ready for writer stage.
+ */
+static QueueHandle_t ready_plans = NULL;
+
+/**
+ * \brief Storage of free_plans (no heap allocation after start-up).
+ */
+static StaticQueue_t free_plans_queue;
+
+/**
+ * \brief Items of free_plans.
+ */
+static uint8_t free_plans_storage[NBT_PROVISIONING_PLANS * sizeof(struct nbt_provisioning_plan *)];
+
+/**
+ * \brief Storage of ready_plans (no heap allocation after start-up).
+ */
+static StaticQueue_t ready_plans_queue;
+
+/**
+ * \brief Items of ready_plans.
+ */
+static uint8_t ready_plans_storage[NBT_PROVISIONING_PLANS * sizeof(struct nbt_provisioning_plan *)];
+
+/**
+ * \brief Stack depth of reader stage task in words.
+ */
+#define NBT_PROVISIONING_READER_STACK_DEPTH 1024U
+
+/**
+ * \brief Stack of reader stage task.
+ */
+static StackType_t reader_stack[NBT_PROVISIONING_READER_STACK_DEPTH];
+
+/**
+ * \brief Task control block of reader stage task.
+ */
+static StaticTask_t reader_task;
+
+/**
+ * \brief Handle of reader stage task once started (kept for following runs).
+ */
+static TaskHandle_t reader_task_handle = NULL;
+
+/**
+ * \brief Lock guarding I2C bus during current run.
+ */
+static struct profiled_mutex *bus = NULL;
+
+/**
+ * \brief Reads big endian 16 bit value.
+ * \param[in] data Pointer to first byte.
+ * \return uint16_t Decoded value.
+ */
+static uint16_t read_u16(const uint8_t *data)
+{
+    return (uint16_t) ((data[0] << 8U) | data[1]);
+}
+
+/**
+ * \brief Converts FreeRTOS ticks to milliseconds.
+ * \param[in] ticks Number of ticks.
+ * \return uint32_t Number of milliseconds.
+ */
+static uint32_t ticks_to_ms(TickType_t ticks)
+{
+    return (uint32_t) ticks * portTICK_PERIOD_MS;
+}
+
+/**
+ * \brief Parses manifest into image.
+ * \param[in] manifest Binary manifest.
+ * \param[in] manifest_len Number of bytes in \c manifest.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_provisioning_parse(const uint8_t *manifest, size_t manifest_len)
+{
+    memset(&image, 0x00, sizeof(image));
+    image.configuration.communication_interface = NBT_COMM_INTF_NFC_ENABLED_I2C_ENABLED;
+    image.configuration.irq_function = NBT_GPIO_FUNCTION_DISABLED;
+    image.configuration.fap = image.fap_pointers;
+
+    if ((manifest_len < 6U) || (memcmp(manifest, "NBTM", 4U) != 0) || (manifest[4] != NBT_PROVISIONING_VERSION))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid manifest header");
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+    }
+    size_t entries = manifest[5];
+    size_t position = 6U;
+    for (size_t i = 0U; i < entries; i++)
+    {
+        if (position >= manifest_len)
+        {
+            break;
+        }
+        uint8_t type = manifest[position++];
+        size_t remaining = manifest_len - position;
+        const uint8_t *entry = manifest + position;
+        if ((type == NBT_PROVISIONING_ENTRY_FAP) && (remaining >= 6U) && (image.configuration.fap_len < NBT_PROVISIONING_MAX_FAPS))
+        {
+            nbt_file_access_policy_t *fap = &image.faps[image.configuration.fap_len];
+            fap->file_id = read_u16(entry);
+            fap->i2c_read_access_condition = entry[2];
+            fap->i2c_write_access_condition = entry[3];
+            fap->nfc_read_access_condition = entry[4];
+            fap->nfc_write_access_condition = entry[5];
+            image.fap_pointers[image.configuration.fap_len++] = fap;
+            position += 6U;
+        }
+        else if ((type == NBT_PROVISIONING_ENTRY_CONFIGURATION) && (remaining >= 2U) &&
+                 ((entry[0] == NBT_PROVISIONING_CONFIGURATION_COMMUNICATION_INTERFACE) || (entry[0] == NBT_PROVISIONING_CONFIGURATION_GPIO_FUNCTION)))
+        {
+            if (entry[0] == NBT_PROVISIONING_CONFIGURATION_COMMUNICATION_INTERFACE)
+            {
+                image.configuration.communication_interface = (nbt_communication_interface_tags) entry[1];
+            }
+            else
+            {
+                image.configuration.irq_function = (nbt_gpio_function_tags) entry[1];
+            }
+            position += 2U;
+        }
+        else if ((type == NBT_PROVISIONING_ENTRY_FILE) && (remaining >= 6U) && ((remaining - 6U) >= read_u16(entry + 4U)) &&
+                 (image.files_len < NBT_PROVISIONING_MAX_FILES))
+        {
+            struct nbt_provisioning_file *file = &image.files[image.files_len++];
+            file->file_id = read_u16(entry);
+            file->offset = read_u16(entry + 2U);
+            file->length = read_u16(entry + 4U);
+            file->data = entry + 6U;
+            position += 6U + file->length;
+        }
+        else if ((type == NBT_PROVISIONING_ENTRY_CRC) && (remaining == 2U))
+        {
+            uint16_t expected = crc16_x25(manifest, position - 1U);
+            if (read_u16(entry) != expected)
+            {
+                // clang-format off
+                ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Manifest CRC mismatch: 0x%04X instead of 0x%04X", read_u16(entry), expected);
+                // clang-format on
+                return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+            }
+            position += 2U;
+        }
+        else
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid manifest entry %u (type 0x%02X)", (unsigned int) i, type);
+            return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+        }
+    }
+    if (position != manifest_len)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Manifest length does not match entries");
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+    }
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Marks byte of file entry as differing, merging it with the previous range if close enough.
+ * \param[in,out] plan Plan to add range to.
+ * \param[in] file Index in nbt_provisioning_image.files.
+ * \param[in] position Offset relative to file entry.
+ */
+static void nbt_provisioning_mark(struct nbt_provisioning_plan *plan, size_t file, size_t position)
+{
+    struct nbt_provisioning_range *last = (plan->ranges_len > 0U) ? &plan->ranges[plan->ranges_len - 1U] : NULL;
+    if ((last != NULL) && (last->file == file) && (position <= ((size_t) last->offset + last->length + NBT_PROVISIONING_MERGE_GAP)))
+    {
+        last->length = (uint16_t) (position - last->offset + 1U);
+        return;
+    }
+    if (plan->ranges_len >= NBT_PROVISIONING_MAX_RUNS)
+    {
+        plan->overflow = true;
+        return;
+    }
+    plan->ranges[plan->ranges_len++] = (struct nbt_provisioning_range) {.file = (uint8_t) file, .offset = (uint16_t) position, .length = 1U};
+}
+
+/**
+ * \brief Reader stage: Reads current contents of a tag and computes differing ranges.
+ * \param[in] tag Index of tag in tags.
+ * \param[out] plan Plan to store differing ranges in.
+ */
+static void nbt_provisioning_diff(size_t tag, struct nbt_provisioning_plan *plan)
+{
+    TickType_t start = xTaskGetTickCount();
+    memset(plan, 0x00, sizeof(*plan));
+    plan->tag = tag;
+    nbt_cmd_t *nbt = tags[tag].nbt;
+
+    profiled_mutex_take(bus, portMAX_DELAY);
+    if (!tags[tag].activated)
+    {
+        uint8_t *atpo = NULL;
+        size_t atpo_len = 0U;
+        plan->status = ifx_protocol_activate(tags[tag].protocol, &atpo, &atpo_len);
+        if (atpo != NULL)
+        {
+            free(atpo);
+        }
+        tags[tag].activated = !ifx_error_check(plan->status);
+        nbt_pipeline_invalidate();
+    }
+    if (!ifx_error_check(plan->status))
+    {
+        plan->status = nbt_select_nbt_application(nbt);
+    }
+    profiled_mutex_give(bus);
+    if (ifx_error_check(plan->status))
+    {
+        return;
+    }
+
+    uint8_t current[NBT_PROVISIONING_READ_CHUNK];
+    for (size_t f = 0U; (f < image.files_len) && !plan->overflow; f++)
+    {
+        const struct nbt_provisioning_file *file = &image.files[f];
+        size_t first_range = plan->ranges_len;
+        bool readable = true;
+        for (size_t chunk_offset = 0U; chunk_offset < file->length; chunk_offset += NBT_PROVISIONING_READ_CHUNK)
+        {
+            size_t chunk_len = ((file->length - chunk_offset) < NBT_PROVISIONING_READ_CHUNK) ? (file->length - chunk_offset) : NBT_PROVISIONING_READ_CHUNK;
+            profiled_mutex_take(bus, portMAX_DELAY);
+            ifx_status_t status = nbt_read_file(nbt, (enum nbt_fileid) file->file_id, file->offset + chunk_offset, chunk_len, current);
+            profiled_mutex_give(bus);
+            if (ifx_error_check(status))
+            {
+                readable = false;
+                break;
+            }
+            for (size_t i = 0U; i < chunk_len; i++)
+            {
+                if (current[i] != file->data[chunk_offset + i])
+                {
+                    nbt_provisioning_mark(plan, f, chunk_offset + i);
+                }
+            }
+        }
+
+        // Contents unknown (e.g. not readable via I2C) so whole entry is written
+        if (!readable)
+        {
+            plan->ranges_len = first_range;
+            if (plan->ranges_len >= NBT_PROVISIONING_MAX_RUNS)
+            {
+                plan->overflow = true;
+                break;
+            }
+            plan->ranges[plan->ranges_len++] = (struct nbt_provisioning_range) {.file = (uint8_t) f, .offset = 0U, .length = file->length};
+        }
+    }
+    plan->read_ms = ticks_to_ms(xTaskGetTickCount() - start);
+}
+
+/**
+ * \brief FreeRTOS task running reader stage for all tags whenever notified by nbt_provisioning_run().
+ * \param[in] data Ignored.
+ */
+static void nbt_provisioning_reader(void *data)
+{
+    (void) data;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (size_t tag = 0U; tag < tags_len; tag++)
+        {
+            struct nbt_provisioning_plan *plan = NULL;
+            xQueueReceive(free_plans, &plan, portMAX_DELAY);
+            nbt_provisioning_diff(tag, plan);
+            xQueueSend(ready_plans, &plan, portMAX_DELAY);
+        }
+    }
+}
+
+/**
+ * \brief Writer stage: Applies configuration and differing ranges to a tag.
+ * \param[in] plan Plan computed by reader stage.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_provisioning_apply(const struct nbt_provisioning_plan *plan)
+{
+    const struct nbt_provisioning_tag *tag = &tags[plan->tag];
+    if (ifx_error_check(plan->status))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Tag 0x%02X: could not read current state", tag->address);
+        return plan->status;
+    }
+
+    // Configuration switches to configurator application so NBT application is reselected before releasing bus
+    TickType_t start = xTaskGetTickCount();
+    profiled_mutex_take(bus, portMAX_DELAY);
+    ifx_status_t status = nbt_configure(tag->nbt, &image.configuration);
+    if (!ifx_error_check(status))
+    {
+        status = nbt_select_nbt_application(tag->nbt);
+    }
+    profiled_mutex_give(bus);
+    if (ifx_error_check(status))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Tag 0x%02X: could not apply configuration", tag->address);
+        return status;
+    }
+    TickType_t configured = xTaskGetTickCount();
+
+    size_t written = 0U;
+    size_t writes = plan->overflow ? image.files_len : plan->ranges_len;
+    for (size_t i = 0U; i < writes; i++)
+    {
+        struct nbt_provisioning_range range = {.file = (uint8_t) i, .offset = 0U, .length = image.files[i].length};
+        if (!plan->overflow)
+        {
+            range = plan->ranges[i];
+        }
+        const struct nbt_provisioning_file *file = &image.files[range.file];
+        profiled_mutex_take(bus, portMAX_DELAY);
+        status = nbt_write_file(tag->nbt, (enum nbt_fileid) file->file_id, file->offset + range.offset, file->data + range.offset, range.length);
+        profiled_mutex_give(bus);
+        if (ifx_error_check(status))
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Tag 0x%02X: could not write file 0x%04X", tag->address, file->file_id);
+            return status;
+        }
+        written += range.length;
+    }
+    TickType_t end = xTaskGetTickCount();
+
+    // clang-format off
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "Tag 0x%02X: read %lu ms, configure %lu ms, write %lu ms (%u bytes in %u writes)",
+                   tag->address, (unsigned long) plan->read_ms, (unsigned long) ticks_to_ms(configured - start), (unsigned long) ticks_to_ms(end - configured),
+                   (unsigned int) written, (unsigned int) writes);
+    // clang-format on
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Adds already activated NBT to the tags being provisioned.
+ *
+ * \param[in] nbt NBT command abstraction (must stay valid).
+ * \param[in] address I2C address of NBT used for reporting.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_provisioning_add_tag(nbt_cmd_t *nbt, uint8_t address)
+{
+    if ((nbt == NULL) || (tags_len >= NBT_PROVISIONING_MAX_TAGS))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+    }
+    tags[tags_len++] = (struct nbt_provisioning_tag) {.nbt = nbt, .address = address, .activated = true, .protocol = NULL};
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Sets up communication stack for an additional NBT (e.g. on a line station) and adds it to the tags being provisioned.
+ *
+ * \param[in] i2c I2C driver of bus NBT is connected to.
+ * \param[in] address I2C address of NBT.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_provisioning_attach_tag(cyhal_i2c_t *i2c, uint8_t address)
+{
+    if ((i2c == NULL) || (tags_len >= NBT_PROVISIONING_MAX_TAGS) || (stacks_len >= NBT_PROVISIONING_MAX_TAGS))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+    }
+    struct nbt_provisioning_stack *stack = &stacks[stacks_len];
+    ifx_status_t status = nbt_i2c_adapter_initialize(&stack->driver, i2c, address);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+    status = ifx_t1prime_initialize(&stack->protocol, &stack->driver.protocol);
+    if (ifx_error_check(status))
+    {
+        ifx_protocol_destroy(&stack->driver.protocol);
+        return status;
+    }
+    ifx_protocol_set_logger(&stack->protocol, ifx_logger_default);
+    status = nbt_initialize(&stack->nbt, &stack->protocol, ifx_logger_default);
+    if (ifx_error_check(status))
+    {
+        ifx_protocol_destroy(&stack->protocol);
+        return status;
+    }
+    stacks_len++;
+
+    // Activated by reader stage while holding bus lock
+    tags[tags_len++] = (struct nbt_provisioning_tag) {.nbt = &stack->nbt, .address = address, .activated = false, .protocol = &stack->protocol};
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Applies manifest to all added tags using minimal writes and logs timing per step.
+ *
+ * \details Write budget enforcement is suspended during provisioning, writes to tags other than the primary NBT (see nbt_set_primary()) are
+ *          not accounted at all. Password bindings are reset by nbt_configure().
+ *
+ * \param[in] manifest Binary manifest (must stay valid during call).
+ * \param[in] manifest_len Number of bytes in \c manifest.
+ * \param[in] bus_lock Lock guarding I2C bus shared with other NBT users.
+ * \return ifx_status_t \c IFX_SUCCESS if all tags have been provisioned, any other value in case of error.
+ */
+ifx_status_t nbt_provisioning_run(const uint8_t *manifest, size_t manifest_len, struct profiled_mutex *bus_lock)
+{
+    if ((manifest == NULL) || (bus_lock == NULL) || (tags_len == 0U))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+    }
+    ifx_status_t status = nbt_provisioning_parse(manifest, manifest_len);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+    if (free_plans == NULL)
+    {
+        free_plans = xQueueCreateStatic(NBT_PROVISIONING_PLANS, sizeof(struct nbt_provisioning_plan *), free_plans_storage, &free_plans_queue);
+        ready_plans = xQueueCreateStatic(NBT_PROVISIONING_PLANS, sizeof(struct nbt_provisioning_plan *), ready_plans_storage, &ready_plans_queue);
+        if ((free_plans == NULL) || (ready_plans == NULL))
+        {
+            return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_OUT_OF_MEMORY);
+        }
+    }
+    for (size_t i = 0U; i < NBT_PROVISIONING_PLANS; i++)
+    {
+        struct nbt_provisioning_plan *plan = &plans[i];
+        xQueueSend(free_plans, &plan, 0U);
+    }
+    bus = bus_lock;
+
+    // Reader stage runs ahead in its own task, writer stage in calling task
+    TickType_t start = xTaskGetTickCount();
+    nbt_write_budget_enforce(false);
+    if (reader_task_handle == NULL)
+    {
+        reader_task_handle = xTaskCreateStatic(nbt_provisioning_reader, (char *) "Provisioning", NBT_PROVISIONING_READER_STACK_DEPTH, 0U,
+                                               uxTaskPriorityGet(NULL), reader_stack, &reader_task);
+    }
+    if (reader_task_handle == NULL)
+    {
+        nbt_write_budget_enforce(true);
+        xQueueReset(free_plans);
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_OUT_OF_MEMORY);
+    }
+    xTaskNotifyGive(reader_task_handle);
+    size_t provisioned = 0U;
+    for (size_t tag = 0U; tag < tags_len; tag++)
+    {
+        struct nbt_provisioning_plan *plan = NULL;
+        xQueueReceive(ready_plans, &plan, portMAX_DELAY);
+        ifx_status_t tag_status = nbt_provisioning_apply(plan);
+        if (ifx_error_check(tag_status))
+        {
+            status = tag_status;
+        }
+        else
+        {
+            provisioned++;
+        }
+        xQueueSend(free_plans, &plan, 0U);
+    }
+    xQueueReset(free_plans);
+    nbt_write_budget_enforce(true);
+
+    // clang-format off
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "Provisioned %u of %u tags in %lu ms",
+                   (unsigned int) provisioned, (unsigned int) tags_len, (unsigned long) ticks_to_ms(xTaskGetTickCount() - start));
+    // clang-format on
+    return status;
+}
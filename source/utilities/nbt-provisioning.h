@@ -0,0 +1,143 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-provisioning.h
+ * \brief Factory provisioning of one or more NBTs from a compact binary manifest.
+ * \details Manifest format (multi-byte values big endian):
+ *     * Header: magic "NBTM", 1B version (NBT_PROVISIONING_VERSION), 1B number of entries
+ *     * FAP entry: 1B type (NBT_PROVISIONING_ENTRY_FAP), 2B file ID, 1B I2C read, 1B I2C write, 1B NFC read, 1B NFC write access condition
+ *     * Configuration entry: 1B type (NBT_PROVISIONING_ENTRY_CONFIGURATION), 1B key (enum nbt_provisioning_configuration_key), 1B value
+ *     * File entry: 1B type (NBT_PROVISIONING_ENTRY_FILE), 2B file ID, 2B offset, 2B length, data
+ *     * Optional integrity entry (last entry only): 1B type (NBT_PROVISIONING_ENTRY_CRC), 2B CRC-16/X.25 of all preceding manifest bytes
+ * \details Tags are processed in a two stage pipeline: while the writer applies the image to tag N, a reader task already reads tag N+1 and
+ *          computes the minimal set of differing file ranges. Both stages share the I2C bus via a lock taken per file operation.
+ */
+#ifndef NBT_PROVISIONING_H
+#define NBT_PROVISIONING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cyhal.h"
+
+#include "infineon/ifx-error.h"
+#include "infineon/nbt-cmd.h"
+
+#include "profiled-mutex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Maximum number of tags provisioned in one run.
+ */
+#ifndef NBT_PROVISIONING_MAX_TAGS
+#define NBT_PROVISIONING_MAX_TAGS 4U
+#endif
+
+/**
+ * \brief Maximum number of file entries in a manifest.
+ */
+#ifndef NBT_PROVISIONING_MAX_FILES
+#define NBT_PROVISIONING_MAX_FILES 8U
+#endif
+
+/**
+ * \brief Maximum number of differing ranges written per tag (all file entries are written completely if exceeded).
+ */
+#ifndef NBT_PROVISIONING_MAX_RUNS
+#define NBT_PROVISIONING_MAX_RUNS 32U
+#endif
+
+/**
+ * \brief Maximum number of equal bytes between two differing ranges for which both are merged into a single write.
+ */
+#ifndef NBT_PROVISIONING_MERGE_GAP
+#define NBT_PROVISIONING_MERGE_GAP 8U
+#endif
+
+/**
+ * \brief Current manifest format version.
+ */
+#define NBT_PROVISIONING_VERSION 0x01U
+
+/** \enum nbt_provisioning_entry_type
+ * \brief Types of manifest entries.
+ */
+enum nbt_provisioning_entry_type
+{
+    /**
+     * \brief File access policy of a single file.
+     */
+    NBT_PROVISIONING_ENTRY_FAP = 0x01U,
+
+    /**
+     * \brief Configurator application setting.
+     */
+    NBT_PROVISIONING_ENTRY_CONFIGURATION = 0x02U,
+
+    /**
+     * \brief File contents.
+     */
+    NBT_PROVISIONING_ENTRY_FILE = 0x03U,
+
+    /**
+     * \brief CRC-16/X.25 of manifest (see crc16_x25()).
+     */
+    NBT_PROVISIONING_ENTRY_CRC = 0x04U
+};
+
+/** \enum nbt_provisioning_configuration_key
+ * \brief Configurator application settings available in manifest.
+ */
+enum nbt_provisioning_configuration_key
+{
+    /**
+     * \brief NBT interface configuration (nbt_communication_interface_tags).
+     */
+    NBT_PROVISIONING_CONFIGURATION_COMMUNICATION_INTERFACE = 0x01U,
+
+    /**
+     * \brief NBT interrupt pin configuration (nbt_gpio_function_tags).
+     */
+    NBT_PROVISIONING_CONFIGURATION_GPIO_FUNCTION = 0x02U
+};
+
+/**
+ * \brief Adds already activated NBT to the tags being provisioned.
+ *
+ * \param[in] nbt NBT command abstraction (must stay valid).
+ * \param[in] address I2C address of NBT used for reporting.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_provisioning_add_tag(nbt_cmd_t *nbt, uint8_t address);
+
+/**
+ * \brief Sets up communication stack for an additional NBT (e.g. on a line station) and adds it to the tags being provisioned.
+ *
+ * \param[in] i2c I2C driver of bus NBT is connected to.
+ * \param[in] address I2C address of NBT.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_provisioning_attach_tag(cyhal_i2c_t *i2c, uint8_t address);
+
+/**
+ * \brief Applies manifest to all added tags using minimal writes and logs timing per step.
+ *
+ * \details Write budget enforcement is suspended during provisioning, writes to tags other than the primary NBT (see nbt_set_primary()) are
+ *          not accounted at all. Password bindings are reset by nbt_configure().
+ *
+ * \param[in] manifest Binary manifest (must stay valid during call).
+ * \param[in] manifest_len Number of bytes in \c manifest.
+ * \param[in] bus_lock Lock guarding I2C bus shared with other NBT users.
+ * \return ifx_status_t \c IFX_SUCCESS if all tags have been provisioned, any other value in case of error.
+ */
+ifx_status_t nbt_provisioning_run(const uint8_t *manifest, size_t manifest_len, struct profiled_mutex *bus_lock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NBT_PROVISIONING_H
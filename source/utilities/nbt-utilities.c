@@ -20,17 +20,283 @@
 #include "infineon/nbt-cmd-config.h"
 #include "infineon/nbt-cmd.h"
 
+#include "log-limiter.h"
+#include "nbt-pipeline.h"
 #include "nbt-utilities.h"
+#include "nbt-write-budget.h"
 
 /**
  * \brief String used as source information for logging.
  */
 #define LOG_TAG "NBT utilities"
 
+/**
+ * \brief Tag of NDEF file control TLV in capability container.
+ */
+#define NBT_CC_TAG_NDEF_FILE_CONTROL 0x04U
+
+/**
+ * \brief Tag of proprietary file control TLV in capability container.
+ */
+#define NBT_CC_TAG_PROPRIETARY_FILE_CONTROL 0x05U
+
+/**
+ * \brief Tag of extended NDEF file control TLV in capability container.
+ */
+#define NBT_CC_TAG_EXTENDED_NDEF_FILE_CONTROL 0x06U
+
+/**
+ * \brief Offset of first file control TLV in capability container.
+ */
+#define NBT_CC_TLV_OFFSET 7U
+
+/**
+ * \brief NBT whose capability container is cached and whose writes are accounted (see nbt_set_primary()).
+ */
+static const nbt_cmd_t *primary_nbt = NULL;
+
+/**
+ * \brief Capability container of primary_nbt cached after first successful NBT application selection.
+ */
+static struct nbt_capability_container capability_container;
+
+/**
+ * \brief Simple flag if capability_container holds valid data.
+ */
+static bool capability_container_valid = false;
+
+/**
+ * \brief Password bindings of a single NBT as set via nbt_configure().
+ */
+struct nbt_password_context
+{
+    /**
+     * \brief NBT the password bindings belong to (\c NULL if unused).
+     */
+    const nbt_cmd_t *nbt;
+
+    /**
+     * \brief Passwords for password protected files.
+     */
+    struct nbt_password_binding bindings[NBT_MAX_PASSWORD_BINDINGS];
+
+    /**
+     * \brief Number of valid entries in nbt_password_context.bindings.
+     */
+    size_t bindings_len;
+};
+
+/**
+ * \brief Password bindings per NBT.
+ */
+static struct nbt_password_context password_contexts[NBT_MAX_PASSWORD_CONTEXTS];
+
+/**
+ * \brief Looks up password bindings of NBT.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \return struct nbt_password_context * Password bindings or \c NULL if none have been set for \c nbt.
+ */
+static struct nbt_password_context *nbt_password_context(const nbt_cmd_t *nbt)
+{
+    for (size_t i = 0U; i < NBT_MAX_PASSWORD_CONTEXTS; i++)
+    {
+        if (password_contexts[i].nbt == nbt)
+        {
+            return &password_contexts[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Sets password bindings of NBT, replacing any previous bindings.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \param[in] passwords Password bindings (may be \c NULL if \c passwords_len is \c 0).
+ * \param[in] passwords_len Number of password bindings in \c passwords.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_password_set(const nbt_cmd_t *nbt, const struct nbt_password_binding *passwords, size_t passwords_len)
+{
+    struct nbt_password_context *context = nbt_password_context(nbt);
+    if (context != NULL)
+    {
+        memset(context, 0x00, sizeof(struct nbt_password_context));
+    }
+    if (passwords_len == 0U)
+    {
+        return IFX_SUCCESS;
+    }
+    context = nbt_password_context(NULL);
+    if (context == NULL)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "No free slot for password bindings (see NBT_MAX_PASSWORD_CONTEXTS)");
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_OUT_OF_MEMORY);
+    }
+    context->nbt = nbt;
+    memcpy(context->bindings, passwords, passwords_len * sizeof(struct nbt_password_binding));
+    context->bindings_len = passwords_len;
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Returns password to be sent along with READ BINARY and UPDATE BINARY of file.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \param[in] file_id NBT file being accessed.
+ * \return const uint8_t * Password (NBT_PASSWORD_LEN bytes) or \c NULL if file is not password protected.
+ */
+static const uint8_t *nbt_password(const nbt_cmd_t *nbt, enum nbt_fileid file_id)
+{
+    const struct nbt_password_context *context = nbt_password_context(nbt);
+    if (context == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0U; i < context->bindings_len; i++)
+    {
+        if (context->bindings[i].file_id == file_id)
+        {
+            return context->bindings[i].password;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Issues command reading all file access policies.
+ *
+ * \param[in,out] request Pipeline request with array of 7 nbt_file_access_policy_t as context.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_issue_read_fap(struct nbt_pipeline_request *request)
+{
+    return nbt_read_fap(request->nbt, (nbt_file_access_policy_t *) request->context);
+}
+
+/**
+ * \brief Issues command updating a single file access policy.
+ *
+ * \param[in,out] request Pipeline request with nbt_file_access_policy_t as context.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_issue_update_fap(struct nbt_pipeline_request *request)
+{
+    return nbt_update_fap(request->nbt, (nbt_file_access_policy_t *) request->context);
+}
+
+/**
+ * \brief Configurator application setting passed to nbt_issue_set_configuration().
+ */
+struct nbt_configuration_setting
+{
+    /**
+     * \brief Configuration tag.
+     */
+    uint8_t tag;
+
+    /**
+     * \brief Value to be set.
+     */
+    uint8_t value;
+};
+
+/**
+ * \brief Issues command setting a single configurator application setting.
+ *
+ * \param[in,out] request Pipeline request with struct nbt_configuration_setting as context.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_issue_set_configuration(struct nbt_pipeline_request *request)
+{
+    const struct nbt_configuration_setting *setting = (const struct nbt_configuration_setting *) request->context;
+    return nbt_set_configuration(request->nbt, setting->tag, setting->value);
+}
+
+/**
+ * \brief Issues command fetching data received via pass-through mode.
+ *
+ * \param[in,out] request Pipeline request.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_issue_pass_through_fetch(struct nbt_pipeline_request *request)
+{
+    return nbt_pass_through_fetch_data(request->nbt, request->nbt->response);
+}
+
+/**
+ * \brief Issues command sending response via pass-through mode.
+ *
+ * \param[in,out] request Pipeline request with ifx_apdu_response_t to be sent as context.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_issue_pass_through_put(struct nbt_pipeline_request *request)
+{
+    return nbt_pass_through_put_response(request->nbt, (ifx_apdu_response_t *) request->context, request->nbt->response);
+}
+
+/**
+ * \brief Returns maximum number of data bytes per READ BINARY command.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \return size_t MLe of cached capability container (primary NBT only) limited by NBT_APDU_CHUNK_LIMIT.
+ */
+static size_t nbt_read_chunk_size(const nbt_cmd_t *nbt)
+{
+    if ((nbt == primary_nbt) && capability_container_valid && (capability_container.mle > 0U) && (capability_container.mle < NBT_APDU_CHUNK_LIMIT))
+    {
+        return capability_container.mle;
+    }
+    return NBT_APDU_CHUNK_LIMIT;
+}
+
+/**
+ * \brief Returns maximum number of data bytes per UPDATE BINARY command.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \return size_t MLc of cached capability container (primary NBT only) limited by NBT_APDU_CHUNK_LIMIT.
+ */
+static size_t nbt_write_chunk_size(const nbt_cmd_t *nbt)
+{
+    if ((nbt == primary_nbt) && capability_container_valid && (capability_container.mlc > 0U) && (capability_container.mlc < NBT_APDU_CHUNK_LIMIT))
+    {
+        return capability_container.mlc;
+    }
+    return NBT_APDU_CHUNK_LIMIT;
+}
+
+/**
+ * \brief Returns maximum size of NBT file.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \param[in] file_id NBT file to get size for.
+ * \return size_t Maximum file size in bytes (NBT_FILE_SIZE_FALLBACK for NBTs other than the primary NBT).
+ */
+static size_t nbt_file_size(const nbt_cmd_t *nbt, enum nbt_fileid file_id)
+{
+    return (nbt == primary_nbt) ? nbt_get_file_size(file_id) : NBT_FILE_SIZE_FALLBACK;
+}
+
+/**
+ * \brief Sets the NBT whose capability container is cached and whose writes are accounted via nbt-write-budget.h.
+ *
+ * \details Other NBTs (e.g. line station tags during factory provisioning) use default file limits and bypass write accounting and
+ *          deferral.
+ *
+ * \param[in] nbt NBT command abstraction of on-board NBT.
+ */
+void nbt_set_primary(const nbt_cmd_t *nbt)
+{
+    primary_nbt = nbt;
+    capability_container_valid = false;
+}
+
 /**
  * \brief Selects NBT (operational) application.
  *
  * \details Wraps select_application() and adds cleanup.
+ * \details Reads and caches capability container on first successful selection of the primary NBT (see nbt_set_primary()).
  *
  * \param[in] nbt NBT command abstraction.
  * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
@@ -42,23 +308,165 @@ ifx_status_t nbt_select_nbt_application(nbt_cmd_t *nbt)
     {
         return IFX_ERROR(LIB_NBT_APDU, NBT_SELECT_APPLICATION, IFX_ILLEGAL_ARGUMENT);
     }
-    ifx_status_t status = nbt_select_application(nbt);
-    ifx_apdu_destroy(nbt->apdu);
+    struct nbt_pipeline_request request = {.nbt = nbt, .kind = NBT_PIPELINE_SELECT_APPLICATION, .function = NBT_SELECT_APPLICATION};
+    ifx_status_t status = nbt_pipeline_execute(&request);
     if (ifx_error_check(status))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not select NBT application");
         return status;
     }
-    if (nbt->response->sw != 0x9000U)
+
+    // Capability container only changes with personalization so it is read once
+    if ((nbt == primary_nbt) && !capability_container_valid)
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for selecting NBT application: 0x%04X", nbt->response->sw);
-        ifx_apdu_response_destroy(nbt->response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_SELECT_APPLICATION, IFX_SW_ERROR);
+        if (ifx_error_check(nbt_read_capability_container(nbt, &capability_container)))
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not read capability container - using default file limits");
+        }
+        else
+        {
+            capability_container_valid = true;
+        }
     }
-    ifx_apdu_response_destroy(nbt->response);
     return IFX_SUCCESS;
 }
 
+/**
+ * \brief Reads and parses NFC capability container (CC) file.
+ *
+ * \details NBT application must already be selected.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \param[out] cc Buffer to store parsed capability container in.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ * \see nbt_read_file()
+ */
+ifx_status_t nbt_read_capability_container(nbt_cmd_t *nbt, struct nbt_capability_container *cc)
+{
+    if ((nbt == NULL) || (cc == NULL))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_ILLEGAL_ARGUMENT);
+    }
+
+    // Read CCLEN first to only read as many bytes as actually available
+    uint8_t raw[NBT_CC_MAX_LEN];
+    ifx_status_t status = nbt_read_file(nbt, NBT_FILEID_CC, 0U, 2U, raw);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+    size_t cc_len = (raw[0] << 8) | raw[1];
+    if (cc_len < NBT_CC_TLV_OFFSET)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid capability container length: %u", (unsigned int) cc_len);
+        return IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_PROGRAMMING_ERROR);
+    }
+    if (cc_len > sizeof(raw))
+    {
+        cc_len = sizeof(raw);
+    }
+    status = nbt_read_file(nbt, NBT_FILEID_CC, 2U, cc_len - 2U, raw + 2U);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+
+    // Parse fixed header
+    memset(cc, 0x00, sizeof(struct nbt_capability_container));
+    cc->len = (raw[0] << 8) | raw[1];
+    cc->mapping_version = raw[2];
+    cc->mle = (raw[3] << 8) | raw[4];
+    cc->mlc = (raw[5] << 8) | raw[6];
+
+    // Parse file control TLVs
+    size_t offset = NBT_CC_TLV_OFFSET;
+    while (((offset + 2U) <= cc_len) && (cc->files_len < NBT_CC_MAX_FILE_CONTROLS))
+    {
+        uint8_t tag = raw[offset];
+        uint8_t len = raw[offset + 1U];
+        const uint8_t *value = raw + offset + 2U;
+        if ((offset + 2U + len) > cc_len)
+        {
+            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Capability container TLV 0x%02X exceeds CCLEN - ignored", tag);
+            break;
+        }
+        struct nbt_file_control *file = &cc->files[cc->files_len];
+        if (((tag == NBT_CC_TAG_NDEF_FILE_CONTROL) || (tag == NBT_CC_TAG_PROPRIETARY_FILE_CONTROL)) && (len == 6U))
+        {
+            file->file_id = (value[0] << 8) | value[1];
+            file->max_size = (value[2] << 8) | value[3];
+            file->read_access = value[4];
+            file->write_access = value[5];
+            cc->files_len++;
+        }
+        else if ((tag == NBT_CC_TAG_EXTENDED_NDEF_FILE_CONTROL) && (len == 8U))
+        {
+            file->file_id = (value[0] << 8) | value[1];
+            file->max_size = ((uint32_t) value[2] << 24) | ((uint32_t) value[3] << 16) | ((uint32_t) value[4] << 8) | value[5];
+            file->read_access = value[6];
+            file->write_access = value[7];
+            cc->files_len++;
+        }
+        offset += 2U + len;
+    }
+
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_DEBUG, "Capability container: MLe %u, MLc %u, %u file(s)", cc->mle, cc->mlc, (unsigned int) cc->files_len);
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Returns capability container of primary NBT cached during nbt_select_nbt_application().
+ *
+ * \return const struct nbt_capability_container * Cached capability container or \c NULL if not read yet.
+ */
+const struct nbt_capability_container *nbt_get_capability_container(void)
+{
+    return capability_container_valid ? &capability_container : NULL;
+}
+
+/**
+ * \brief Returns file control information for a given file as declared in the cached capability container of the primary NBT.
+ *
+ * \param[in] file_id NBT file to get file control information for.
+ * \return const struct nbt_file_control * File control information or \c NULL if file not described by capability container.
+ */
+const struct nbt_file_control *nbt_get_file_control(enum nbt_fileid file_id)
+{
+    if (!capability_container_valid)
+    {
+        return NULL;
+    }
+    for (size_t i = 0U; i < capability_container.files_len; i++)
+    {
+        if (capability_container.files[i].file_id == file_id)
+        {
+            return &capability_container.files[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Returns maximum size of file of primary NBT.
+ *
+ * \details Uses cached capability container and falls back to NBT_FILE_SIZE_FALLBACK for undeclared files.
+ *
+ * \param[in] file_id NBT file to get size for.
+ * \return size_t Maximum file size in bytes.
+ */
+size_t nbt_get_file_size(enum nbt_fileid file_id)
+{
+    if (capability_container_valid && (file_id == NBT_FILEID_CC))
+    {
+        return capability_container.len;
+    }
+    const struct nbt_file_control *file = nbt_get_file_control(file_id);
+    if (file != NULL)
+    {
+        return file->max_size;
+    }
+    return NBT_FILE_SIZE_FALLBACK;
+}
+
 /**
  * \brief Configures NBT according to given configuration.
  *
@@ -73,9 +481,20 @@ ifx_status_t nbt_configure(nbt_cmd_t *nbt, const struct nbt_configuration *confi
     {
         return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
     }
+    if ((configuration->passwords_len > NBT_MAX_PASSWORD_BINDINGS) || ((configuration->passwords_len > 0U) && (configuration->passwords == NULL)))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_ILLEGAL_ARGUMENT);
+    }
+
+    // Remember passwords for password protected files of this NBT
+    ifx_status_t status = nbt_password_set(nbt, configuration->passwords, configuration->passwords_len);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
 
     // Update file access policies
-    ifx_status_t status = nbt_select_nbt_application(nbt);
+    status = nbt_select_nbt_application(nbt);
     if (ifx_error_check(status))
     {
         ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not select NBT application");
@@ -84,20 +503,17 @@ ifx_status_t nbt_configure(nbt_cmd_t *nbt, const struct nbt_configuration *confi
 
     // Get current file access policies
     nbt_file_access_policy_t current_faps[7];
-    status = nbt_read_fap(nbt, current_faps);
-    ifx_apdu_destroy(nbt->apdu);
+    struct nbt_pipeline_request read_fap = {.nbt = nbt,
+                                            .kind = NBT_PIPELINE_OTHER,
+                                            .function = NBT_UPDATE_FAP_BYTES_WITH_PASSWORD,
+                                            .issue = nbt_issue_read_fap,
+                                            .context = current_faps,
+                                            .description = "read file access policies"};
+    status = nbt_pipeline_execute(&read_fap);
     if (ifx_error_check(status))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not read current file access policies");
         return status;
     }
-    if (nbt->response->sw != 0x9000U)
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for reading file access policy: 0x%04X", nbt->response->sw);
-        ifx_apdu_response_destroy(nbt->response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_FAP_BYTES_WITH_PASSWORD, IFX_SW_ERROR);
-    }
-    ifx_apdu_response_destroy(nbt->response);
 
     // Check file access policies to be updated
     for (size_t i = 0U; i < configuration->fap_len; i++)
@@ -112,24 +528,22 @@ ifx_status_t nbt_configure(nbt_cmd_t *nbt, const struct nbt_configuration *confi
                 // Check if file access policy needs to be updated
                 if (memcmp(configuration->fap[i], &current_faps[j], sizeof(nbt_file_access_policy_t)) != 0)
                 {
-                    status = nbt_update_fap(nbt, configuration->fap[i]);
-                    ifx_apdu_destroy(nbt->apdu);
+                    struct nbt_pipeline_request update_fap = {.nbt = nbt,
+                                                              .kind = NBT_PIPELINE_OTHER,
+                                                              .function = NBT_UPDATE_FAP_BYTES_WITH_PASSWORD,
+                                                              .file_id = configuration->fap[i]->file_id,
+                                                              .issue = nbt_issue_update_fap,
+                                                              .context = configuration->fap[i],
+                                                              .description = "update file access policy"};
+                    status = nbt_pipeline_execute(&update_fap);
                     if (ifx_error_check(status))
                     {
-                        // clang-format off
-                        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not update file access policy for file 0x%04X", configuration->fap[i]->file_id);
-                        // clang-format on
                         return status;
                     }
-                    if (nbt->response->sw != 0x9000U)
+                    if (nbt == primary_nbt)
                     {
-                        // clang-format off
-                        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for updating file access policy: 0x%04X", nbt->response->sw);
-                        // clang-format on
-                        ifx_apdu_response_destroy(nbt->response);
-                        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_FAP_BYTES_WITH_PASSWORD, IFX_SW_ERROR);
+                        nbt_write_budget_record(NBT_WRITE_REGION_FAP, 0U, 1U, false);
                     }
-                    ifx_apdu_response_destroy(nbt->response);
                 }
                 break;
             }
@@ -142,48 +556,34 @@ ifx_status_t nbt_configure(nbt_cmd_t *nbt, const struct nbt_configuration *confi
     }
 
     // Set interface configuration
-    status = nbt_select_configurator_application(nbt);
-    ifx_apdu_destroy(nbt->apdu);
+    struct nbt_pipeline_request select = {.nbt = nbt, .kind = NBT_PIPELINE_SELECT_CONFIGURATOR, .function = NBT_SELECT_CONFIGURATOR};
+    status = nbt_pipeline_execute(&select);
     if (ifx_error_check(status))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not select NBT configurator application");
         return status;
     }
-    if (nbt->response->sw != 0x9000U)
+    const struct nbt_configuration_setting settings[] = {
+        {.tag = NBT_TAG_COMMUNICATION_INTERFACE_ENABLE, .value = configuration->communication_interface},
+        {.tag = NBT_TAG_GPIO_FUNCTION, .value = configuration->irq_function},
+    };
+    for (size_t i = 0U; i < (sizeof(settings) / sizeof(settings[0])); i++)
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for selecting NBT configurator application: 0x%04X", nbt->response->sw);
-        ifx_apdu_response_destroy(nbt->response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_SELECT_CONFIGURATOR, IFX_SW_ERROR);
-    }
-    ifx_apdu_response_destroy(nbt->response);
-    status = nbt_set_configuration(nbt, NBT_TAG_COMMUNICATION_INTERFACE_ENABLE, configuration->communication_interface);
-    ifx_apdu_destroy(nbt->apdu);
-    if (ifx_error_check(status))
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not configure NBT interface availability");
-        return status;
-    }
-    if (nbt->response->sw != 0x9000U)
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for configuring NBT interface availability: 0x%04X", nbt->response->sw);
-        ifx_apdu_response_destroy(nbt->response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_SW_ERROR);
-    }
-    ifx_apdu_response_destroy(nbt->response);
-    status = nbt_set_configuration(nbt, NBT_TAG_GPIO_FUNCTION, configuration->irq_function);
-    ifx_apdu_destroy(nbt->apdu);
-    if (ifx_error_check(status))
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not configure NBT GPIO/IRQ functionality");
-        return status;
-    }
-    if (nbt->response->sw != 0x9000U)
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for configuring NBT GPIO/IRQ functionality: 0x%04X", nbt->response->sw);
-        ifx_apdu_response_destroy(nbt->response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_SET_CONFIGURATION, IFX_SW_ERROR);
+        struct nbt_pipeline_request set = {.nbt = nbt,
+                                           .kind = NBT_PIPELINE_OTHER,
+                                           .function = NBT_SET_CONFIGURATION,
+                                           .issue = nbt_issue_set_configuration,
+                                           .context = (void *) &settings[i],
+                                           .description = "set NBT configuration"};
+        status = nbt_pipeline_execute(&set);
+        if (ifx_error_check(status))
+        {
+            return status;
+        }
+        if (nbt == primary_nbt)
+        {
+            nbt_write_budget_record(NBT_WRITE_REGION_CONFIGURATION, 0U, 1U, false);
+        }
     }
-    ifx_apdu_response_destroy(nbt->response);
 
     return IFX_SUCCESS;
 }
@@ -192,6 +592,7 @@ ifx_status_t nbt_configure(nbt_cmd_t *nbt, const struct nbt_configuration *confi
  * \brief Reads data from NBT file.
  *
  * \details Combines nbt_select_file_by_id() and (potentially) multiple calls to nbt_read_binary() to get file's contents.
+ * \details The password of password protected files (see nbt_configuration.passwords) is sent along with each command.
  *
  * \param[in] nbt NBT command abstraction.
  * \param[in] file_id NBT file to be read.
@@ -205,52 +606,93 @@ ifx_status_t nbt_configure(nbt_cmd_t *nbt, const struct nbt_configuration *confi
 ifx_status_t nbt_read_file(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t offset, size_t length, uint8_t *buffer)
 {
     // Validate parameters
-    if ((nbt == NULL) || (buffer == NULL) || ((offset + length) > 4096U))
+    if ((nbt == NULL) || (buffer == NULL) || ((offset + length) > nbt_file_size(nbt, file_id)))
     {
         return IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_ILLEGAL_ARGUMENT);
     }
 
     // Select file to be read
-    ifx_status_t status = nbt_select_file(nbt, file_id);
-    ifx_apdu_destroy(nbt->apdu);
+    struct nbt_pipeline_request select = {.nbt = nbt, .kind = NBT_PIPELINE_SELECT_FILE, .function = NBT_READ_BINARY, .file_id = file_id};
+    ifx_status_t status = nbt_pipeline_execute(&select);
     if (ifx_error_check(status))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not select NBT file 0x%04X", file_id);
         return status;
     }
-    if (nbt->response->sw != 0x9000U)
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for selecting NBT file 0x%04X: 0x%04X", file_id, nbt->response->sw);
-        ifx_apdu_response_destroy(nbt->response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_SW_ERROR);
-    }
-    ifx_apdu_response_destroy(nbt->response);
 
     // Actually read file in chunks
-    for (size_t chunk_offset = 0U; chunk_offset < length; chunk_offset += 0xFFU)
+    const uint8_t *password = nbt_password(nbt, file_id);
+    size_t chunk_size = nbt_read_chunk_size(nbt);
+    size_t chunk_offset = 0U;
+    while (chunk_offset < length)
     {
-        uint8_t chunk_len = ((length - (offset + chunk_offset)) < 0xFFU) ? (length - (offset + chunk_offset)) : 0xFFU;
-        status = nbt_read_binary(nbt, offset + chunk_offset, chunk_len);
-        ifx_apdu_destroy(nbt->apdu);
+        size_t chunk_len = ((length - chunk_offset) < chunk_size) ? (length - chunk_offset) : chunk_size;
+        struct nbt_pipeline_request read = {.nbt = nbt,
+                                            .kind = NBT_PIPELINE_READ_BINARY,
+                                            .function = NBT_READ_BINARY,
+                                            .file_id = file_id,
+                                            .offset = offset + chunk_offset,
+                                            .length = chunk_len,
+                                            .data = buffer + chunk_offset,
+                                            .password = password};
+        status = nbt_pipeline_execute(&read);
         if (ifx_error_check(status))
         {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not read NBT file 0x%04X", file_id);
             return status;
         }
-        if (nbt->response->sw != 0x9000U)
+        chunk_offset += chunk_len;
+    }
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Writes data to NBT file without checking the NVM write budget.
+ *
+ * \details Used by nbt_write_file() and nbt_write_deferred() once the write has been cleared to be performed.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \param[in] file_id NBT file to be written.
+ * \param[in] offset Offset within NBT file.
+ * \param[in] data Data to be written.
+ * \param[in] length Number of bytes in \c data.
+ * \param[in] acquired \c true if budget has already been consumed for this write (ignored for NBTs other than the primary NBT).
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+static ifx_status_t nbt_write_file_now(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t offset, const uint8_t *data, size_t length, bool acquired)
+{
+    // Select file to be written
+    struct nbt_pipeline_request select = {.nbt = nbt, .kind = NBT_PIPELINE_SELECT_FILE, .function = NBT_UPDATE_BINARY, .file_id = file_id};
+    ifx_status_t status = nbt_pipeline_execute(&select);
+    if (ifx_error_check(status))
+    {
+        return status;
+    }
+
+    // Actually write file in chunks, password of protected files takes up part of the command data
+    enum nbt_write_region region = nbt_write_budget_region(file_id);
+    const uint8_t *password = nbt_password(nbt, file_id);
+    size_t chunk_size = nbt_write_chunk_size(nbt) - ((password != NULL) ? NBT_PASSWORD_LEN : 0U);
+    size_t chunk_offset = 0U;
+    while (chunk_offset < length)
+    {
+        size_t chunk_len = ((length - chunk_offset) < chunk_size) ? (length - chunk_offset) : chunk_size;
+        struct nbt_pipeline_request update = {.nbt = nbt,
+                                              .kind = NBT_PIPELINE_UPDATE_BINARY,
+                                              .function = NBT_UPDATE_BINARY,
+                                              .file_id = file_id,
+                                              .offset = offset + chunk_offset,
+                                              .length = chunk_len,
+                                              .data = (uint8_t *) (data + chunk_offset),
+                                              .password = password};
+        status = nbt_pipeline_execute(&update);
+        if (ifx_error_check(status))
         {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for reading NBT file 0x%04X: 0x%04X", file_id, nbt->response->sw);
-            ifx_apdu_response_destroy(nbt->response);
-            return IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_SW_ERROR);
+            return status;
         }
-        if (nbt->response->len != chunk_len)
+        if (nbt == primary_nbt)
         {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid data in NBT file 0x%04X", file_id);
-            ifx_apdu_response_destroy(nbt->response);
-            return IFX_ERROR(LIB_NBT_APDU, NBT_READ_BINARY, IFX_PROGRAMMING_ERROR);
+            nbt_write_budget_record(region, offset + chunk_offset, chunk_len, acquired);
         }
-        memcpy(buffer + chunk_offset, nbt->response->data, chunk_len);
-        ifx_apdu_response_destroy(nbt->response);
+        chunk_offset += chunk_len;
     }
     return IFX_SUCCESS;
 }
@@ -259,6 +701,8 @@ ifx_status_t nbt_read_file(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t off
  * \brief Writes data to NBT file.
  *
  * \details Combines nbt_select_file_by_id() and (potentially) multiple calls to nbt_update_binary() to set file's contents.
+ * \details The password of password protected files (see nbt_configuration.passwords) is sent along with each command.
+ * \details Writes to the primary NBT are accounted via nbt_write_budget_record() and deferred if the NVM write budget is exhausted.
  *
  * \param[in] nbt NBT command abstraction.
  * \param[in] file_id NBT file to be written.
@@ -272,45 +716,56 @@ ifx_status_t nbt_read_file(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t off
 ifx_status_t nbt_write_file(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t offset, const uint8_t *data, size_t length)
 {
     // Validate parameters
-    if ((nbt == NULL) || (data == NULL) || ((offset + length) > 4096U))
+    if ((nbt == NULL) || (data == NULL) || ((offset + length) > nbt_file_size(nbt, file_id)))
     {
         return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_ILLEGAL_ARGUMENT);
     }
-
-    // Select file to be written
-    ifx_status_t status = nbt_select_file(nbt, file_id);
-    ifx_apdu_destroy(nbt->apdu);
-    if (ifx_error_check(status))
+    if (nbt != primary_nbt)
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not select NBT file 0x%04X", file_id);
-        return status;
+        return nbt_write_file_now(nbt, file_id, offset, data, length, true);
     }
-    if (nbt->response->sw != 0x9000U)
+
+    // Defer write if NVM write budget is exhausted (or older writes to same range are still pending)
+    bool acquired = !nbt_write_budget_is_deferred(file_id, offset, length) &&
+                    nbt_write_budget_acquire(nbt_write_budget_region(file_id), offset, length);
+    if (!acquired)
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for selecting NBT file 0x%04X: 0x%04X", file_id, nbt->response->sw);
-        ifx_apdu_response_destroy(nbt->response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_SW_ERROR);
+        if (length <= NBT_WRITE_BUDGET_DEFERRED_MAX_LEN)
+        {
+            return nbt_write_budget_defer(file_id, offset, data, length);
+        }
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Write to NBT file 0x%04X exceeds write budget but is too large to be deferred", file_id);
     }
-    ifx_apdu_response_destroy(nbt->response);
+    return nbt_write_file_now(nbt, file_id, offset, data, length, acquired);
+}
 
-    // Actually write file in chunks
-    for (size_t chunk_offset = 0U; chunk_offset < length; chunk_offset += 0xFFU)
+/**
+ * \brief Performs writes previously deferred by nbt_write_file() as far as the NVM write budget allows.
+ *
+ * \details NBT application must already be selected.
+ * \details Writes are performed in order of deferral, a failed write is put back and retried on the next call.
+ *
+ * \param[in] nbt NBT command abstraction of primary NBT.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ * \see nbt_write_file()
+ */
+ifx_status_t nbt_write_deferred(nbt_cmd_t *nbt)
+{
+    if ((nbt == NULL) || (nbt != primary_nbt))
     {
-        uint8_t chunk_len = ((length - (offset + chunk_offset)) < 0xFFU) ? (length - (offset + chunk_offset)) : 0xFFU;
-        status = nbt_update_binary(nbt, offset + chunk_offset, chunk_len, (uint8_t *) (data + chunk_offset));
-        ifx_apdu_destroy(nbt->apdu);
+        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_ILLEGAL_ARGUMENT);
+    }
+    struct nbt_deferred_write write;
+    while (nbt_write_budget_take_deferred(&write))
+    {
+        // Budget already consumed by nbt_write_budget_take_deferred(), must not be deferred again
+        ifx_status_t status = nbt_write_file_now(nbt, (enum nbt_fileid) write.file_id, write.offset, write.data, write.length, true);
         if (ifx_error_check(status))
         {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not write NBT file 0x%04X", file_id);
+            LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not perform deferred write to NBT file 0x%04X", write.file_id);
+            nbt_write_budget_restore(&write);
             return status;
         }
-        if (nbt->response->sw != 0x9000U)
-        {
-            ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for writing NBT file 0x%04X: 0x%04X", file_id, nbt->response->sw);
-            ifx_apdu_response_destroy(nbt->response);
-            return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_SW_ERROR);
-        }
-        ifx_apdu_response_destroy(nbt->response);
     }
     return IFX_SUCCESS;
 }
@@ -334,35 +789,32 @@ ifx_status_t nbt_get_passthrough_apdu(nbt_cmd_t *nbt, ifx_apdu_t *apdu_buffer)
     }
 
     // Fetch generic data from NBT
-    ifx_apdu_response_t apdu_response = {0};
-    ifx_status_t status = nbt_pass_through_fetch_data(nbt, &apdu_response);
-    ifx_apdu_destroy(nbt->apdu);
+    struct nbt_pipeline_request request = {.nbt = nbt,
+                                           .kind = NBT_PIPELINE_OTHER,
+                                           .function = NBT_PASS_THROUGH_FETCH_DATA,
+                                           .issue = nbt_issue_pass_through_fetch,
+                                           .description = "fetch pass-through data",
+                                           .keep_response = true};
+    ifx_status_t status = nbt_pipeline_execute(&request);
     if (ifx_error_check(status))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not fetch pass-through data from NBT");
         return status;
     }
-    if (apdu_response.sw != 0x9000U)
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for fetching pass-through data from NBT: 0x%04X", apdu_response.sw);
-        ifx_apdu_response_destroy(&apdu_response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_PASS_THROUGH_FETCH_DATA, IFX_SW_ERROR);
-    }
 
     // Parse command data
     ifx_blob_t blob = {0};
-    status = nbt_pass_through_decode_apdu_bytes(&apdu_response, &blob);
-    ifx_apdu_response_destroy(&apdu_response);
+    status = nbt_pass_through_decode_apdu_bytes(nbt->response, &blob);
+    ifx_apdu_response_destroy(nbt->response);
     if (ifx_error_check(status) || (blob.buffer == NULL) || (blob.length == 0U))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not parse APDU request received via pass-through mode");
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not parse APDU request received via pass-through mode");
         return status;
     }
     status = ifx_apdu_decode(apdu_buffer, blob.buffer, blob.length);
     free(blob.buffer);
     if (ifx_error_check(status))
     {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Data received via pass-through modeis not in APDU format");
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Data received via pass-through modeis not in APDU format");
         return status;
     }
     return IFX_SUCCESS;
@@ -384,20 +836,11 @@ ifx_status_t nbt_set_passthrough_response(nbt_cmd_t *nbt, ifx_apdu_response_t *r
     {
         return IFX_ERROR(LIB_NBT_APDU, NBT_PASS_THROUGH_PUT_RESPONSE, IFX_ILLEGAL_ARGUMENT);
     }
-    ifx_apdu_response_t pt_response = {0};
-    ifx_status_t status = nbt_pass_through_put_response(nbt, response, &pt_response);
-    ifx_apdu_destroy(nbt->apdu);
-    if (ifx_error_check(status))
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not send pass-through response to NBT");
-        return status;
-    }
-    if (pt_response.sw != 0x9000U)
-    {
-        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Invalid status word for sending pass-through response to NBT: 0x%04X", pt_response.sw);
-        ifx_apdu_response_destroy(&pt_response);
-        return IFX_ERROR(LIB_NBT_APDU, NBT_PASS_THROUGH_PUT_RESPONSE, IFX_SW_ERROR);
-    }
-    ifx_apdu_response_destroy(&pt_response);
-    return IFX_SUCCESS;
+    struct nbt_pipeline_request request = {.nbt = nbt,
+                                           .kind = NBT_PIPELINE_OTHER,
+                                           .function = NBT_PASS_THROUGH_PUT_RESPONSE,
+                                           .issue = nbt_issue_pass_through_put,
+                                           .context = response,
+                                           .description = "send pass-through response"};
+    return nbt_pipeline_execute(&request);
 }
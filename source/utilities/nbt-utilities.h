@@ -24,6 +24,149 @@ extern "C" {
  */
 #define NBT_DEFAULT_I2C_ADDRESS 0x18U
 
+/**
+ * \brief File size limit used for files not described by the capability container.
+ * \details Also used for all files as long as the capability container has not been read yet.
+ */
+#define NBT_FILE_SIZE_FALLBACK 4096U
+
+/**
+ * \brief Maximum number of APDU data bytes per READ BINARY / UPDATE BINARY command.
+ * \details The capability container's MLe / MLc values are capped by this limit. Commands use short APDU encoding only, so the limit
+ *          must not exceed 0xFF.
+ */
+#ifndef NBT_APDU_CHUNK_LIMIT
+#define NBT_APDU_CHUNK_LIMIT 0xFFU
+#endif
+#if NBT_APDU_CHUNK_LIMIT > 0xFFU
+#error "NBT_APDU_CHUNK_LIMIT exceeds short APDU encoding (0xFF)"
+#endif
+
+/**
+ * \brief Maximum number of file control TLVs cached from the capability container.
+ */
+#define NBT_CC_MAX_FILE_CONTROLS 6U
+
+/**
+ * \brief Maximum number of capability container bytes being read and parsed.
+ */
+#define NBT_CC_MAX_LEN 0x40U
+
+/** \struct nbt_file_control
+ * \brief File control information of a single file as declared in the NFC capability container.
+ *
+ * \see nbt_capability_container
+ */
+struct nbt_file_control
+{
+    /**
+     * \brief File ID of file described by this file control TLV.
+     */
+    uint16_t file_id;
+
+    /**
+     * \brief Maximum file size in bytes.
+     */
+    uint32_t max_size;
+
+    /**
+     * \brief NFC read access condition byte (\c 0x00 means granted).
+     */
+    uint8_t read_access;
+
+    /**
+     * \brief NFC write access condition byte (\c 0x00 means granted).
+     */
+    uint8_t write_access;
+};
+
+/** \struct nbt_capability_container
+ * \brief Parsed contents of the NFC capability container (CC) file.
+ *
+ * \see nbt_read_capability_container()
+ */
+struct nbt_capability_container
+{
+    /**
+     * \brief Length of capability container file (CCLEN).
+     */
+    uint16_t len;
+
+    /**
+     * \brief NFC Forum T4T mapping version.
+     */
+    uint8_t mapping_version;
+
+    /**
+     * \brief Maximum R-APDU data size (MLe).
+     */
+    uint16_t mle;
+
+    /**
+     * \brief Maximum C-APDU data size (MLc).
+     */
+    uint16_t mlc;
+
+    /**
+     * \brief File control information for NDEF and proprietary files.
+     */
+    struct nbt_file_control files[NBT_CC_MAX_FILE_CONTROLS];
+
+    /**
+     * \brief Number of valid entries in nbt_capability_container.files.
+     */
+    size_t files_len;
+};
+
+/**
+ * \brief Maximum number of password protected files known to the helper layer.
+ */
+#ifndef NBT_MAX_PASSWORD_BINDINGS
+#define NBT_MAX_PASSWORD_BINDINGS 4U
+#endif
+
+/**
+ * \brief Maximum number of NBTs with password protected files (e.g. on-board NBT and line station tag during provisioning).
+ */
+#ifndef NBT_MAX_PASSWORD_CONTEXTS
+#define NBT_MAX_PASSWORD_CONTEXTS 2U
+#endif
+
+/**
+ * \brief Length of NBT password in bytes.
+ */
+#define NBT_PASSWORD_LEN 4U
+
+/**
+ * \brief NBT access condition granting access with password of given ID (see nbt_password_binding).
+ */
+#define NBT_ACCESS_CONDITION_PASSWORD(password_id) ((uint8_t) (0x40U | (password_id)))
+
+/** \struct nbt_password_binding
+ * \brief Password required to access a file protected by a password access condition.
+ *
+ * \details The password itself must already be present on the NBT (e.g. created during personalization).
+ *
+ * \see nbt_configuration
+ */
+struct nbt_password_binding
+{
+    /**
+     * \brief File ID of file protected by password.
+     */
+    uint16_t file_id;
+
+    /**
+     * \brief NBT password ID as referenced by the file's access policy.
+     */
+    uint8_t password_id;
+
+    /**
+     * \brief Password value.
+     */
+    uint8_t password[NBT_PASSWORD_LEN];
+};
+
 /** \struct nbt_configuration
  * \brief Simple configuration struct to set NBT to desired state.
  *
@@ -50,6 +193,17 @@ struct nbt_configuration
      * \brief NBT interrupt pin configuration.
      */
     nbt_gpio_function_tags irq_function;
+
+    /**
+     * \brief Passwords for files with password protected access conditions (may be \c NULL).
+     * \details Copied per NBT by nbt_configure() and sent along with each command of nbt_read_file() / nbt_write_file().
+     */
+    const struct nbt_password_binding *passwords;
+
+    /**
+     * \brief Number of password bindings in nbt_configuration.passwords.
+     */
+    size_t passwords_len;
 };
 
 /** \enum nbt_fileid
@@ -93,10 +247,21 @@ enum nbt_fileid
     NBT_FILEID_PROPRIETARY4 = 0xE1A4U
 };
 
+/**
+ * \brief Sets the NBT whose capability container is cached and whose writes are accounted via nbt-write-budget.h.
+ *
+ * \details Other NBTs (e.g. line station tags during factory provisioning) use default file limits and bypass write accounting and
+ *          deferral.
+ *
+ * \param[in] nbt NBT command abstraction of on-board NBT.
+ */
+void nbt_set_primary(const nbt_cmd_t *nbt);
+
 /**
  * \brief Selects NBT (operational) application.
  *
  * \details Wraps select_application() and adds cleanup.
+ * \details Reads and caches capability container on first successful selection of the primary NBT (see nbt_set_primary()).
  *
  * \param[in] nbt NBT command abstraction.
  * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
@@ -104,6 +269,43 @@ enum nbt_fileid
  */
 ifx_status_t nbt_select_nbt_application(nbt_cmd_t *nbt);
 
+/**
+ * \brief Reads and parses NFC capability container (CC) file.
+ *
+ * \details NBT application must already be selected.
+ *
+ * \param[in] nbt NBT command abstraction.
+ * \param[out] cc Buffer to store parsed capability container in.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ * \see nbt_read_file()
+ */
+ifx_status_t nbt_read_capability_container(nbt_cmd_t *nbt, struct nbt_capability_container *cc);
+
+/**
+ * \brief Returns capability container of primary NBT cached during nbt_select_nbt_application().
+ *
+ * \return const struct nbt_capability_container * Cached capability container or \c NULL if not read yet.
+ */
+const struct nbt_capability_container *nbt_get_capability_container(void);
+
+/**
+ * \brief Returns file control information for a given file as declared in the cached capability container of the primary NBT.
+ *
+ * \param[in] file_id NBT file to get file control information for.
+ * \return const struct nbt_file_control * File control information or \c NULL if file not described by capability container.
+ */
+const struct nbt_file_control *nbt_get_file_control(enum nbt_fileid file_id);
+
+/**
+ * \brief Returns maximum size of file of primary NBT.
+ *
+ * \details Uses cached capability container and falls back to NBT_FILE_SIZE_FALLBACK for undeclared files.
+ *
+ * \param[in] file_id NBT file to get size for.
+ * \return size_t Maximum file size in bytes.
+ */
+size_t nbt_get_file_size(enum nbt_fileid file_id);
+
 /**
  * \brief Configures NBT according to given configuration.
  *
@@ -117,6 +319,7 @@ ifx_status_t nbt_configure(nbt_cmd_t *nbt, const struct nbt_configuration *confi
  * \brief Reads data from NBT file.
  *
  * \details Combines nbt_select_file_by_id() and (potentially) multiple calls to nbt_read_binary() to get file's contents.
+ * \details The password of password protected files (see nbt_configuration.passwords) is sent along with each command.
  *
  * \param[in] nbt NBT command abstraction.
  * \param[in] file_id NBT file to be read.
@@ -133,6 +336,8 @@ ifx_status_t nbt_read_file(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t off
  * \brief Writes data to NBT file.
  *
  * \details Combines nbt_select_file_by_id() and (potentially) multiple calls to nbt_update_binary() to set file's contents.
+ * \details The password of password protected files (see nbt_configuration.passwords) is sent along with each command.
+ * \details Writes to the primary NBT are accounted via nbt_write_budget_record() and deferred if the NVM write budget is exhausted.
  *
  * \param[in] nbt NBT command abstraction.
  * \param[in] file_id NBT file to be written.
@@ -145,6 +350,18 @@ ifx_status_t nbt_read_file(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t off
  */
 ifx_status_t nbt_write_file(nbt_cmd_t *nbt, enum nbt_fileid file_id, uint16_t offset, const uint8_t *data, size_t length);
 
+/**
+ * \brief Performs writes previously deferred by nbt_write_file() as far as the NVM write budget allows.
+ *
+ * \details NBT application must already be selected.
+ * \details Writes are performed in order of deferral, a failed write is put back and retried on the next call.
+ *
+ * \param[in] nbt NBT command abstraction of primary NBT.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ * \see nbt_write_file()
+ */
+ifx_status_t nbt_write_deferred(nbt_cmd_t *nbt);
+
 /**
  * \brief Retrieves available APDU received via pass-through mode.
  *
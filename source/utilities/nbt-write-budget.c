@@ -0,0 +1,531 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-write-budget.c
+ * \brief NVM write accounting and rate budget for NBT files and configuration.
+ * \details Keeps per-region page write counts (persisted lazily to data_storage) and a token bucket limiting NVM page writes over time.
+ * \details Writes exceeding the budget can be deferred and are flushed via nbt_write_deferred() once the budget allows.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "infineon/ifx-error.h"
+#include "infineon/ifx-logger.h"
+#include "infineon/nbt-apdu.h"
+
+#include "data-storage.h"
+#include "log-limiter.h"
+#include "nbt-utilities.h"
+#include "nbt-write-budget.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT write budget"
+
+/**
+ * \brief Key of write counters in data_storage.
+ */
+#define NBT_WRITE_BUDGET_STORAGE_KEY "nbt_wear"
+
+/**
+ * \brief Version of persisted write counter format.
+ */
+#define NBT_WRITE_BUDGET_STORAGE_VERSION 1U
+
+/**
+ * \brief Milliseconds per hour used for budget refill calculation.
+ */
+#define MS_PER_HOUR (60U * 60U * 1000U)
+
+/**
+ * \brief Write counters as persisted in data_storage.
+ */
+struct nbt_write_counters
+{
+    /**
+     * \brief Format version (NBT_WRITE_BUDGET_STORAGE_VERSION).
+     */
+    uint32_t version;
+
+    /**
+     * \brief Counters per region.
+     */
+    struct nbt_write_region_stats regions[NBT_WRITE_REGION_COUNT];
+};
+
+/**
+ * \brief Write counters collected since boot plus persisted counters once loaded.
+ */
+static struct nbt_write_counters counters = {.version = NBT_WRITE_BUDGET_STORAGE_VERSION};
+
+/**
+ * \brief Simple flag if counters changed since last persistent storage update.
+ */
+static bool counters_dirty = false;
+
+/**
+ * \brief Tick count of last persistent storage update.
+ */
+static TickType_t last_persist = 0U;
+
+/**
+ * \brief Page writes currently available in budget.
+ */
+static uint32_t tokens = NBT_WRITE_BUDGET_BURST;
+
+/**
+ * \brief Tick count up to which the budget has been refilled.
+ */
+static TickType_t last_refill = 0U;
+
+/**
+ * \brief Simple flag if budget is enforced (see nbt_write_budget_enforce()).
+ */
+static bool enforced = true;
+
+/**
+ * \brief Writes deferred because of an exceeded budget.
+ */
+static struct nbt_deferred_write deferred[NBT_WRITE_BUDGET_DEFERRED_SLOTS];
+
+/**
+ * \brief Sequence number of next deferred write.
+ */
+static uint32_t next_sequence = 0U;
+
+/**
+ * \brief Calculates number of NVM pages touched by a write.
+ *
+ * \param[in] offset Offset within region.
+ * \param[in] length Number of bytes written.
+ * \return size_t Number of pages touched.
+ */
+static size_t nbt_write_budget_pages(size_t offset, size_t length)
+{
+    if (length == 0U)
+    {
+        return 0U;
+    }
+    return ((offset + length - 1U) / NBT_WRITE_BUDGET_PAGE_SIZE) - (offset / NBT_WRITE_BUDGET_PAGE_SIZE) + 1U;
+}
+
+/**
+ * \brief Refills budget according to time elapsed since last refill.
+ */
+static void nbt_write_budget_refill(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint64_t elapsed_ms = (uint64_t) (now - last_refill) * portTICK_PERIOD_MS;
+    uint64_t refill = (elapsed_ms * NBT_WRITE_BUDGET_PAGES_PER_HOUR) / MS_PER_HOUR;
+    if (refill == 0U)
+    {
+        return;
+    }
+    if ((tokens + refill) >= NBT_WRITE_BUDGET_BURST)
+    {
+        tokens = NBT_WRITE_BUDGET_BURST;
+        last_refill = now;
+    }
+    else
+    {
+        tokens += (uint32_t) refill;
+        last_refill += pdMS_TO_TICKS((refill * MS_PER_HOUR) / NBT_WRITE_BUDGET_PAGES_PER_HOUR);
+    }
+}
+
+/**
+ * \brief Checks if budget has enough page writes available.
+ *
+ * \param[in] pages Number of page writes required.
+ * \return bool \c true if enough page writes available.
+ */
+static bool nbt_write_budget_available(size_t pages)
+{
+    if (NBT_WRITE_BUDGET_BURST == 0U)
+    {
+        return true;
+    }
+    nbt_write_budget_refill();
+    return tokens >= pages;
+}
+
+/**
+ * \brief Consumes page writes from budget.
+ *
+ * \param[in] pages Number of page writes to consume (budget saturates at \c 0).
+ */
+static void nbt_write_budget_consume(size_t pages)
+{
+    if (NBT_WRITE_BUDGET_BURST == 0U)
+    {
+        return;
+    }
+    tokens = (tokens > pages) ? (tokens - pages) : 0U;
+}
+
+/**
+ * \brief Maps NBT file ID to write accounting region.
+ *
+ * \param[in] file_id NBT file ID.
+ * \return enum nbt_write_region Matching region or NBT_WRITE_REGION_COUNT if unknown.
+ */
+enum nbt_write_region nbt_write_budget_region(uint16_t file_id)
+{
+    switch (file_id)
+    {
+    case NBT_FILEID_CC:
+        return NBT_WRITE_REGION_CC;
+    case NBT_FILEID_NDEF:
+        return NBT_WRITE_REGION_NDEF;
+    case NBT_FILEID_FAP:
+        return NBT_WRITE_REGION_FAP;
+    case NBT_FILEID_PROPRIETARY1:
+        return NBT_WRITE_REGION_PROPRIETARY1;
+    case NBT_FILEID_PROPRIETARY2:
+        return NBT_WRITE_REGION_PROPRIETARY2;
+    case NBT_FILEID_PROPRIETARY3:
+        return NBT_WRITE_REGION_PROPRIETARY3;
+    case NBT_FILEID_PROPRIETARY4:
+        return NBT_WRITE_REGION_PROPRIETARY4;
+    default:
+        return NBT_WRITE_REGION_COUNT;
+    }
+}
+
+/**
+ * \brief Checks if the budget allows a write and consumes the required page writes if so.
+ *
+ * \param[in] region Region to be written.
+ * \param[in] offset Offset within region.
+ * \param[in] length Number of bytes to be written.
+ * \return bool \c true if write may be performed now, \c false if it should be deferred.
+ */
+bool nbt_write_budget_acquire(enum nbt_write_region region, size_t offset, size_t length)
+{
+    (void) region;
+    if (!enforced)
+    {
+        return true;
+    }
+    size_t pages = nbt_write_budget_pages(offset, length);
+    if (!nbt_write_budget_available(pages))
+    {
+        return false;
+    }
+    nbt_write_budget_consume(pages);
+    return true;
+}
+
+/**
+ * \brief Enables or disables budget enforcement, e.g. during factory provisioning.
+ *
+ * \details Accounting stays active, writes performed while not enforced are not charged against the budget.
+ *
+ * \param[in] enforce \c true to enforce budget, \c false to allow all writes.
+ */
+void nbt_write_budget_enforce(bool enforce)
+{
+    enforced = enforce;
+}
+
+/**
+ * \brief Records a performed write in the per-region counters.
+ *
+ * \details Writes that have not been acquired via nbt_write_budget_acquire() (e.g. configuration) are charged against the budget as well.
+ *
+ * \param[in] region Region written.
+ * \param[in] offset Offset within region.
+ * \param[in] length Number of bytes written.
+ * \param[in] acquired \c true if budget has already been consumed via nbt_write_budget_acquire().
+ */
+void nbt_write_budget_record(enum nbt_write_region region, size_t offset, size_t length, bool acquired)
+{
+    if (region >= NBT_WRITE_REGION_COUNT)
+    {
+        return;
+    }
+    size_t pages = nbt_write_budget_pages(offset, length);
+    if (!acquired)
+    {
+        nbt_write_budget_refill();
+        nbt_write_budget_consume(pages);
+    }
+    struct nbt_write_region_stats *stats = &counters.regions[region];
+    stats->commands++;
+    size_t first_page = offset / NBT_WRITE_BUDGET_PAGE_SIZE;
+    for (size_t page = first_page; page < (first_page + pages); page++)
+    {
+        size_t tracked = (page < NBT_WRITE_BUDGET_TRACKED_PAGES) ? page : (NBT_WRITE_BUDGET_TRACKED_PAGES - 1U);
+        stats->page_writes[tracked]++;
+    }
+    counters_dirty = true;
+}
+
+/**
+ * \brief Stores write for later execution.
+ *
+ * \details Overlapping bytes of pending writes are updated with \c data so that older writes flushed first never restore stale data.
+ *          A write fully covered by a pending write is merged into it.
+ *
+ * \param[in] file_id NBT file to be written.
+ * \param[in] offset Offset within NBT file.
+ * \param[in] data Data to be written.
+ * \param[in] length Number of bytes in \c data.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_defer(uint16_t file_id, uint16_t offset, const uint8_t *data, size_t length)
+{
+    if ((data == NULL) || (length == 0U) || (length > NBT_WRITE_BUDGET_DEFERRED_MAX_LEN))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_ILLEGAL_ARGUMENT);
+    }
+    struct nbt_deferred_write *slot = NULL;
+    bool merged = false;
+    for (size_t i = 0U; i < NBT_WRITE_BUDGET_DEFERRED_SLOTS; i++)
+    {
+        struct nbt_deferred_write *pending = &deferred[i];
+        if (pending->length == 0U)
+        {
+            slot = (slot == NULL) ? pending : slot;
+            continue;
+        }
+        size_t pending_end = pending->offset + pending->length;
+        size_t end = offset + length;
+        if ((pending->file_id != file_id) || (pending->offset >= end) || (offset >= pending_end))
+        {
+            continue;
+        }
+
+        // Newer data wins in overlapping range
+        size_t overlap_start = (pending->offset > offset) ? pending->offset : offset;
+        size_t overlap_end = (pending_end < end) ? pending_end : end;
+        memcpy(&pending->data[overlap_start - pending->offset], &data[overlap_start - offset], overlap_end - overlap_start);
+        merged = merged || ((pending->offset <= offset) && (end <= pending_end));
+    }
+    if (merged)
+    {
+        return IFX_SUCCESS;
+    }
+    if (slot == NULL)
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "No free slot to defer write to NBT file 0x%04X", file_id);
+        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_OUT_OF_MEMORY);
+    }
+    slot->file_id = file_id;
+    slot->offset = offset;
+    slot->length = length;
+    slot->sequence = next_sequence++;
+    memcpy(slot->data, data, length);
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_DEBUG, "Write budget exceeded - deferred write to NBT file 0x%04X", file_id);
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Checks if a pending deferred write overlaps the given range.
+ *
+ * \param[in] file_id NBT file ID.
+ * \param[in] offset Offset within NBT file.
+ * \param[in] length Number of bytes.
+ * \return bool \c true if a deferred write overlaps the range.
+ */
+bool nbt_write_budget_is_deferred(uint16_t file_id, size_t offset, size_t length)
+{
+    for (size_t i = 0U; i < NBT_WRITE_BUDGET_DEFERRED_SLOTS; i++)
+    {
+        if ((deferred[i].length > 0U) && (deferred[i].file_id == file_id) && (deferred[i].offset < (offset + length)) &&
+            (offset < (deferred[i].offset + deferred[i].length)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Takes the oldest deferred write if it fits into the current budget and consumes the required page writes.
+ *
+ * \param[out] write Buffer to store deferred write in (slot is released).
+ * \return bool \c true if a deferred write has been taken, \c false if none pending or budget exhausted.
+ */
+bool nbt_write_budget_take_deferred(struct nbt_deferred_write *write)
+{
+    if (write == NULL)
+    {
+        return false;
+    }
+    struct nbt_deferred_write *oldest = NULL;
+    for (size_t i = 0U; i < NBT_WRITE_BUDGET_DEFERRED_SLOTS; i++)
+    {
+        if ((deferred[i].length > 0U) && ((oldest == NULL) || ((int32_t) (deferred[i].sequence - oldest->sequence) < 0)))
+        {
+            oldest = &deferred[i];
+        }
+    }
+    if (oldest == NULL)
+    {
+        return false;
+    }
+    if (enforced)
+    {
+        size_t pages = nbt_write_budget_pages(oldest->offset, oldest->length);
+        if (!nbt_write_budget_available(pages))
+        {
+            return false;
+        }
+        nbt_write_budget_consume(pages);
+    }
+    memcpy(write, oldest, sizeof(struct nbt_deferred_write));
+    oldest->length = 0U;
+    return true;
+}
+
+/**
+ * \brief Puts back a write taken via nbt_write_budget_take_deferred() that could not be performed.
+ *
+ * \details Keeps its original position in the flush order.
+ *
+ * \param[in] write Deferred write to put back.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_restore(const struct nbt_deferred_write *write)
+{
+    if ((write == NULL) || (write->length == 0U))
+    {
+        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_ILLEGAL_ARGUMENT);
+    }
+    for (size_t i = 0U; i < NBT_WRITE_BUDGET_DEFERRED_SLOTS; i++)
+    {
+        if (deferred[i].length == 0U)
+        {
+            memcpy(&deferred[i], write, sizeof(struct nbt_deferred_write));
+            return IFX_SUCCESS;
+        }
+    }
+    return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_OUT_OF_MEMORY);
+}
+
+/**
+ * \brief Returns write counters of a region.
+ *
+ * \param[in] region Region to get counters for.
+ * \return const struct nbt_write_region_stats * Counters or \c NULL for invalid region.
+ */
+const struct nbt_write_region_stats *nbt_write_budget_stats(enum nbt_write_region region)
+{
+    if (region >= NBT_WRITE_REGION_COUNT)
+    {
+        return NULL;
+    }
+    return &counters.regions[region];
+}
+
+/**
+ * \brief Loads write counters from data_storage and adds them to the counters collected since boot.
+ *
+ * \details data_storage must already be initialized.
+ *
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_load(void)
+{
+    static struct nbt_write_counters stored;
+    uint32_t read_size = sizeof(stored);
+    if (data_storage_get(NBT_WRITE_BUDGET_STORAGE_KEY, NULL, &read_size) != CY_RSLT_SUCCESS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "No persisted NBT write counters - starting from zero");
+        counters_dirty = true;
+        return IFX_SUCCESS;
+    }
+    if (read_size != sizeof(stored))
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Persisted NBT write counters have unexpected size - ignored");
+        counters_dirty = true;
+        return IFX_SUCCESS;
+    }
+    if (data_storage_get(NBT_WRITE_BUDGET_STORAGE_KEY, (uint8_t *) (&stored), &read_size) != CY_RSLT_SUCCESS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Could not read persisted NBT write counters");
+        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_UNSPECIFIED_ERROR);
+    }
+    if (stored.version != NBT_WRITE_BUDGET_STORAGE_VERSION)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Persisted NBT write counters have unknown version %u - ignored", (unsigned int) stored.version);
+        counters_dirty = true;
+        return IFX_SUCCESS;
+    }
+
+    // Counters collected since boot are added on top of persisted ones
+    for (size_t region = 0U; region < NBT_WRITE_REGION_COUNT; region++)
+    {
+        counters.regions[region].commands += stored.regions[region].commands;
+        for (size_t page = 0U; page < NBT_WRITE_BUDGET_TRACKED_PAGES; page++)
+        {
+            counters.regions[region].page_writes[page] += stored.regions[region].page_writes[page];
+        }
+    }
+    counters_dirty = true;
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Persists write counters to data_storage if changed and NBT_WRITE_BUDGET_PERSIST_PERIOD_MS elapsed.
+ *
+ * \param[in] force \c true to ignore NBT_WRITE_BUDGET_PERSIST_PERIOD_MS.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_persist(bool force)
+{
+    if (!counters_dirty)
+    {
+        return IFX_SUCCESS;
+    }
+    TickType_t now = xTaskGetTickCount();
+    if (!force && ((now - last_persist) < pdMS_TO_TICKS(NBT_WRITE_BUDGET_PERSIST_PERIOD_MS)))
+    {
+        return IFX_SUCCESS;
+    }
+    if (data_storage_set(NBT_WRITE_BUDGET_STORAGE_KEY, (uint8_t *) (&counters), sizeof(counters)) != CY_RSLT_SUCCESS)
+    {
+        LOG_LIMITED(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not persist NBT write counters");
+        return IFX_ERROR(LIB_NBT_APDU, NBT_UPDATE_BINARY, IFX_UNSPECIFIED_ERROR);
+    }
+    counters_dirty = false;
+    last_persist = now;
+    return IFX_SUCCESS;
+}
+
+/**
+ * \brief Logs write counters of all regions.
+ */
+void nbt_write_budget_report(void)
+{
+    static const char *const region_names[NBT_WRITE_REGION_COUNT] = {"CC", "NDEF", "FAP", "Proprietary 1", "Proprietary 2", "Proprietary 3", "Proprietary 4",
+                                                                     "Configuration"};
+    for (size_t region = 0U; region < NBT_WRITE_REGION_COUNT; region++)
+    {
+        const struct nbt_write_region_stats *stats = &counters.regions[region];
+        uint32_t max_page_writes = 0U;
+        size_t max_page = 0U;
+        for (size_t page = 0U; page < NBT_WRITE_BUDGET_TRACKED_PAGES; page++)
+        {
+            if (stats->page_writes[page] > max_page_writes)
+            {
+                max_page_writes = stats->page_writes[page];
+                max_page = page;
+            }
+        }
+        // clang-format off
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "%s: %u write command(s), most written page %u with %u page write(s)", region_names[region],
+                       (unsigned int) stats->commands, (unsigned int) max_page, (unsigned int) max_page_writes);
+        // clang-format on
+    }
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "Write budget: %u of %u page write(s) available", (unsigned int) tokens,
+                   (unsigned int) NBT_WRITE_BUDGET_BURST);
+}
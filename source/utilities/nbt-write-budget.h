@@ -0,0 +1,287 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file nbt-write-budget.h
+ * \brief NVM write accounting and rate budget for NBT files and configuration.
+ * \details Keeps per-region page write counts (persisted lazily to data_storage) and a token bucket limiting NVM page writes over time.
+ * \details Writes exceeding the budget can be deferred and are flushed via nbt_write_deferred() once the budget allows.
+ */
+#ifndef NBT_WRITE_BUDGET_H
+#define NBT_WRITE_BUDGET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "infineon/ifx-error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Size of a single NBT NVM page in bytes used for accounting.
+ */
+#ifndef NBT_WRITE_BUDGET_PAGE_SIZE
+#define NBT_WRITE_BUDGET_PAGE_SIZE 64U
+#endif
+
+/**
+ * \brief Number of pages per region tracked individually (writes to later pages are accounted to the last tracked page).
+ */
+#ifndef NBT_WRITE_BUDGET_TRACKED_PAGES
+#define NBT_WRITE_BUDGET_TRACKED_PAGES 16U
+#endif
+
+/**
+ * \brief Maximum number of page writes that can be performed in a burst.
+ * \details Set to \c 0 to disable budget enforcement (accounting stays active).
+ */
+#ifndef NBT_WRITE_BUDGET_BURST
+#define NBT_WRITE_BUDGET_BURST 64U
+#endif
+
+/**
+ * \brief Number of page writes being refilled to the budget per hour.
+ */
+#ifndef NBT_WRITE_BUDGET_PAGES_PER_HOUR
+#define NBT_WRITE_BUDGET_PAGES_PER_HOUR 720U
+#endif
+
+/**
+ * \brief Minimum time between two persistent storage updates of the write counters.
+ */
+#ifndef NBT_WRITE_BUDGET_PERSIST_PERIOD_MS
+#define NBT_WRITE_BUDGET_PERSIST_PERIOD_MS (10U * 60U * 1000U)
+#endif
+
+/**
+ * \brief Maximum number of writes that can be deferred at the same time.
+ */
+#ifndef NBT_WRITE_BUDGET_DEFERRED_SLOTS
+#define NBT_WRITE_BUDGET_DEFERRED_SLOTS 4U
+#endif
+
+/**
+ * \brief Maximum number of data bytes of a single deferred write.
+ * \details Large enough for the LE Secure Connection confirmation and random value written as one unit.
+ */
+#ifndef NBT_WRITE_BUDGET_DEFERRED_MAX_LEN
+#define NBT_WRITE_BUDGET_DEFERRED_MAX_LEN 48U
+#endif
+
+/** \enum nbt_write_region
+ * \brief NBT NVM regions being accounted separately.
+ */
+enum nbt_write_region
+{
+    /**
+     * \brief NFC Capability Container (CC).
+     */
+    NBT_WRITE_REGION_CC = 0U,
+
+    /**
+     * \brief NFC NDEF file.
+     */
+    NBT_WRITE_REGION_NDEF,
+
+    /**
+     * \brief File Access Policy file (FAP), updated via nbt_update_fap().
+     */
+    NBT_WRITE_REGION_FAP,
+
+    /**
+     * \brief NBT Proprietary file 1.
+     */
+    NBT_WRITE_REGION_PROPRIETARY1,
+
+    /**
+     * \brief NBT Proprietary file 2.
+     */
+    NBT_WRITE_REGION_PROPRIETARY2,
+
+    /**
+     * \brief NBT Proprietary file 3.
+     */
+    NBT_WRITE_REGION_PROPRIETARY3,
+
+    /**
+     * \brief NBT Proprietary file 4.
+     */
+    NBT_WRITE_REGION_PROPRIETARY4,
+
+    /**
+     * \brief Configurator application tags, updated via nbt_set_configuration().
+     */
+    NBT_WRITE_REGION_CONFIGURATION,
+
+    /**
+     * \brief Number of regions (not a region itself).
+     */
+    NBT_WRITE_REGION_COUNT
+};
+
+/** \struct nbt_write_region_stats
+ * \brief Write counters of a single NBT NVM region.
+ */
+struct nbt_write_region_stats
+{
+    /**
+     * \brief Number of write commands issued to region.
+     */
+    uint32_t commands;
+
+    /**
+     * \brief Number of page writes per tracked page.
+     */
+    uint32_t page_writes[NBT_WRITE_BUDGET_TRACKED_PAGES];
+};
+
+/** \struct nbt_deferred_write
+ * \brief Single write deferred because of an exceeded budget.
+ */
+struct nbt_deferred_write
+{
+    /**
+     * \brief NBT file ID to be written.
+     */
+    uint16_t file_id;
+
+    /**
+     * \brief Offset within NBT file.
+     */
+    uint16_t offset;
+
+    /**
+     * \brief Number of bytes in nbt_deferred_write.data (\c 0 for unused slot).
+     */
+    size_t length;
+
+    /**
+     * \brief Sequence number of write, deferred writes are flushed in order of deferral.
+     */
+    uint32_t sequence;
+
+    /**
+     * \brief Data to be written.
+     */
+    uint8_t data[NBT_WRITE_BUDGET_DEFERRED_MAX_LEN];
+};
+
+/**
+ * \brief Maps NBT file ID to write accounting region.
+ *
+ * \param[in] file_id NBT file ID.
+ * \return enum nbt_write_region Matching region or NBT_WRITE_REGION_COUNT if unknown.
+ */
+enum nbt_write_region nbt_write_budget_region(uint16_t file_id);
+
+/**
+ * \brief Checks if the budget allows a write and consumes the required page writes if so.
+ *
+ * \param[in] region Region to be written.
+ * \param[in] offset Offset within region.
+ * \param[in] length Number of bytes to be written.
+ * \return bool \c true if write may be performed now, \c false if it should be deferred.
+ */
+bool nbt_write_budget_acquire(enum nbt_write_region region, size_t offset, size_t length);
+
+/**
+ * \brief Enables or disables budget enforcement, e.g. during factory provisioning.
+ *
+ * \details Accounting stays active, writes performed while not enforced are not charged against the budget.
+ *
+ * \param[in] enforce \c true to enforce budget, \c false to allow all writes.
+ */
+void nbt_write_budget_enforce(bool enforce);
+
+/**
+ * \brief Records a performed write in the per-region counters.
+ *
+ * \details Writes that have not been acquired via nbt_write_budget_acquire() (e.g. configuration) are charged against the budget as well.
+ *
+ * \param[in] region Region written.
+ * \param[in] offset Offset within region.
+ * \param[in] length Number of bytes written.
+ * \param[in] acquired \c true if budget has already been consumed via nbt_write_budget_acquire().
+ */
+void nbt_write_budget_record(enum nbt_write_region region, size_t offset, size_t length, bool acquired);
+
+/**
+ * \brief Stores write for later execution.
+ *
+ * \details Overlapping bytes of pending writes are updated with \c data so that older writes flushed first never restore stale data.
+ *          A write fully covered by a pending write is merged into it.
+ *
+ * \param[in] file_id NBT file to be written.
+ * \param[in] offset Offset within NBT file.
+ * \param[in] data Data to be written.
+ * \param[in] length Number of bytes in \c data.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_defer(uint16_t file_id, uint16_t offset, const uint8_t *data, size_t length);
+
+/**
+ * \brief Checks if a pending deferred write overlaps the given range.
+ *
+ * \param[in] file_id NBT file ID.
+ * \param[in] offset Offset within NBT file.
+ * \param[in] length Number of bytes.
+ * \return bool \c true if a deferred write overlaps the range.
+ */
+bool nbt_write_budget_is_deferred(uint16_t file_id, size_t offset, size_t length);
+
+/**
+ * \brief Takes the oldest deferred write if it fits into the current budget and consumes the required page writes.
+ *
+ * \param[out] write Buffer to store deferred write in (slot is released).
+ * \return bool \c true if a deferred write has been taken, \c false if none pending or budget exhausted.
+ */
+bool nbt_write_budget_take_deferred(struct nbt_deferred_write *write);
+
+/**
+ * \brief Puts back a write taken via nbt_write_budget_take_deferred() that could not be performed.
+ *
+ * \details Keeps its original position in the flush order.
+ *
+ * \param[in] write Deferred write to put back.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_restore(const struct nbt_deferred_write *write);
+
+/**
+ * \brief Returns write counters of a region.
+ *
+ * \param[in] region Region to get counters for.
+ * \return const struct nbt_write_region_stats * Counters or \c NULL for invalid region.
+ */
+const struct nbt_write_region_stats *nbt_write_budget_stats(enum nbt_write_region region);
+
+/**
+ * \brief Loads write counters from data_storage and adds them to the counters collected since boot.
+ *
+ * \details data_storage must already be initialized.
+ *
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_load(void);
+
+/**
+ * \brief Persists write counters to data_storage if changed and NBT_WRITE_BUDGET_PERSIST_PERIOD_MS elapsed.
+ *
+ * \param[in] force \c true to ignore NBT_WRITE_BUDGET_PERSIST_PERIOD_MS.
+ * \return ifx_status_t \c IFX_SUCCESS if successful, any other value in case of error.
+ */
+ifx_status_t nbt_write_budget_persist(bool force);
+
+/**
+ * \brief Logs write counters of all regions.
+ */
+void nbt_write_budget_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NBT_WRITE_BUDGET_H
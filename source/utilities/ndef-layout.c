@@ -0,0 +1,326 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file ndef-layout.c
+ * \brief Builder for the BLE connection handover NDEF message optimized for the number of READ BINARY commands per tap.
+ * \details Phones read the NDEF file length (NLEN) and then the message in chunks of at most MLe bytes. The builder selects all
+ *          required fields and adds optional fields (in order of ndef_layout_build()'s priority list) only as long as the message
+ *          still fits into the number of reads needed for the required fields alone.
+ * \details Message is populated according to *NFC Forum: Bluetooth Secure Simple Pairing Using NFC* application document using
+ *          short records only, with fields for:
+ *     * BLE Device Address (always included)
+ *     * BLE Role (always included)
+ *     * BLE Local Name (optional)
+ *     * BLE Appearance (optional)
+ *     * Security Manager TK (optional but required by AOSP based Bluetooth stacks - still ignored)
+ *     * LE Secure Connection Confirmation Value (optional but required by AOSP based Bluetooth stacks)
+ *     * LE Secure Connection Random Value (optional but required by AOSP based Bluetooth stacks)
+ *     * BLE OOB flags (optional)
+ * \details Optionally followed by a device status record (external type *infineon.com:status*).
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "infineon/ifx-logger.h"
+
+#include "ndef-layout.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "NBT example"
+
+/**
+ * \brief Length of NDEF message length field (NLEN).
+ */
+#define NDEF_LAYOUT_NLEN_LEN 2U
+
+/**
+ * \brief Length of short record header (header, type length, payload length).
+ */
+#define NDEF_LAYOUT_SR_HEADER_LEN 3U
+
+/**
+ * \brief Length of AD field header (length, data type) preceding each value.
+ */
+#define NDEF_LAYOUT_AD_HEADER_LEN 2U
+
+/**
+ * \brief NDEF record header flag: message begin.
+ */
+#define NDEF_LAYOUT_MB 0x80U
+
+/**
+ * \brief NDEF record header flag: message end.
+ */
+#define NDEF_LAYOUT_ME 0x40U
+
+/**
+ * \brief NDEF record header flag: short record.
+ */
+#define NDEF_LAYOUT_SR 0x10U
+
+/**
+ * \brief NDEF record type name format: media type.
+ */
+#define NDEF_LAYOUT_TNF_MEDIA 0x02U
+
+/**
+ * \brief NDEF record type name format: external type.
+ */
+#define NDEF_LAYOUT_TNF_EXTERNAL 0x04U
+
+/**
+ * \brief Record type of BLE OOB record.
+ */
+static const char OOB_TYPE[] = "application/vnd.bluetooth.le.oob";
+
+/**
+ * \brief Record type of device status record.
+ */
+static const char STATUS_TYPE[] = "infineon.com:status";
+
+// clang-format off
+/**
+ * \brief Skeleton of BLE Device Address field (1B length, 1B data type, 6B address, 1B address type).
+ */
+static const uint8_t ADDRESS_FIELD[] = {0x08U, 0x1BU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0x00U};
+
+/**
+ * \brief BLE Role field (1B length, 1B data type, 1B role "Peripheral").
+ */
+static const uint8_t ROLE_FIELD[] = {0x02U, 0x1CU, 0x00U};
+
+/**
+ * \brief BLE Local Name field (1B length, 1B data type, 3B name "NBT").
+ */
+static const uint8_t NAME_FIELD[] = {0x04U, 0x09U, 0x4EU, 0x42U, 0x54U};
+
+/**
+ * \brief Appearance field (1B length, 1B data type, 2B appearance "HID: Mouse").
+ */
+static const uint8_t APPEARANCE_FIELD[] = {0x03U, 0x19U, 0xC2U, 0x03U};
+
+/**
+ * \brief Security Manager TK field (1B length, 1B data type, 16B key).
+ */
+static const uint8_t TK_FIELD[] = {0x11U, 0x10U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U};
+
+/**
+ * \brief Skeleton of LE Secure Connection Confirmation Value field (1B length, 1B data type, 16B confirmation value).
+ */
+static const uint8_t CONFIRMATION_FIELD[] = {0x11U, 0x22U, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU};
+
+/**
+ * \brief Skeleton of LE Secure Connection Random Value field (1B length, 1B data type, 16B random value).
+ */
+static const uint8_t RANDOM_FIELD[] = {0x11U, 0x23U, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU};
+
+/**
+ * \brief LE OOB Flags field (1B length, 1B data type, 1B flags LE General Discoverable Mode, BR/EDR not supported).
+ */
+static const uint8_t FLAGS_FIELD[] = {0x02U, 0x01U, 0x06U};
+// clang-format on
+
+/** \struct ndef_layout_field
+ * \brief AD field of BLE OOB record.
+ */
+struct ndef_layout_field
+{
+    /**
+     * \brief Field flag (NDEF_LAYOUT_FIELD_*).
+     */
+    uint16_t flag;
+
+    /**
+     * \brief Field skeleton.
+     */
+    const uint8_t *data;
+
+    /**
+     * \brief Number of bytes in ndef_layout_field.data.
+     */
+    size_t length;
+};
+
+/**
+ * \brief AD fields in order of appearance in BLE OOB record.
+ */
+static const struct ndef_layout_field FIELDS[] = {
+    {NDEF_LAYOUT_FIELD_ADDRESS, ADDRESS_FIELD, sizeof(ADDRESS_FIELD)},
+    {NDEF_LAYOUT_FIELD_ROLE, ROLE_FIELD, sizeof(ROLE_FIELD)},
+    {NDEF_LAYOUT_FIELD_NAME, NAME_FIELD, sizeof(NAME_FIELD)},
+    {NDEF_LAYOUT_FIELD_APPEARANCE, APPEARANCE_FIELD, sizeof(APPEARANCE_FIELD)},
+    {NDEF_LAYOUT_FIELD_TK, TK_FIELD, sizeof(TK_FIELD)},
+    {NDEF_LAYOUT_FIELD_CONFIRMATION, CONFIRMATION_FIELD, sizeof(CONFIRMATION_FIELD)},
+    {NDEF_LAYOUT_FIELD_RANDOM, RANDOM_FIELD, sizeof(RANDOM_FIELD)},
+    {NDEF_LAYOUT_FIELD_FLAGS, FLAGS_FIELD, sizeof(FLAGS_FIELD)}};
+
+/**
+ * \brief Optional fields in order of priority (first one is added first).
+ */
+static const uint16_t PRIORITIES[] = {NDEF_LAYOUT_FIELD_CONFIRMATION, NDEF_LAYOUT_FIELD_RANDOM, NDEF_LAYOUT_FIELD_STATUS,
+                                      NDEF_LAYOUT_FIELD_FLAGS,        NDEF_LAYOUT_FIELD_TK,     NDEF_LAYOUT_FIELD_NAME,
+                                      NDEF_LAYOUT_FIELD_APPEARANCE};
+
+/**
+ * \brief Returns length of BLE OOB record payload for selected fields.
+ * \param[in] fields Selected fields (NDEF_LAYOUT_FIELD_*).
+ * \return size_t Payload length.
+ */
+static size_t ndef_layout_oob_payload_length(uint16_t fields)
+{
+    size_t length = 0U;
+    for (size_t i = 0U; i < (sizeof(FIELDS) / sizeof(FIELDS[0])); i++)
+    {
+        if ((fields & FIELDS[i].flag) != 0U)
+        {
+            length += FIELDS[i].length;
+        }
+    }
+    return length;
+}
+
+/**
+ * \brief Returns length of connection handover message for selected fields.
+ * \param[in] fields Selected fields (NDEF_LAYOUT_FIELD_*).
+ * \return size_t Message length including NLEN.
+ */
+static size_t ndef_layout_length(uint16_t fields)
+{
+    size_t length = NDEF_LAYOUT_NLEN_LEN + NDEF_LAYOUT_SR_HEADER_LEN + (sizeof(OOB_TYPE) - 1U) + ndef_layout_oob_payload_length(fields);
+    if ((fields & NDEF_LAYOUT_FIELD_STATUS) != 0U)
+    {
+        length += NDEF_LAYOUT_SR_HEADER_LEN + (sizeof(STATUS_TYPE) - 1U) + NDEF_LAYOUT_STATUS_LEN;
+    }
+    return length;
+}
+
+/**
+ * \brief Selects fields with fewest reads for MLe.
+ * \param[in] mle Maximum number of data bytes per READ BINARY.
+ * \param[in] required Fields always included.
+ * \param[in] optional Fields included if they do not cost an additional read.
+ * \return uint16_t Selected fields.
+ */
+static uint16_t ndef_layout_select(size_t mle, uint16_t required, uint16_t optional)
+{
+    uint16_t fields = required | NDEF_LAYOUT_FIELD_ADDRESS | NDEF_LAYOUT_FIELD_ROLE;
+    size_t target = ndef_layout_reads(ndef_layout_length(fields), mle);
+    for (size_t i = 0U; i < (sizeof(PRIORITIES) / sizeof(PRIORITIES[0])); i++)
+    {
+        uint16_t candidate = fields | (optional & PRIORITIES[i]);
+        if (ndef_layout_reads(ndef_layout_length(candidate), mle) <= target)
+        {
+            fields = candidate;
+        }
+    }
+    return fields;
+}
+
+/**
+ * \brief Returns number of READ BINARY commands a phone needs for a message.
+ *
+ * \param[in] length Length of message including NLEN.
+ * \param[in] mle Maximum number of data bytes per READ BINARY.
+ * \return size_t Number of READ BINARY commands (NLEN read separately).
+ */
+size_t ndef_layout_reads(size_t length, size_t mle)
+{
+    if ((mle == 0U) || (length <= NDEF_LAYOUT_NLEN_LEN))
+    {
+        return 1U;
+    }
+    return 1U + (((length - NDEF_LAYOUT_NLEN_LEN) + mle - 1U) / mle);
+}
+
+/**
+ * \brief Builds connection handover message with fewest reads for MLe.
+ *
+ * \param[out] layout Layout to be built.
+ * \param[in] mle Maximum number of data bytes per READ BINARY.
+ * \param[in] required Fields always included (NDEF_LAYOUT_FIELD_*).
+ * \param[in] optional Fields included if they do not cost an additional read (NDEF_LAYOUT_FIELD_*).
+ * \param[in] status Initial device status payload of NDEF_LAYOUT_STATUS_LEN bytes.
+ * \return bool \c true if successful, \c false if \c mle is invalid.
+ */
+bool ndef_layout_build(struct ndef_layout *layout, size_t mle, uint16_t required, uint16_t optional, const uint8_t status[NDEF_LAYOUT_STATUS_LEN])
+{
+    if ((layout == NULL) || (mle == 0U))
+    {
+        return false;
+    }
+    memset(layout, 0x00, sizeof(struct ndef_layout));
+    layout->fields = ndef_layout_select(mle, required, optional);
+    layout->mle = mle;
+    bool with_status = (layout->fields & NDEF_LAYOUT_FIELD_STATUS) != 0U;
+
+    // NDEF message length
+    size_t nlen = ndef_layout_length(layout->fields) - NDEF_LAYOUT_NLEN_LEN;
+    uint8_t *cursor = layout->message;
+    *cursor++ = (uint8_t) (nlen >> 8);
+    *cursor++ = (uint8_t) nlen;
+
+    // BLE OOB record (short record, all payloads < 256 bytes)
+    *cursor++ = NDEF_LAYOUT_MB | (with_status ? 0x00U : NDEF_LAYOUT_ME) | NDEF_LAYOUT_SR | NDEF_LAYOUT_TNF_MEDIA;
+    *cursor++ = (uint8_t) (sizeof(OOB_TYPE) - 1U);
+    *cursor++ = (uint8_t) ndef_layout_oob_payload_length(layout->fields);
+    memcpy(cursor, OOB_TYPE, sizeof(OOB_TYPE) - 1U);
+    cursor += sizeof(OOB_TYPE) - 1U;
+    for (size_t i = 0U; i < (sizeof(FIELDS) / sizeof(FIELDS[0])); i++)
+    {
+        if ((layout->fields & FIELDS[i].flag) == 0U)
+        {
+            continue;
+        }
+        size_t value_offset = (size_t) (cursor - layout->message) + NDEF_LAYOUT_AD_HEADER_LEN;
+        if (FIELDS[i].flag == NDEF_LAYOUT_FIELD_ADDRESS)
+        {
+            layout->address_offset = value_offset;
+        }
+        else if (FIELDS[i].flag == NDEF_LAYOUT_FIELD_CONFIRMATION)
+        {
+            layout->confirmation_offset = value_offset;
+        }
+        else if (FIELDS[i].flag == NDEF_LAYOUT_FIELD_RANDOM)
+        {
+            layout->random_offset = value_offset;
+        }
+        memcpy(cursor, FIELDS[i].data, FIELDS[i].length);
+        cursor += FIELDS[i].length;
+    }
+
+    // Device status record
+    if (with_status)
+    {
+        *cursor++ = NDEF_LAYOUT_ME | NDEF_LAYOUT_SR | NDEF_LAYOUT_TNF_EXTERNAL;
+        *cursor++ = (uint8_t) (sizeof(STATUS_TYPE) - 1U);
+        *cursor++ = (uint8_t) NDEF_LAYOUT_STATUS_LEN;
+        memcpy(cursor, STATUS_TYPE, sizeof(STATUS_TYPE) - 1U);
+        cursor += sizeof(STATUS_TYPE) - 1U;
+        layout->status_offset = (size_t) (cursor - layout->message);
+        memcpy(cursor, status, NDEF_LAYOUT_STATUS_LEN);
+        cursor += NDEF_LAYOUT_STATUS_LEN;
+    }
+    layout->length = (size_t) (cursor - layout->message);
+    return true;
+}
+
+/**
+ * \brief Logs length and reads per tap of built layout compared to the full and minimal layouts.
+ *
+ * \param[in] layout Built layout.
+ * \param[in] mle Actual MLe (e.g. from capability container) to report reads for.
+ */
+void ndef_layout_report(const struct ndef_layout *layout, size_t mle)
+{
+    size_t full = ndef_layout_length(NDEF_LAYOUT_FIELDS_ALL);
+    size_t minimal = ndef_layout_length(NDEF_LAYOUT_REQUIRED_FIELDS | NDEF_LAYOUT_FIELD_ADDRESS | NDEF_LAYOUT_FIELD_ROLE);
+    // clang-format off
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "NDEF layout 0x%03X for MLe %u: %u bytes, %u read(s) per tap at MLe %u", layout->fields, (unsigned int) layout->mle, (unsigned int) layout->length, (unsigned int) ndef_layout_reads(layout->length, mle), (unsigned int) mle);
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "    full layout: %u bytes, %u read(s) - required fields only: %u bytes, %u read(s)", (unsigned int) full, (unsigned int) ndef_layout_reads(full, mle), (unsigned int) minimal, (unsigned int) ndef_layout_reads(minimal, mle));
+    // clang-format on
+}
@@ -0,0 +1,205 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file ndef-layout.h
+ * \brief Builder for the BLE connection handover NDEF message optimized for the number of READ BINARY commands per tap.
+ * \details Phones read the NDEF file length (NLEN) and then the message in chunks of at most MLe bytes. The builder selects all
+ *          required fields and adds optional fields (in order of ndef_layout_build()'s priority list) only as long as the message
+ *          still fits into the number of reads needed for the required fields alone.
+ * \details Message is populated according to *NFC Forum: Bluetooth Secure Simple Pairing Using NFC* application document using
+ *          short records only, with fields for:
+ *     * BLE Device Address (always included)
+ *     * BLE Role (always included)
+ *     * BLE Local Name (optional)
+ *     * BLE Appearance (optional)
+ *     * Security Manager TK (optional but required by AOSP based Bluetooth stacks - still ignored)
+ *     * LE Secure Connection Confirmation Value (optional but required by AOSP based Bluetooth stacks)
+ *     * LE Secure Connection Random Value (optional but required by AOSP based Bluetooth stacks)
+ *     * BLE OOB flags (optional)
+ * \details Optionally followed by a device status record (external type *infineon.com:status*).
+ */
+#ifndef NDEF_LAYOUT_H
+#define NDEF_LAYOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Field for BLE Device Address (always included).
+ */
+#define NDEF_LAYOUT_FIELD_ADDRESS 0x0001U
+
+/**
+ * \brief Field for BLE Role (always included).
+ */
+#define NDEF_LAYOUT_FIELD_ROLE 0x0002U
+
+/**
+ * \brief Field for BLE Local Name.
+ */
+#define NDEF_LAYOUT_FIELD_NAME 0x0004U
+
+/**
+ * \brief Field for BLE Appearance.
+ */
+#define NDEF_LAYOUT_FIELD_APPEARANCE 0x0008U
+
+/**
+ * \brief Field for Security Manager TK.
+ */
+#define NDEF_LAYOUT_FIELD_TK 0x0010U
+
+/**
+ * \brief Field for LE Secure Connection Confirmation Value.
+ */
+#define NDEF_LAYOUT_FIELD_CONFIRMATION 0x0020U
+
+/**
+ * \brief Field for LE Secure Connection Random Value.
+ */
+#define NDEF_LAYOUT_FIELD_RANDOM 0x0040U
+
+/**
+ * \brief Field for BLE OOB flags.
+ */
+#define NDEF_LAYOUT_FIELD_FLAGS 0x0080U
+
+/**
+ * \brief Device status record.
+ */
+#define NDEF_LAYOUT_FIELD_STATUS 0x0100U
+
+/**
+ * \brief All fields.
+ */
+#define NDEF_LAYOUT_FIELDS_ALL 0x01FFU
+
+/**
+ * \brief Fields required by AOSP based Bluetooth stacks.
+ */
+#define NDEF_LAYOUT_PROFILE_AOSP                                                                                                           \
+    (NDEF_LAYOUT_FIELD_ADDRESS | NDEF_LAYOUT_FIELD_ROLE | NDEF_LAYOUT_FIELD_TK | NDEF_LAYOUT_FIELD_CONFIRMATION | NDEF_LAYOUT_FIELD_RANDOM)
+
+/**
+ * \brief Fields required by Bluetooth stacks only evaluating LE Secure Connections OOB data.
+ */
+#define NDEF_LAYOUT_PROFILE_SECURE_CONNECTIONS                                                                                             \
+    (NDEF_LAYOUT_FIELD_ADDRESS | NDEF_LAYOUT_FIELD_ROLE | NDEF_LAYOUT_FIELD_CONFIRMATION | NDEF_LAYOUT_FIELD_RANDOM)
+
+/**
+ * \brief Fields always included in connection handover message (phone profile).
+ */
+#ifndef NDEF_LAYOUT_REQUIRED_FIELDS
+#define NDEF_LAYOUT_REQUIRED_FIELDS NDEF_LAYOUT_PROFILE_AOSP
+#endif
+
+/**
+ * \brief Fields included in connection handover message if they do not cost an additional read.
+ */
+#ifndef NDEF_LAYOUT_OPTIONAL_FIELDS
+#define NDEF_LAYOUT_OPTIONAL_FIELDS NDEF_LAYOUT_FIELDS_ALL
+#endif
+
+/**
+ * \brief MLe the layout is optimized for (maximum number of data bytes per READ BINARY as declared in the capability container).
+ */
+#ifndef NDEF_LAYOUT_MLE
+#define NDEF_LAYOUT_MLE 0xFFU
+#endif
+
+/**
+ * \brief Maximum length of connection handover message including NLEN (all fields).
+ */
+#define NDEF_LAYOUT_MAX_LEN 143U
+
+/**
+ * \brief Length of device status record payload.
+ */
+#define NDEF_LAYOUT_STATUS_LEN 6U
+
+/** \struct ndef_layout
+ * \brief Connection handover message and offsets of its variable values.
+ */
+struct ndef_layout
+{
+    /**
+     * \brief Message including NLEN.
+     */
+    uint8_t message[NDEF_LAYOUT_MAX_LEN];
+
+    /**
+     * \brief Number of bytes in ndef_layout.message.
+     */
+    size_t length;
+
+    /**
+     * \brief Selected fields (NDEF_LAYOUT_FIELD_*).
+     */
+    uint16_t fields;
+
+    /**
+     * \brief MLe the layout was optimized for.
+     */
+    size_t mle;
+
+    /**
+     * \brief Offset of BLE Device Address value.
+     */
+    size_t address_offset;
+
+    /**
+     * \brief Offset of LE Secure Connection Confirmation value (0 if not selected).
+     */
+    size_t confirmation_offset;
+
+    /**
+     * \brief Offset of LE Secure Connection Random value (0 if not selected).
+     */
+    size_t random_offset;
+
+    /**
+     * \brief Offset of device status payload (0 if not selected).
+     */
+    size_t status_offset;
+};
+
+/**
+ * \brief Returns number of READ BINARY commands a phone needs for a message.
+ *
+ * \param[in] length Length of message including NLEN.
+ * \param[in] mle Maximum number of data bytes per READ BINARY.
+ * \return size_t Number of READ BINARY commands (NLEN read separately).
+ */
+size_t ndef_layout_reads(size_t length, size_t mle);
+
+/**
+ * \brief Builds connection handover message with fewest reads for MLe.
+ *
+ * \param[out] layout Layout to be built.
+ * \param[in] mle Maximum number of data bytes per READ BINARY.
+ * \param[in] required Fields always included (NDEF_LAYOUT_FIELD_*).
+ * \param[in] optional Fields included if they do not cost an additional read (NDEF_LAYOUT_FIELD_*).
+ * \param[in] status Initial device status payload of NDEF_LAYOUT_STATUS_LEN bytes.
+ * \return bool \c true if successful, \c false if \c mle is invalid.
+ */
+bool ndef_layout_build(struct ndef_layout *layout, size_t mle, uint16_t required, uint16_t optional, const uint8_t status[NDEF_LAYOUT_STATUS_LEN]);
+
+/**
+ * \brief Logs length and reads per tap of built layout compared to the full and minimal layouts.
+ *
+ * \param[in] layout Built layout.
+ * \param[in] mle Actual MLe (e.g. from capability container) to report reads for.
+ */
+void ndef_layout_report(const struct ndef_layout *layout, size_t mle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NDEF_LAYOUT_H
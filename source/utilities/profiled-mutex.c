@@ -0,0 +1,267 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file profiled-mutex.c
+ * \brief FreeRTOS mutex wrapper recording contention.
+ * \details Records wait and hold times (DWT cycle counter) as well as owner/waiter task pairs per lock.
+ * \details profiled_mutex_report() logs the locks with the longest waits first.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cyhal.h"
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#include "infineon/ifx-logger.h"
+
+#include "profiled-mutex.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "Locks"
+
+/**
+ * \brief List of all profiled locks.
+ */
+static struct profiled_mutex *profiled_mutexes = NULL;
+
+/**
+ * \brief Returns current CPU cycle count, enabling DWT cycle counter on first use.
+ * \return uint32_t Current CPU cycle count.
+ */
+static uint32_t cycles_now(void)
+{
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0U)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0U;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    return DWT->CYCCNT;
+}
+
+/**
+ * \brief Returns CPU cycles elapsed since timestamp, also for spans exceeding the range of the 32 bit cycle counter.
+ *
+ * \details The cycle counter wraps after a few seconds (about 28 s at 150 MHz). The FreeRTOS tick count elapsed in the meantime tells how
+ *          many times it wrapped, the cycle counter delta still provides the exact remainder.
+ *
+ * \param[in] cycles Cycle counter value at start of span.
+ * \param[in] ticks FreeRTOS tick count at start of span.
+ * \return uint64_t Number of CPU cycles elapsed.
+ */
+static uint64_t cycles_since(uint32_t cycles, TickType_t ticks)
+{
+    uint32_t delta = cycles_now() - cycles;
+    uint64_t estimate = (uint64_t) (xTaskGetTickCount() - ticks) * (SystemCoreClock / configTICK_RATE_HZ);
+    if (estimate <= delta)
+    {
+        return delta;
+    }
+
+    // Tick based estimate is accurate to a tick, round to closest number of missed counter periods
+    uint64_t wraps = ((estimate - delta) + (1ULL << 31U)) >> 32U;
+    return delta + (wraps << 32U);
+}
+
+/**
+ * \brief Converts CPU cycles to microseconds.
+ * \param[in] cycles Number of CPU cycles.
+ * \return unsigned long Number of microseconds.
+ */
+static unsigned long cycles_to_us(uint64_t cycles)
+{
+    return (unsigned long) (cycles / (SystemCoreClock / 1000000U));
+}
+
+/**
+ * \brief Returns name of FreeRTOS task for reporting.
+ * \param[in] task FreeRTOS task (may be \c NULL).
+ * \return const char * Name of task.
+ */
+static const char *task_name(TaskHandle_t task)
+{
+    return (task != NULL) ? pcTaskGetName(task) : "?";
+}
+
+/**
+ * \brief Records contention between lock owner and waiting task.
+ * \param[in] mutex Contended lock.
+ * \param[in] owner Task holding lock when waiting started.
+ * \param[in] waiter Task that had to wait.
+ * \param[in] wait_cycles Wait time in CPU cycles.
+ */
+static void profiled_mutex_record_pair(struct profiled_mutex *mutex, TaskHandle_t owner, TaskHandle_t waiter, uint64_t wait_cycles)
+{
+    struct profiled_mutex_pair *slot = NULL;
+    for (size_t i = 0U; i < PROFILED_MUTEX_MAX_PAIRS; i++)
+    {
+        struct profiled_mutex_pair *pair = &mutex->pairs[i];
+        if (((pair->owner == owner) && (pair->waiter == waiter)) || (pair->count == 0U))
+        {
+            slot = pair;
+            break;
+        }
+        // Replace least severe pair if table is full
+        if ((slot == NULL) || (pair->max_wait_cycles < slot->max_wait_cycles))
+        {
+            slot = pair;
+        }
+    }
+    if ((slot->owner != owner) || (slot->waiter != waiter))
+    {
+        if ((slot->count > 0U) && (slot->max_wait_cycles >= wait_cycles))
+        {
+            return;
+        }
+        memset(slot, 0x00, sizeof(*slot));
+        slot->owner = owner;
+        slot->waiter = waiter;
+    }
+    slot->count++;
+    if (wait_cycles > slot->max_wait_cycles)
+    {
+        slot->max_wait_cycles = wait_cycles;
+    }
+}
+
+/**
+ * \brief Creates FreeRTOS mutex and registers lock for reporting.
+ *
+ * \details Not thread-safe, locks are expected to be created during initialization.
+ *
+ * \param[out] mutex Lock to be initialized.
+ * \param[in] name Name of lock used for reporting (must stay valid).
+ * \return bool \c true if successful.
+ */
+bool profiled_mutex_initialize(struct profiled_mutex *mutex, const char *name)
+{
+    if ((mutex == NULL) || (name == NULL))
+    {
+        return false;
+    }
+    memset(mutex, 0x00, sizeof(*mutex));
+    mutex->handle = xSemaphoreCreateMutex();
+    if (mutex->handle == NULL)
+    {
+        return false;
+    }
+    mutex->name = name;
+    mutex->next = profiled_mutexes;
+    profiled_mutexes = mutex;
+    return true;
+}
+
+/**
+ * \brief Takes lock and records wait time.
+ *
+ * \param[in] mutex Lock to be taken.
+ * \param[in] timeout Maximum number of ticks to wait.
+ * \return bool \c true if lock has been taken.
+ */
+bool profiled_mutex_take(struct profiled_mutex *mutex, TickType_t timeout)
+{
+    // Fast path without contention
+    if (xSemaphoreTake(mutex->handle, 0U) == pdPASS)
+    {
+        mutex->acquired_at = cycles_now();
+        mutex->acquired_at_tick = xTaskGetTickCount();
+        mutex->acquisitions++;
+        return true;
+    }
+
+    TaskHandle_t owner = xSemaphoreGetMutexHolder(mutex->handle);
+    uint32_t wait_start = cycles_now();
+    TickType_t wait_start_tick = xTaskGetTickCount();
+    if (xSemaphoreTake(mutex->handle, timeout) != pdPASS)
+    {
+        return false;
+    }
+    uint64_t wait_cycles = cycles_since(wait_start, wait_start_tick);
+    mutex->acquired_at = cycles_now();
+    mutex->acquired_at_tick = xTaskGetTickCount();
+    mutex->acquisitions++;
+    mutex->contended++;
+    mutex->total_wait_cycles += wait_cycles;
+    if (wait_cycles > mutex->max_wait_cycles)
+    {
+        mutex->max_wait_cycles = wait_cycles;
+    }
+    profiled_mutex_record_pair(mutex, owner, xTaskGetCurrentTaskHandle(), wait_cycles);
+    return true;
+}
+
+/**
+ * \brief Gives lock and records hold time.
+ *
+ * \param[in] mutex Lock to be given.
+ */
+void profiled_mutex_give(struct profiled_mutex *mutex)
+{
+    uint64_t hold_cycles = cycles_since(mutex->acquired_at, mutex->acquired_at_tick);
+    mutex->total_hold_cycles += hold_cycles;
+    if (hold_cycles > mutex->max_hold_cycles)
+    {
+        mutex->max_hold_cycles = hold_cycles;
+    }
+    xSemaphoreGive(mutex->handle);
+}
+
+/**
+ * \brief Logs statistics of all profiled locks, longest waits first.
+ */
+void profiled_mutex_report(void)
+{
+    // Simple selection by decreasing maximum wait time (only a handful of locks)
+    uint64_t previous_max = UINT64_MAX;
+    const struct profiled_mutex *previous = NULL;
+    while (1)
+    {
+        const struct profiled_mutex *worst = NULL;
+        bool passed_previous = (previous == NULL);
+        for (const struct profiled_mutex *mutex = profiled_mutexes; mutex != NULL; mutex = mutex->next)
+        {
+            if (mutex == previous)
+            {
+                passed_previous = true;
+                continue;
+            }
+            bool after_previous = (mutex->max_wait_cycles < previous_max) || ((mutex->max_wait_cycles == previous_max) && passed_previous);
+            if (after_previous && ((worst == NULL) || (mutex->max_wait_cycles > worst->max_wait_cycles)))
+            {
+                worst = mutex;
+            }
+        }
+        if (worst == NULL)
+        {
+            break;
+        }
+
+        // clang-format off
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "%s: %lu/%lu contended, wait max %lu us avg %lu us, hold max %lu us avg %lu us",
+                       worst->name, (unsigned long) worst->contended, (unsigned long) worst->acquisitions,
+                       cycles_to_us(worst->max_wait_cycles), (worst->contended > 0U) ? cycles_to_us(worst->total_wait_cycles / worst->contended) : 0UL,
+                       cycles_to_us(worst->max_hold_cycles), (worst->acquisitions > 0U) ? cycles_to_us(worst->total_hold_cycles / worst->acquisitions) : 0UL);
+        // clang-format on
+        for (size_t i = 0U; i < PROFILED_MUTEX_MAX_PAIRS; i++)
+        {
+            const struct profiled_mutex_pair *pair = &worst->pairs[i];
+            if (pair->count > 0U)
+            {
+                // clang-format off
+                ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "    %s waited for %s %lu times, max %lu us",
+                               task_name(pair->waiter), task_name(pair->owner), (unsigned long) pair->count, cycles_to_us(pair->max_wait_cycles));
+                // clang-format on
+            }
+        }
+        previous_max = worst->max_wait_cycles;
+        previous = worst;
+    }
+}
@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file profiled-mutex.h
+ * \brief FreeRTOS mutex wrapper recording contention.
+ * \details Records wait and hold times (DWT cycle counter) as well as owner/waiter task pairs per lock.
+ * \details profiled_mutex_report() logs the locks with the longest waits first.
+ */
+#ifndef PROFILED_MUTEX_H
+#define PROFILED_MUTEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Number of distinct owner/waiter task pairs recorded per lock.
+ */
+#ifndef PROFILED_MUTEX_MAX_PAIRS
+#define PROFILED_MUTEX_MAX_PAIRS 4U
+#endif
+
+/** \struct profiled_mutex_pair
+ * \brief Contention between a lock owner and a waiting task.
+ */
+struct profiled_mutex_pair
+{
+    /**
+     * \brief Task holding lock while \c waiter had to wait.
+     */
+    TaskHandle_t owner;
+
+    /**
+     * \brief Task waiting for lock.
+     */
+    TaskHandle_t waiter;
+
+    /**
+     * \brief Number of times \c waiter had to wait for \c owner.
+     */
+    uint32_t count;
+
+    /**
+     * \brief Longest wait of \c waiter for \c owner in CPU cycles.
+     */
+    uint64_t max_wait_cycles;
+};
+
+/** \struct profiled_mutex
+ * \brief FreeRTOS mutex with contention statistics.
+ */
+struct profiled_mutex
+{
+    /**
+     * \brief Actual FreeRTOS mutex.
+     */
+    SemaphoreHandle_t handle;
+
+    /**
+     * \brief Name of lock used for reporting.
+     */
+    const char *name;
+
+    /**
+     * \brief Number of successful acquisitions.
+     */
+    uint32_t acquisitions;
+
+    /**
+     * \brief Number of acquisitions that had to wait for another task.
+     */
+    uint32_t contended;
+
+    /**
+     * \brief Sum of all wait times in CPU cycles.
+     */
+    uint64_t total_wait_cycles;
+
+    /**
+     * \brief Longest wait time in CPU cycles.
+     */
+    uint64_t max_wait_cycles;
+
+    /**
+     * \brief Sum of all hold times in CPU cycles.
+     */
+    uint64_t total_hold_cycles;
+
+    /**
+     * \brief Longest hold time in CPU cycles.
+     */
+    uint64_t max_hold_cycles;
+
+    /**
+     * \brief Cycle counter value when lock was acquired.
+     */
+    uint32_t acquired_at;
+
+    /**
+     * \brief FreeRTOS tick count when lock was acquired (extends hold times beyond the cycle counter range).
+     */
+    TickType_t acquired_at_tick;
+
+    /**
+     * \brief Owner/waiter pairs with contention.
+     */
+    struct profiled_mutex_pair pairs[PROFILED_MUTEX_MAX_PAIRS];
+
+    /**
+     * \brief Next lock in list of all profiled locks.
+     */
+    struct profiled_mutex *next;
+};
+
+/**
+ * \brief Creates FreeRTOS mutex and registers lock for reporting.
+ *
+ * \details Not thread-safe, locks are expected to be created during initialization.
+ *
+ * \param[out] mutex Lock to be initialized.
+ * \param[in] name Name of lock used for reporting (must stay valid).
+ * \return bool \c true if successful.
+ */
+bool profiled_mutex_initialize(struct profiled_mutex *mutex, const char *name);
+
+/**
+ * \brief Takes lock and records wait time.
+ *
+ * \param[in] mutex Lock to be taken.
+ * \param[in] timeout Maximum number of ticks to wait.
+ * \return bool \c true if lock has been taken.
+ */
+bool profiled_mutex_take(struct profiled_mutex *mutex, TickType_t timeout);
+
+/**
+ * \brief Gives lock and records hold time.
+ *
+ * \param[in] mutex Lock to be given.
+ */
+void profiled_mutex_give(struct profiled_mutex *mutex);
+
+/**
+ * \brief Logs statistics of all profiled locks, longest waits first.
+ */
+void profiled_mutex_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROFILED_MUTEX_H
@@ -0,0 +1,383 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file watchdog-supervisor.c
+ * \brief Hardware watchdog supervisor requiring heartbeats from registered tasks.
+ * \details The hardware watchdog is only kicked while every registered task sent a heartbeat within its latency SLO.
+ * \details The first stall per boot is captured with context in no-init RAM, logged and persisted in data_storage after the watchdog reset.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cyhal.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "infineon/ifx-logger.h"
+
+#include "data-storage.h"
+#include "watchdog-supervisor.h"
+
+/**
+ * \brief String used as source information for logging.
+ */
+#define LOG_TAG "Watchdog"
+
+/**
+ * \brief Key of captured stall in data_storage.
+ */
+#define WATCHDOG_SUPERVISOR_STORAGE_KEY "wdt_stall"
+
+/**
+ * \brief Marker of valid stall record in no-init RAM.
+ */
+#define WATCHDOG_SUPERVISOR_STALL_MAGIC 0x57445453U
+
+/**
+ * \brief Maximum number of characters of task name in captured stall.
+ */
+#define WATCHDOG_SUPERVISOR_NAME_LEN 16U
+
+/**
+ * \brief State of a single supervised task.
+ */
+struct watchdog_supervisor_slot
+{
+    /**
+     * \brief Latency metrics (slot unused while watchdog_supervisor_stats.name is \c NULL).
+     */
+    struct watchdog_supervisor_stats stats;
+
+    /**
+     * \brief FreeRTOS task for stall context (may be \c NULL).
+     */
+    TaskHandle_t task;
+
+    /**
+     * \brief Tick count of last heartbeat.
+     */
+    volatile TickType_t last_heartbeat;
+
+    /**
+     * \brief Simple flag if supervision is currently suspended.
+     */
+    volatile bool suspended;
+
+    /**
+     * \brief Simple flag if task exceeded its SLO in last supervisor check (violations only count transitions).
+     */
+    bool stalled;
+};
+
+/**
+ * \brief Context of stall as captured in no-init RAM and persisted in data_storage.
+ */
+struct watchdog_supervisor_stall
+{
+    /**
+     * \brief WATCHDOG_SUPERVISOR_STALL_MAGIC if record is valid.
+     */
+    uint32_t magic;
+
+    /**
+     * \brief Name of stalled task.
+     */
+    char name[WATCHDOG_SUPERVISOR_NAME_LEN];
+
+    /**
+     * \brief Time since last heartbeat of stalled task.
+     */
+    uint32_t gap_ms;
+
+    /**
+     * \brief Uptime when stall was captured.
+     */
+    uint32_t uptime_ms;
+
+    /**
+     * \brief FreeRTOS state of stalled task (eTaskState, \c 0xFF if unknown).
+     */
+    uint8_t task_state;
+
+    /**
+     * \brief Minimum amount of free stack of stalled task in words (\c 0 if unknown).
+     */
+    uint32_t stack_high_water_mark;
+};
+
+/**
+ * \brief Supervised tasks.
+ */
+static struct watchdog_supervisor_slot slots[WATCHDOG_SUPERVISOR_MAX_TASKS];
+
+/**
+ * \brief Hardware watchdog.
+ */
+static cyhal_wdt_t watchdog;
+
+/**
+ * \brief Simple flag if a stall has already been captured since boot.
+ */
+static bool stall_captured = false;
+
+/**
+ * \brief Stall captured before watchdog reset.
+ * \details Kept in no-init RAM so that the supervisor never blocks on data_storage while the device is about to reset.
+ */
+static CY_NOINIT struct watchdog_supervisor_stall captured_stall;
+
+/**
+ * \brief Converts FreeRTOS ticks to milliseconds.
+ * \param[in] ticks Number of ticks.
+ * \return uint32_t Number of milliseconds.
+ */
+static uint32_t ticks_to_ms(TickType_t ticks)
+{
+    return (uint32_t) ticks * portTICK_PERIOD_MS;
+}
+
+/**
+ * \brief Registers task for supervision.
+ *
+ * \details Supervision starts immediately, first heartbeat is expected within \c slo_ms.
+ *
+ * \param[in] name Name of task used for logging (must stay valid).
+ * \param[in] task FreeRTOS task for stall context (may be \c NULL e.g. for stack callbacks).
+ * \param[in] slo_ms Maximum allowed time between two heartbeats.
+ * \return watchdog_supervisor_id_t ID for further calls or WATCHDOG_SUPERVISOR_INVALID_ID if no slot is free.
+ */
+watchdog_supervisor_id_t watchdog_supervisor_register(const char *name, TaskHandle_t task, uint32_t slo_ms)
+{
+    if (name == NULL)
+    {
+        return WATCHDOG_SUPERVISOR_INVALID_ID;
+    }
+    watchdog_supervisor_id_t id = WATCHDOG_SUPERVISOR_INVALID_ID;
+    taskENTER_CRITICAL();
+    for (size_t i = 0U; i < WATCHDOG_SUPERVISOR_MAX_TASKS; i++)
+    {
+        if (slots[i].stats.name == NULL)
+        {
+            memset(&slots[i], 0x00, sizeof(slots[i]));
+            slots[i].task = task;
+            slots[i].last_heartbeat = xTaskGetTickCount();
+            slots[i].stats.slo_ms = slo_ms;
+            slots[i].stats.name = name;
+            id = (watchdog_supervisor_id_t) i;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+    if (id == WATCHDOG_SUPERVISOR_INVALID_ID)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "No free slot to supervise %s", name);
+    }
+    return id;
+}
+
+/**
+ * \brief Signals that supervised task is alive.
+ *
+ * \param[in] id ID as returned by watchdog_supervisor_register().
+ */
+void watchdog_supervisor_heartbeat(watchdog_supervisor_id_t id)
+{
+    if ((id < 0) || ((size_t) id >= WATCHDOG_SUPERVISOR_MAX_TASKS))
+    {
+        return;
+    }
+    struct watchdog_supervisor_slot *slot = &slots[id];
+    TickType_t now = xTaskGetTickCount();
+    uint32_t gap_ms = ticks_to_ms(now - slot->last_heartbeat);
+    if (!slot->suspended && (gap_ms > slot->stats.max_gap_ms))
+    {
+        slot->stats.max_gap_ms = gap_ms;
+    }
+    slot->last_heartbeat = now;
+    slot->stats.heartbeats++;
+}
+
+/**
+ * \brief Suspends or resumes supervision, e.g. around intentionally long operations.
+ *
+ * \details Resuming counts as heartbeat.
+ *
+ * \param[in] id ID as returned by watchdog_supervisor_register().
+ * \param[in] suspended \c true to suspend, \c false to resume supervision.
+ */
+void watchdog_supervisor_suspend(watchdog_supervisor_id_t id, bool suspended)
+{
+    if ((id < 0) || ((size_t) id >= WATCHDOG_SUPERVISOR_MAX_TASKS))
+    {
+        return;
+    }
+    slots[id].last_heartbeat = xTaskGetTickCount();
+    slots[id].stalled = false;
+    slots[id].suspended = suspended;
+}
+
+/**
+ * \brief Captures context of stalled task in no-init RAM before the watchdog resets the device.
+ *
+ * \param[in] slot Stalled task.
+ * \param[in] gap_ms Time since last heartbeat of stalled task.
+ */
+static void watchdog_supervisor_capture(const struct watchdog_supervisor_slot *slot, uint32_t gap_ms)
+{
+    struct watchdog_supervisor_stall stall = {.gap_ms = gap_ms, .uptime_ms = ticks_to_ms(xTaskGetTickCount()), .task_state = 0xFFU};
+    strncpy(stall.name, slot->stats.name, sizeof(stall.name) - 1U);
+    if (slot->task != NULL)
+    {
+        stall.task_state = (uint8_t) eTaskGetState(slot->task);
+        stall.stack_high_water_mark = (uint32_t) uxTaskGetStackHighWaterMark(slot->task);
+    }
+
+    // clang-format off
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_FATAL, "%s stalled for %lu ms (SLO %lu ms, state %u, free stack %lu words)",
+                   stall.name, (unsigned long) gap_ms, (unsigned long) slot->stats.slo_ms, stall.task_state, (unsigned long) stall.stack_high_water_mark);
+    // clang-format on
+    stall.magic = WATCHDOG_SUPERVISOR_STALL_MAGIC;
+    captured_stall = stall;
+}
+
+/**
+ * \brief FreeRTOS task checking heartbeats and kicking hardware watchdog while all supervised tasks are within their SLO.
+ * \param[in] data Ignored.
+ */
+static void watchdog_supervisor_task(void *data)
+{
+    (void) data;
+
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(WATCHDOG_SUPERVISOR_PERIOD_MS));
+        TickType_t now = xTaskGetTickCount();
+        bool healthy = true;
+        for (size_t i = 0U; i < WATCHDOG_SUPERVISOR_MAX_TASKS; i++)
+        {
+            struct watchdog_supervisor_slot *slot = &slots[i];
+            if ((slot->stats.name == NULL) || slot->suspended)
+            {
+                continue;
+            }
+            uint32_t gap_ms = ticks_to_ms(now - slot->last_heartbeat);
+            if (gap_ms <= slot->stats.slo_ms)
+            {
+                slot->stalled = false;
+            }
+            else
+            {
+                healthy = false;
+                if (!slot->stalled)
+                {
+                    slot->stalled = true;
+                    slot->stats.violations++;
+                }
+                if (gap_ms > slot->stats.max_gap_ms)
+                {
+                    slot->stats.max_gap_ms = gap_ms;
+                }
+                if (!stall_captured)
+                {
+                    stall_captured = true;
+                    watchdog_supervisor_capture(slot, gap_ms);
+                }
+            }
+        }
+        if (healthy)
+        {
+            cyhal_wdt_kick(&watchdog);
+        }
+    }
+}
+
+/**
+ * \brief Logs stall captured before a previous watchdog reset and persists it in data_storage.
+ *
+ * \details No-init RAM holds arbitrary data after power-on, so the record is only trusted after a watchdog reset.
+ */
+static void watchdog_supervisor_report_previous_stall(void)
+{
+    struct watchdog_supervisor_stall stall = captured_stall;
+    memset(&captured_stall, 0x00, sizeof(captured_stall));
+    if ((stall.magic != WATCHDOG_SUPERVISOR_STALL_MAGIC) || (cyhal_system_get_reset_reason() != CYHAL_SYSTEM_RESET_WDT))
+    {
+        return;
+    }
+    stall.name[sizeof(stall.name) - 1U] = '\0';
+    // clang-format off
+    ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_ERROR, "Watchdog reset after %s stalled for %lu ms at uptime %lu ms (state %u, free stack %lu words)",
+                   stall.name, (unsigned long) stall.gap_ms, (unsigned long) stall.uptime_ms, stall.task_state, (unsigned long) stall.stack_high_water_mark);
+    // clang-format on
+    if (data_storage_set(WATCHDOG_SUPERVISOR_STORAGE_KEY, (uint8_t *) (&stall), sizeof(stall)) != CY_RSLT_SUCCESS)
+    {
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_WARN, "Could not persist stall information");
+    }
+}
+
+/**
+ * \brief Starts hardware watchdog and supervisor task.
+ *
+ * \details data_storage must already be initialized. Logs and persists stall captured before a previous watchdog reset.
+ *
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t watchdog_supervisor_start(void)
+{
+    watchdog_supervisor_report_previous_stall();
+    cyhal_system_clear_reset_reason();
+
+    uint32_t timeout_ms = WATCHDOG_SUPERVISOR_TIMEOUT_MS;
+    if (timeout_ms > cyhal_wdt_get_max_timeout_ms())
+    {
+        timeout_ms = cyhal_wdt_get_max_timeout_ms();
+    }
+    cy_rslt_t result = cyhal_wdt_init(&watchdog, timeout_ms);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+    if (xTaskCreate(watchdog_supervisor_task, (char *) "Watchdog", 1024U, 0U, configMAX_PRIORITIES - 1U, NULL) != pdPASS)
+    {
+        cyhal_wdt_free(&watchdog);
+        return CY_RSLT_TYPE_ERROR;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * \brief Returns latency metrics of supervised task.
+ *
+ * \param[in] id ID as returned by watchdog_supervisor_register().
+ * \return const struct watchdog_supervisor_stats * Metrics or \c NULL for invalid ID.
+ */
+const struct watchdog_supervisor_stats *watchdog_supervisor_stats(watchdog_supervisor_id_t id)
+{
+    if ((id < 0) || ((size_t) id >= WATCHDOG_SUPERVISOR_MAX_TASKS) || (slots[id].stats.name == NULL))
+    {
+        return NULL;
+    }
+    return &slots[id].stats;
+}
+
+/**
+ * \brief Logs latency metrics of all supervised tasks.
+ */
+void watchdog_supervisor_report(void)
+{
+    for (size_t i = 0U; i < WATCHDOG_SUPERVISOR_MAX_TASKS; i++)
+    {
+        const struct watchdog_supervisor_stats *stats = &slots[i].stats;
+        if (stats->name == NULL)
+        {
+            continue;
+        }
+        // clang-format off
+        ifx_logger_log(ifx_logger_default, LOG_TAG, IFX_LOG_INFO, "%s: max gap %lu ms (SLO %lu ms), %lu heartbeats, %lu violations",
+                       stats->name, (unsigned long) stats->max_gap_ms, (unsigned long) stats->slo_ms, (unsigned long) stats->heartbeats, (unsigned long) stats->violations);
+        // clang-format on
+    }
+}
@@ -0,0 +1,142 @@
+// SPDX-FileCopyrightText: 2024 Infineon Technologies AG
+// SPDX-License-Identifier: MIT
+
+/**
+ * \file watchdog-supervisor.h
+ * \brief Hardware watchdog supervisor requiring heartbeats from registered tasks.
+ * \details The hardware watchdog is only kicked while every registered task sent a heartbeat within its latency SLO.
+ * \details The first stall per boot is captured with context in no-init RAM, logged and persisted in data_storage after the watchdog reset.
+ */
+#ifndef WATCHDOG_SUPERVISOR_H
+#define WATCHDOG_SUPERVISOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cyhal.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Maximum number of supervised tasks.
+ */
+#ifndef WATCHDOG_SUPERVISOR_MAX_TASKS
+#define WATCHDOG_SUPERVISOR_MAX_TASKS 6U
+#endif
+
+/**
+ * \brief Hardware watchdog timeout (limited to maximum supported by hardware).
+ */
+#ifndef WATCHDOG_SUPERVISOR_TIMEOUT_MS
+#define WATCHDOG_SUPERVISOR_TIMEOUT_MS 4000U
+#endif
+
+/**
+ * \brief Period in which supervisor checks heartbeats and kicks hardware watchdog.
+ */
+#ifndef WATCHDOG_SUPERVISOR_PERIOD_MS
+#define WATCHDOG_SUPERVISOR_PERIOD_MS 500U
+#endif
+
+/**
+ * \brief Identifier of supervised task as returned by watchdog_supervisor_register().
+ */
+typedef int8_t watchdog_supervisor_id_t;
+
+/**
+ * \brief Invalid watchdog_supervisor_id_t (e.g. no free slot).
+ */
+#define WATCHDOG_SUPERVISOR_INVALID_ID ((watchdog_supervisor_id_t) -1)
+
+/** \struct watchdog_supervisor_stats
+ * \brief Latency metrics of a supervised task.
+ */
+struct watchdog_supervisor_stats
+{
+    /**
+     * \brief Name of supervised task.
+     */
+    const char *name;
+
+    /**
+     * \brief Maximum allowed time between two heartbeats.
+     */
+    uint32_t slo_ms;
+
+    /**
+     * \brief Maximum time between two heartbeats observed since boot.
+     */
+    uint32_t max_gap_ms;
+
+    /**
+     * \brief Number of heartbeats since boot.
+     */
+    uint32_t heartbeats;
+
+    /**
+     * \brief Number of times the SLO was exceeded (consecutive supervisor checks of one stall count once).
+     */
+    uint32_t violations;
+};
+
+/**
+ * \brief Registers task for supervision.
+ *
+ * \details Supervision starts immediately, first heartbeat is expected within \c slo_ms.
+ *
+ * \param[in] name Name of task used for logging (must stay valid).
+ * \param[in] task FreeRTOS task for stall context (may be \c NULL e.g. for stack callbacks).
+ * \param[in] slo_ms Maximum allowed time between two heartbeats.
+ * \return watchdog_supervisor_id_t ID for further calls or WATCHDOG_SUPERVISOR_INVALID_ID if no slot is free.
+ */
+watchdog_supervisor_id_t watchdog_supervisor_register(const char *name, TaskHandle_t task, uint32_t slo_ms);
+
+/**
+ * \brief Signals that supervised task is alive.
+ *
+ * \param[in] id ID as returned by watchdog_supervisor_register().
+ */
+void watchdog_supervisor_heartbeat(watchdog_supervisor_id_t id);
+
+/**
+ * \brief Suspends or resumes supervision, e.g. around intentionally long operations.
+ *
+ * \details Resuming counts as heartbeat.
+ *
+ * \param[in] id ID as returned by watchdog_supervisor_register().
+ * \param[in] suspended \c true to suspend, \c false to resume supervision.
+ */
+void watchdog_supervisor_suspend(watchdog_supervisor_id_t id, bool suspended);
+
+/**
+ * \brief Starts hardware watchdog and supervisor task.
+ *
+ * \details data_storage must already be initialized. Logs and persists stall captured before a previous watchdog reset.
+ *
+ * \returns cy_rslt_t CR_RSLT_SUCCESS if successful, any other value in case of error.
+ */
+cy_rslt_t watchdog_supervisor_start(void);
+
+/**
+ * \brief Returns latency metrics of supervised task.
+ *
+ * \param[in] id ID as returned by watchdog_supervisor_register().
+ * \return const struct watchdog_supervisor_stats * Metrics or \c NULL for invalid ID.
+ */
+const struct watchdog_supervisor_stats *watchdog_supervisor_stats(watchdog_supervisor_id_t id);
+
+/**
+ * \brief Logs latency metrics of all supervised tasks.
+ */
+void watchdog_supervisor_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WATCHDOG_SUPERVISOR_H